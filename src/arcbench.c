@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arcbench - measures how well evicted tuples are compressed in the
+ * archive, and how fast the archive can be scanned
+ *
+ * usage: ./arcbench [-n tuples] [-d directory]
+ *
+ * appends tuples shaped like those of the Flows table to the archive of a
+ * table in `directory' (/tmp/arcbench by default), a millisecond apart,
+ * then reports the bytes they took in memory and on disk, and the rate at
+ * which they were archived, scanned in full and scanned for a single port
+ */
+#include "map.h"
+#include "filecrawler.h"
+#include "table.h"
+#include "tuple.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include "rtab.h"
+#include "sqlstmts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define USAGE "./arcbench [-n tuples] [-d directory]"
+#define NCOLS 7
+
+static char *colnames[NCOLS] = {"proto", "saddr", "sport", "daddr", "dport",
+                                "npkts", "nbytes"};
+static int dports[] = {80, 443, 53, 22, 25, 123, 8080, 993};
+
+/*
+ * scan the archive of `t' in full, with `nfilters' filters, and report
+ * the rate
+ */
+static void scan(char *label, T *t, Table *tb, int nfilters,
+                 sqlfilter **filters) {
+    sqlwindow win;
+    Filecrawler *fc;
+    Predicate *p;
+    Rtab *results;
+    tstamp_t start, finish;
+    long long n = t_position(t);
+    int i;
+
+    memset(&win, 0, sizeof(win));
+    win.type = SQL_WINTYPE_SINCE;
+    results = rtab_new();
+    results->ncols = NCOLS;
+    results->colnames = (char **)malloc(NCOLS * sizeof(char *));
+    for (i = 0; i < NCOLS; i++)
+        results->colnames[i] = strdup(colnames[i]);
+    table_extract_relevant_types(tb, results);
+    start = timestamp_now();
+    p = predicate_new(tb, nfilters, filters, SQL_FILTER_TYPE_AND);
+    fc = filecrawler_new(t, n);
+    filecrawler_window(fc, &win, 0);
+    filecrawler_filter(fc, p);
+    filecrawler_project(fc, tb, results);
+    filecrawler_free(fc);
+    predicate_free(p);
+    finish = timestamp_now();
+    printf("%-12s %10.0f tuples/s, %d rows selected\n", label,
+           (double)n / ((double)(finish - start) / 1.0e9), results->nrows);
+    rtab_free(results);
+}
+
+int main(int argc, char *argv[]) {
+    int *coltypes[NCOLS];
+    char *dir = "/tmp/arcbench";
+    char proto[8], saddr[16], sport[8], daddr[16], dport[8];
+    char npkts[16], nbytes[16];
+    char *vals[NCOLS];
+    unsigned char buf[MAX_TUPLE_SIZE];
+    long long ntuples = 1000000LL, mem = 0, disk = 0;
+    tstamp_t ts, start, finish;
+    sqlfilter filter, *filters[1];
+    Table *tb;
+    Map *map;
+    T *t;
+    long long k;
+    int i, j, len;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-n") == 0)
+            ntuples = atoll(argv[j]);
+        else if (strcmp(argv[i], "-d") == 0)
+            dir = argv[j];
+        else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+            exit(1);
+        }
+        i = j + 1;
+    }
+    if (ntuples < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    for (j = 0; j < NCOLS; j++)
+        coltypes[j] = (j == 1 || j == 3) ? PRIMTYPE_VARCHAR : PRIMTYPE_INTEGER;
+    tb = table_new(NCOLS, colnames, coltypes);
+    table_tabletype(tb, 0, -1);
+    (void) mkdir(dir, 0755);
+    if (! (map = map_new(dir)) ||
+        ! (t = map_create_table(map, "Flows", NCOLS, colnames, coltypes))) {
+        fprintf(stderr, "unable to create archive in %s\n", dir);
+        exit(1);
+    }
+    vals[0] = proto;
+    vals[1] = saddr;
+    vals[2] = sport;
+    vals[3] = daddr;
+    vals[4] = dport;
+    vals[5] = npkts;
+    vals[6] = nbytes;
+    srandom(42);
+    ts = timestamp_now();
+    start = timestamp_now();
+    for (k = 0; k < ntuples; k++) {
+        long r = random();
+        sprintf(proto, "%d", (r & 3) ? 6 : 17);
+        sprintf(saddr, "192.168.1.%ld", (r >> 2) % 64);
+        sprintf(sport, "%ld", 1024 + (r >> 8) % 60000);
+        sprintf(daddr, "10.20.%ld.%ld", (r >> 24) % 4, (r >> 12) % 200);
+        sprintf(dport, "%d", dports[(r >> 20) % 8]);
+        sprintf(npkts, "%lld", 1 + k % 100);
+        sprintf(nbytes, "%lld", 64 * (1 + k % 100) + (r >> 4) % 64);
+        len = tuple_length(tb, NCOLS, vals);
+        if (! tuple_encode(tb, NCOLS, vals, buf))
+            exit(1);
+        if (! t_append(t, ts + k * 1000000ULL, buf, len))
+            exit(1);
+        mem += len;
+    }
+    t_closefiles(t);
+    finish = timestamp_now();
+    for (j = 0; j < t->nfiles; j++)
+        disk += t->files[j]->size;
+    printf("%lld tuples: %lld bytes in memory, %lld bytes archived, ratio %.2f\n",
+           ntuples, mem, disk, (double)mem / (double)disk);
+    printf("%-12s %10.0f tuples/s\n", "archive",
+           (double)ntuples / ((double)(finish - start) / 1.0e9));
+    scan("full scan", t, tb, 0, NULL);
+    memset(&filter, 0, sizeof(filter));
+    filter.varname = "dport";
+    filter.sign = SQL_FILTER_EQUAL;
+    filter.value.intv = 443;
+    filters[0] = &filter;
+    scan("dport = 443", t, tb, 1, filters);
+    map_destroy(map);
+    return 0;
+}
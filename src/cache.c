@@ -32,10 +32,14 @@
 /*
  * Homework Cache
  *
- * single-threaded provider of the Homework Database using SRPC
+ * provider of the Homework Database using SRPC
  *
  * expects SQL statement in input buffer, sends back results of
  * query in output buffer
+ *
+ * requests are served by the thread that receives them, or, with -w, by
+ * a pool of worker threads; the requests from an endpoint always go to
+ * the same worker, so they are answered in the order they were sent
  */
 
 #include "config.h"
@@ -44,20 +48,27 @@
 #include "rtab.h"
 #include "srpc/srpc.h"
 #include "mb.h"
+#include "wal.h"
+#include "checkpoint.h"
+#include "map.h"
 #include "timestamp.h"
+#include "adts/tsuqueue.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#include <pthread.h>
 
-#define USAGE "./cache [-p port] [-l packets|stats] [-c config-file]"
+#define USAGE "./cache [-p port] [-l packets|stats] [-c config-file] [-m size[k|m|g]] [-b normal|thp|huge[,populate]] [-j log-file] [-f always|off|millis] [-r checkpoint] [-a archive-dir] [-w workers]"
 #define LOG_STATS 1
 #define LOG_PACKETS 2
 #define STATS_COUNT 10000
 #define ILLEGAL_QUERY_RESPONSE "1<|>Illegal query<|>0<|>0<|>\n"
+#define MAX_WORKERS 64
 
 char *progname;
 int must_exit = 0;
@@ -67,6 +78,32 @@ extern int log_allocation;
 static char buf[SOCK_RECV_BUF_LEN];
 static char resp[SOCK_RECV_BUF_LEN];
 
+/*
+ * a request queued for a worker, and the worker with its own response
+ * buffer
+ */
+typedef struct request {
+    RpcEndpoint sender;
+    char buf[1];		/* the request, nul-terminated */
+} Request;
+
+typedef struct worker {
+    pthread_t thr;
+    TSUQueue *queue;
+    char resp[SOCK_RECV_BUF_LEN];
+} Worker;
+
+static RpcService rps;
+static int logging;
+static int isreadonly;
+static int nworkers;		/* 0 if requests are served in place */
+static Worker *workers;
+static long pending;		/* requests queued or being served */
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+static int count;		/* statements since the last mb_dump */
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void signal_handler(int signum) {
     sig_received = signum;
     must_exit++;
@@ -108,6 +145,70 @@ static void loadfile(char *file, int log, int isreadonly) {
     fclose(fd);
 }
 
+/*
+ * convert "<number>[k|m|g]" to a number of bytes; returns 0 if malformed
+ */
+static long parse_size(char *s) {
+    char *p;
+    long n = strtol(s, &p, 10);
+
+    switch (*p) {
+    case 'k': case 'K':
+        n *= 1024L;
+        p++;
+        break;
+    case 'm': case 'M':
+        n *= 1024L * 1024L;
+        p++;
+        break;
+    case 'g': case 'G':
+        n *= 1024L * 1024L * 1024L;
+        p++;
+        break;
+    }
+    return (*p == '\0' && n > 0) ? n : 0L;
+}
+
+/*
+ * convert a comma-separated list of page policies to MB_PAGES_* flags;
+ * returns -1 if malformed
+ */
+static int parse_policy(char *s) {
+    char tmp[128], *w;
+    int policy = 0;
+
+    strncpy(tmp, s, sizeof(tmp) - 1);
+    tmp[sizeof(tmp) - 1] = '\0';
+    for (w = strtok(tmp, ","); w; w = strtok(NULL, ",")) {
+        if (strcmp(w, "normal") == 0)
+            ;
+        else if (strcmp(w, "thp") == 0)
+            policy |= MB_PAGES_THP;
+        else if (strcmp(w, "huge") == 0)
+            policy |= MB_PAGES_HUGETLB;
+        else if (strcmp(w, "populate") == 0)
+            policy |= MB_PAGES_POPULATE;
+        else
+            return -1;
+    }
+    return policy;
+}
+
+/*
+ * convert a log sync policy to WAL_SYNC_*, storing the interval in
+ * `millis' if it is a number of milliseconds; returns -1 if malformed
+ */
+static int parse_sync(char *s, int *millis) {
+    char *p;
+
+    if (strcmp(s, "always") == 0)
+        return WAL_SYNC_ALWAYS;
+    if (strcmp(s, "off") == 0)
+        return WAL_SYNC_OFF;
+    *millis = (int)strtol(s, &p, 10);
+    return (*p == '\0' && *millis > 0) ? WAL_SYNC_BATCH : -1;
+}
+
 static void crtolf(char *buf) {
     while (*buf != '\0')
         if (*buf == '\r')
@@ -116,25 +217,214 @@ static void crtolf(char *buf) {
             buf++;
 }
 
+/*
+ * add `n' to the count of statements executed, dumping the statistics of
+ * the memory buffer every STATS_COUNT statements
+ */
+static void tally(int n) {
+    int dump;
+
+    pthread_mutex_lock(&count_lock);
+    if ((dump = ((count += n) >= STATS_COUNT)))
+        count = 0;
+    pthread_mutex_unlock(&count_lock);
+    if (dump && logging >= LOG_STATS)
+        mb_dump();
+}
+
+/*
+ * serve the SQL, BULK, PREPARE or EXECUTE request in `buf', which is
+ * overwritten, leaving the response in `resp'; returns the length of the
+ * response
+ *
+ * may be called by several workers at once
+ */
+static unsigned serve(char *buf, char *resp) {
+    Rtab *results;
+    char *p, *q, *r;
+    int i, j, n, ninserts, sofar;
+    unsigned len;
+
+    p = strchr(buf, ':');
+    if (p == NULL) {
+        printf("Illegal query: %s\n", buf);
+        strcpy(resp, ILLEGAL_QUERY_RESPONSE);
+        return strlen(resp) + 1;
+    }
+    *p++ = '\0';
+    n = 0;
+    if (strcmp(buf, "SQL") == 0) {
+        n++;
+        q = p;
+        p = strchr(q, '\n');
+        if (p)
+            *p++ ='\0';
+        results = hwdb_exec_query(q, isreadonly);
+        if (logging >= LOG_PACKETS) {
+            rtab_print(results);
+        }
+        if (! results) {
+            strcpy(resp, "1<|>Error<|>0<|>0<|>\n");
+            len = strlen(resp) + 1;
+        } else {
+            if (! rtab_pack(results, resp, SOCK_RECV_BUF_LEN, &i))
+                printf("query results truncated\n");
+            len = i;
+        }
+        rtab_free(results);
+    } else if (strcmp(buf, "BULK") == 0) {
+        q = p;
+        p = strchr(q, '\n');
+        *p++ = '\0';
+        ninserts = atoi(q);
+        r = resp;
+        sofar = 0;
+        for (j = 0; j < ninserts; j++) {
+            q = p;
+            p = strchr(q, '\n');
+            *p++ = '\0';
+            n++;
+            results = hwdb_exec_query(q, isreadonly);
+            if (logging >= LOG_PACKETS) {
+                rtab_print(results);
+            }
+            if (! results) {
+                sofar += sprintf(r+sofar, "1<|>Error<|>0<|>0<|>\n");
+            } else {
+                (void) rtab_pack(results, r+sofar, SOCK_RECV_BUF_LEN, &i);
+                sofar += i;
+            }
+            rtab_free(results);
+        }
+        len = sofar;
+    } else if (strcmp(buf, "PREPARE") == 0) {
+        q = p;
+        if ((p = strchr(q, '\n')))
+            *p = '\0';
+        if (hwdb_prepare(q))
+            sprintf(resp, "0<|>Prepare success<|>0<|>0<|>\n");
+        else
+            sprintf(resp, "1<|>Prepare failed<|>0<|>0<|>\n");
+        len = strlen(resp) + 1;
+    } else if (strcmp(buf, "EXECUTE") == 0) {
+        n++;
+        q = p;
+        if ((p = strchr(q, '\n')))
+            *p = '\0';
+        results = hwdb_execute(q, isreadonly);
+        if (logging >= LOG_PACKETS) {
+            rtab_print(results);
+        }
+        if (! rtab_pack(results, resp, SOCK_RECV_BUF_LEN, &i))
+            printf("query results truncated\n");
+        len = i;
+        rtab_free(results);
+    } else {
+        printf("Illegal query: %s:%s\n", buf, p);
+        strcpy(resp, ILLEGAL_QUERY_RESPONSE);
+        len = strlen(resp) + 1;
+    }
+    tally(n);
+    return len;
+}
+
+static void *work(void *arg) {
+    Worker *w = (Worker *)arg;
+    Request *rq;
+    unsigned len;
+
+    for (;;) {
+        tsuq_take(w->queue, (void **)&rq);
+        len = serve(rq->buf, w->resp);
+        rpc_response(rps, &rq->sender, w->resp, len);
+        free(rq);
+        pthread_mutex_lock(&pending_lock);
+        if (--pending == 0)
+            pthread_cond_broadcast(&drained);
+        pthread_mutex_unlock(&pending_lock);
+    }
+    return NULL;
+}
+
+/*
+ * start `n' workers; returns 1 if successful, 0 if not
+ */
+static int start_workers(int n) {
+    int i;
+
+    if (! (workers = (Worker *)malloc(n * sizeof(Worker))))
+        return 0;
+    for (i = 0; i < n; i++) {
+        if (! (workers[i].queue = tsuq_create()))
+            return 0;
+        if (pthread_create(&workers[i].thr, NULL, work, &workers[i]))
+            return 0;
+    }
+    nworkers = n;
+    return 1;
+}
+
+/*
+ * queue the request of `len' bytes in `buf' from `sender' for the worker
+ * that serves the sender, chosen from its address, port and subport; the
+ * rest of the endpoint, including padding, is not hashed
+ */
+static void dispatch(RpcEndpoint *sender, char *buf, unsigned len) {
+    unsigned long h;
+    Request *rq;
+
+    if (! (rq = (Request *)malloc(sizeof(Request) + len))) {
+        len = serve(buf, resp);
+        rpc_response(rps, sender, resp, len);
+        return;
+    }
+    h = (unsigned long)ntohl(sender->addr.sin_addr.s_addr);
+    h = 33 * h ^ (unsigned long)ntohs(sender->addr.sin_port);
+    h = 33 * h ^ sender->subport;
+    rq->sender = *sender;
+    memcpy(rq->buf, buf, len + 1);
+    pthread_mutex_lock(&pending_lock);
+    pending++;
+    pthread_mutex_unlock(&pending_lock);
+    tsuq_add(workers[h % nworkers].queue, rq);
+}
+
+/*
+ * wait until the workers have served every queued request, so that
+ * SNAPSHOT and CHECKPOINT see no insert in progress
+ */
+static void drain(void) {
+    pthread_mutex_lock(&pending_lock);
+    while (pending > 0)
+        pthread_cond_wait(&drained, &pending_lock);
+    pthread_mutex_unlock(&pending_lock);
+}
+
 int main(int argc, char *argv[]) {
     RpcEndpoint sender;
     unsigned len;
-    RpcService rps;
     unsigned short port, snap;
     int i, j;
-    Rtab *results;
-    int log, count;
-    char *p, *q, *r;
-    int ninserts, sofar;
+    char *p, *q;
     char *cfile;
     tstamp_t start, finish;
-    int isreadonly;
+    int nthreads;
+    long mbsize;
+    int policy;
+    char *logfile;
+    int sync, millis;
 
     port = HWDB_SERVER_PORT;
     snap = HWDB_SNAPSHOT_PORT;
-    log = LOG_STATS;
+    logging = LOG_STATS;
     cfile = NULL;
     isreadonly = 0;
+    mbsize = 0L;
+    policy = MB_PAGES_THP;
+    logfile = NULL;
+    sync = WAL_SYNC_ALWAYS;
+    millis = 0;
+    nthreads = 0;
     for (i = 1; i < argc; ) {
         if ((j = i + 1) == argc) {
             fprintf(stderr, "usage: %s\n", USAGE);
@@ -145,24 +435,56 @@ int main(int argc, char *argv[]) {
             snap = port + 1;
         } else if (strcmp(argv[i], "-l") == 0) {
             if (strcmp(argv[j], "packets") == 0)
-                log = LOG_PACKETS;
+                logging = LOG_PACKETS;
             else if (strcmp(argv[j], "stats") == 0)
-                log = LOG_STATS;
+                logging = LOG_STATS;
             else {
                 fprintf(stderr, "usage: %s\n", USAGE);
             }
         } else if (strcmp(argv[i], "-c") == 0) {
             cfile = argv[j];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (! (mbsize = parse_size(argv[j]))) {
+                fprintf(stderr, "usage: %s\n", USAGE);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-b") == 0) {
+            if ((policy = parse_policy(argv[j])) < 0) {
+                fprintf(stderr, "usage: %s\n", USAGE);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-r") == 0) {
+            ckpt_configure(argv[j]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            map_configure(argv[j]);
+        } else if (strcmp(argv[i], "-j") == 0) {
+            logfile = argv[j];
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if ((sync = parse_sync(argv[j], &millis)) < 0) {
+                fprintf(stderr, "usage: %s\n", USAGE);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-w") == 0) {
+            nthreads = atoi(argv[j]);
+            if (nthreads < 0 || nthreads > MAX_WORKERS) {
+                fprintf(stderr, "usage: %s\n", USAGE);
+                exit(1);
+            }
         } else {
             fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
         }
         i = j + 1;
     }
     printf("initializing database\n");
-    hwdb_init(1);
+    mb_configure(mbsize, policy);
+    wal_configure(logfile, sync, millis);
+    if (! hwdb_init(1)) {
+        fprintf(stderr, "Failure to initialize database\n");
+        exit(-1);
+    }
     if (cfile) {
         printf("processing configuration file %s\n", cfile);
-        loadfile(cfile, log, isreadonly);
+        loadfile(cfile, logging, isreadonly);
     }
     printf("initializing rpc system\n");
     if (!rpc_init(port)) {
@@ -175,9 +497,15 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Failure offering HWDB service\n");
         exit(-1);
     }
+    if (nthreads > 0) {
+        printf("starting %d workers\n", nthreads);
+        if (! start_workers(nthreads)) {
+            fprintf(stderr, "Failure to start workers\n");
+            exit(-1);
+        }
+    }
     printf("starting to read queries from network\n");
     //log_allocation = 1;
-    count = 0;
 
     if (signal(SIGTERM, signal_handler) == SIG_IGN)
         signal(SIGTERM, SIG_IGN);
@@ -199,6 +527,12 @@ int main(int argc, char *argv[]) {
      *
      * SNAPSHOT:\n
      *
+     * CHECKPOINT:<file>\n
+     *
+     * PREPARE:<name> AS insert into ..... values (..., ?, ...)\n
+     *
+     * EXECUTE:<name> (<value>, ...)\n
+     *
      * For SQL queries, the response will consist of a line of the form
      *
      * status<|>Status comment<|>ncols<|>nrows<|>\n
@@ -211,74 +545,28 @@ int main(int argc, char *argv[]) {
      *
      * status<|>Status comment<|>0<|>0<|>\n
      *
-     * For SNAPSHOT commands, the response will consist of a line
+     * For SNAPSHOT, CHECKPOINT and PREPARE commands, the response will
+     * consist of a line
      *
      * status<|>Status comment<|>0<|>0<|>\n
+     *
+     * PREPARE checks an insert once and names it; each `?' among its
+     * values is a parameter, for which EXECUTE supplies a value, so that
+     * the insert is done without parsing any SQL.  The response to EXECUTE
+     * is that of the insert.
      */
     while (! must_exit) {
         if ((len = rpc_query(rps, &sender, buf, SOCK_RECV_BUF_LEN)) == 0)
             break;
         buf[len] = '\0';
-        if (log >= LOG_PACKETS) {
+        if (logging >= LOG_PACKETS) {
             static char tmp[SOCK_RECV_BUF_LEN];
             strcpy(tmp, buf);
             crtolf(tmp);
             MSG("Received: %s", tmp);
         }
-        p = strchr(buf, ':');
-        if (p == NULL) {
-            printf("Illegal query: %s\n", buf);
-            strcpy(resp, ILLEGAL_QUERY_RESPONSE);
-            len = strlen(resp) + 1;
-            rpc_response(rps, &sender, resp, len);
-            continue;
-        }
-        *p++ = '\0';
-        if (strcmp(buf, "SQL") == 0) {
-            count++;
-            q = p;
-            p = strchr(q, '\n');
-            if (p)
-                *p++ ='\0';
-            results = hwdb_exec_query(q, isreadonly);
-            if (log >= LOG_PACKETS) {
-                rtab_print(results);
-            }
-            if (! results) {
-                strcpy(resp, "1<|>Error<|>0<|>0<|>\n");
-                len = strlen(resp) + 1;
-            } else {
-                if (! rtab_pack(results, resp, SOCK_RECV_BUF_LEN, &i))
-                    printf("query results truncated\n");
-                len = i;
-            }
-            rtab_free(results);
-        } else if (strcmp(buf, "BULK") == 0) {
-            q = p;
-            p = strchr(q, '\n');
-            *p++ = '\0';
-            ninserts = atoi(q);
-            r = resp;
-            sofar = 0;
-            for (j = 0; j < ninserts; j++) {
-                q = p;
-                p = strchr(q, '\n');
-                *p++ = '\0';
-                count++;
-                results = hwdb_exec_query(q, isreadonly);
-                if (log >= LOG_PACKETS) {
-                    rtab_print(results);
-                }
-                if (! results) {
-                    sofar += sprintf(r+sofar, "1<|>Error<|>0<|>0<|>\n");
-                } else {
-                    (void) rtab_pack(results, r+sofar, SOCK_RECV_BUF_LEN, &i);
-                    sofar += i;
-                }
-                rtab_free(results);
-            }
-            len = sofar;
-        } else if (strcmp(buf, "SNAPSHOT") == 0) {
+        if (strncmp(buf, "SNAPSHOT:", 9) == 0) {
+            drain();
             start = timestamp_now();
             rpc_suspend();		/* suspend RPC processing */
             pid_t pid = fork();
@@ -308,19 +596,29 @@ int main(int argc, char *argv[]) {
                     exit(1);
                 setsid();		/* new session */
                 isreadonly = 1;
+                nworkers = 0;		/* the workers were not forked */
                 continue;		/* no response to send */
             }
-        } else {
-            printf("Illegal query: %s:%s\n", buf, p);
-            strcpy(resp, ILLEGAL_QUERY_RESPONSE);
+        } else if (strncmp(buf, "CHECKPOINT:", 11) == 0) {
+            long nrows;
+            q = buf + 11;
+            if ((p = strchr(q, '\n')))
+                *p = '\0';
+            drain();
+            start = timestamp_now();
+            if (*q == '\0' || (nrows = hwdb_checkpoint(q)) < 0) {
+                sprintf(resp, "1<|>Checkpoint failed<|>0<|>0<|>\n");
+            } else {
+                finish = (timestamp_now() - start) / 100000;
+                sprintf(resp, "0<|>Checkpoint success, %ld rows, %lld.%lld ms<|>0<|>0<|>\n", nrows, finish/10, finish%10);
+            }
             len = strlen(resp) + 1;
-        }
+        } else if (nworkers > 0) {
+            dispatch(&sender, buf, len);
+            continue;			/* the worker responds */
+        } else
+            len = serve(buf, resp);
         rpc_response(rps, &sender, resp, len);
-        if (count >= STATS_COUNT) {
-            count = 0;
-            if (log >= LOG_STATS)
-                mb_dump();
-        }
     }
     /*
      * we reach here if a signal is received or rpc_query yields 0
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * cachebench - measures how long inserting clients wait for the cache
+ * while another client runs a slow group-by select
+ *
+ * usage: ./cachebench [-h host] [-p port] [-c clients] [-n inserts-per-client] [-r rows]
+ *
+ * a reader repeatedly selects a sum grouped over a table of `rows' rows
+ * while each of the clients inserts into a table of its own over a
+ * connection of its own; the insert throughput and the median, 99th
+ * percentile and worst insert latencies are printed.  Run it against
+ * `cache' and `cache -w N' to compare the two.
+ */
+#include "config.h"
+#include "timestamp.h"
+#include "srpc/srpc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define USAGE "./cachebench [-h host] [-p port] [-c clients] [-n inserts-per-client] [-r rows]"
+#define MAX_CLIENTS 64
+#define BULK_ROWS 500
+
+static char *host = HWDB_SERVER_ADDR;
+static unsigned short port = HWDB_SERVER_PORT;
+static long ninserts = 10000L;
+static volatile int done = 0;
+static long nselects = 0L;
+
+typedef struct client {
+    pthread_t thr;
+    int id;
+    tstamp_t *latency;		/* of each insert, in nanoseconds */
+} Client;
+
+static RpcConnection connect_cache(void) {
+    RpcConnection rpc;
+
+    if (! (rpc = rpc_connect(host, port, "HWDB", 1l))) {
+        fprintf(stderr, "unable to connect to %s:%hu\n", host, port);
+        exit(1);
+    }
+    return rpc;
+}
+
+/*
+ * send `query' and check that it succeeded
+ */
+static void call(RpcConnection rpc, char *query) {
+    Q_Decl(q, SOCK_RECV_BUF_LEN);
+    char resp[SOCK_RECV_BUF_LEN];
+    unsigned len;
+
+    strcpy(q, query);
+    if (! rpc_call(rpc, Q_Arg(q), strlen(q) + 1, resp, sizeof(resp), &len)) {
+        fprintf(stderr, "rpc_call() failed\n");
+        exit(1);
+    }
+    if (resp[0] != '0') {
+        fprintf(stderr, "query failed: %s", query);
+        exit(1);
+    }
+}
+
+static void *reader(void *arg) {
+    RpcConnection rpc = (RpcConnection)arg;
+
+    while (! done) {
+        call(rpc, "SQL:select b, sum(a) from BenchRows group by b\n");
+        nselects++;
+    }
+    return NULL;
+}
+
+static void *inserter(void *arg) {
+    Client *c = (Client *)arg;
+    RpcConnection rpc = connect_cache();
+    char query[256];
+    tstamp_t start;
+    long i;
+
+    for (i = 0; i < ninserts; i++) {
+        sprintf(query, "SQL:insert into Bench%d values ('%ld', 'v%ld')\n",
+                c->id, i, i % 13);
+        start = timestamp_now();
+        call(rpc, query);
+        c->latency[i] = timestamp_now() - start;
+    }
+    rpc_disconnect(rpc);
+    return NULL;
+}
+
+static int cmp(const void *a, const void *b) {
+    tstamp_t x = *(tstamp_t *)a, y = *(tstamp_t *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+int main(int argc, char *argv[]) {
+    int nclients = 4;
+    long nrows = 20000L;
+    int i, j;
+    long k, n;
+    char *query, *q;
+    RpcConnection rpc;
+    pthread_t rthr;
+    Client *clients;
+    tstamp_t start, finish, *all;
+    double secs;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-h") == 0)
+            host = argv[j];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = atoi(argv[j]);
+        else if (strcmp(argv[i], "-c") == 0)
+            nclients = atoi(argv[j]);
+        else if (strcmp(argv[i], "-n") == 0)
+            ninserts = atol(argv[j]);
+        else if (strcmp(argv[i], "-r") == 0)
+            nrows = atol(argv[j]);
+        else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+            exit(1);
+        }
+        i = j + 1;
+    }
+    if (nclients < 1 || nclients > MAX_CLIENTS || ninserts < 1 || nrows < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    if (! rpc_init(0)) {
+        fprintf(stderr, "Failure to initialize rpc system\n");
+        exit(1);
+    }
+    rpc = connect_cache();
+    query = (char *)malloc(SOCK_RECV_BUF_LEN);
+    for (i = 0; i < nclients; i++) {
+        sprintf(query, "SQL:create table Bench%d (a integer, b varchar(16))\n", i);
+        call(rpc, query);
+    }
+    call(rpc, "SQL:create table BenchRows (a integer, b varchar(16))\n");
+    for (k = 0; k < nrows; k += n) {
+        n = (nrows - k < BULK_ROWS) ? nrows - k : BULK_ROWS;
+        q = query + sprintf(query, "BULK:%ld\n", n);
+        for (i = 0; i < n; i++)
+            q += sprintf(q, "insert into BenchRows values ('%ld', 'k%ld')\n",
+                         (k + i) % 97, (k + i) % 13);
+        call(rpc, query);
+    }
+    printf("%d clients, %ld inserts per client, %ld rows selected\n",
+           nclients, ninserts, nrows);
+
+    clients = (Client *)malloc(nclients * sizeof(Client));
+    all = (tstamp_t *)malloc(nclients * ninserts * sizeof(tstamp_t));
+    pthread_create(&rthr, NULL, reader, rpc);
+    start = timestamp_now();
+    for (i = 0; i < nclients; i++) {
+        clients[i].id = i;
+        clients[i].latency = all + i * ninserts;
+        pthread_create(&clients[i].thr, NULL, inserter, &clients[i]);
+    }
+    for (i = 0; i < nclients; i++)
+        pthread_join(clients[i].thr, NULL);
+    finish = timestamp_now();
+    done = 1;
+    pthread_join(rthr, NULL);
+    rpc_disconnect(rpc);
+
+    n = nclients * ninserts;
+    qsort(all, n, sizeof(tstamp_t), cmp);
+    secs = (double)(finish - start) / 1.0e9;
+    printf("%10.0f inserts/s, %ld selects\n", (double)n / secs, nselects);
+    printf("insert latency: median %.3f ms, 99%% %.3f ms, worst %.3f ms\n",
+           (double)all[n / 2] / 1.0e6, (double)all[n * 99 / 100] / 1.0e6,
+           (double)all[n - 1] / 1.0e6);
+    return 0;
+}
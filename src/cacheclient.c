@@ -166,6 +166,16 @@ int main(int argc, char *argv[]) {
             n = strlen(query) + 1;	/* count '\0' */
             nreplies = 1;
             ifsnapshot++;
+        } else if (strncmp(inb, "CHECKPOINT:", 11) == 0) {
+            strcpy(query, inb);
+            n = strlen(query) + 1;
+            nreplies = 1;
+            ifsnapshot++;
+        } else if (strncmp(inb, "PREPARE:", 8) == 0 ||
+                   strncmp(inb, "EXECUTE:", 8) == 0) {
+            strcpy(query, inb);
+            n = strlen(query) + 1;
+            nreplies = 1;
         } else if (strncmp(inb, "JOIN:", 5) == 0) {  /* join host:port 4 fwd */
             strcpy(query, inb);
             n = strlen(query) + 1;
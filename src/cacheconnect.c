@@ -337,6 +337,66 @@ CacheResponse raw_sql(char* query_text) {
     return newCacheResponse(rbuf, len);
 }
 
+static CacheResponse cache_call(char* query, int qlen) {
+    int rc;
+    unsigned len;
+
+    int rlen=4096;
+    char rbuf[rlen];
+
+    Q_Decl(equery, qlen);
+    memcpy(equery, query, qlen);
+    rc = rpc_call(rpc, Q_Arg(equery), qlen, rbuf, rlen, &len);
+    if(rc==0) {
+        printf("query failed catastrophically\n");
+        return NULL;
+    }
+    return newCacheResponse(rbuf, len);
+}
+
+CacheResponse prepare_sql(char* name, char* insert_text) {
+    CacheResponse result;
+    char* query;
+    int rc;
+
+    rc = asprintf(&query, "PREPARE:%s AS %s", name, insert_text);
+    if(rc<1) {
+        fprintf(stderr, "Can't generate the prepare string.\n");
+        return NULL;
+    }
+    result = cache_call(query, rc+1);
+    free(query);
+    return result;
+}
+
+CacheResponse execute_sql(char* name, int nvals, char** vals) {
+    CacheResponse result;
+    char* query;
+    char* p;
+    int i, qlen;
+
+    /* each value is quoted with whichever quote it does not contain */
+    qlen = strlen("EXECUTE:") + strlen(name) + strlen(" ()") + 1;
+    for(i=0; i<nvals; i++) {
+        if(strchr(vals[i], '"') && strchr(vals[i], '\'')) {
+            fprintf(stderr, "Can't quote value %d for execute.\n", i);
+            return NULL;
+        }
+        qlen += strlen(vals[i]) + 4;
+    }
+    query = (char*)malloc(qlen);
+    if(query==NULL) { return NULL; }
+    p = query + sprintf(query, "EXECUTE:%s (", name);
+    for(i=0; i<nvals; i++) {
+        char q = strchr(vals[i], '"') ? '\'' : '"';
+        p += sprintf(p, "%s%c%s%c", (i>0) ? ", " : "", q, vals[i], q);
+    }
+    p += sprintf(p, ")");
+    result = cache_call(query, p-query+1);
+    free(query);
+    return result;
+}
+
 CacheResponse file_sql(char* fname) {
     CacheResponse result;
     FILE* f;
@@ -57,4 +57,9 @@ int install_file_automata(char* fname, AutomataHandler_t ahandle);
 CacheResponse raw_sql(char* query_text);
 CacheResponse file_sql(char* fname);
 
+/* Prepared inserts: `?' marks a parameter in the values of insert_text,
+ * and execute_sql supplies nvals values for them */
+CacheResponse prepare_sql(char* name, char* insert_text);
+CacheResponse execute_sql(char* name, int nvals, char** vals);
+
 #endif
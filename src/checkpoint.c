@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * checkpoint.c - write every table to a binary file, and load it again
+ *
+ * a checkpoint holds the schema of each table followed by its rows, oldest
+ * first; a row is its timestamp, its length and the encoded tuple itself,
+ * so loading a row is a copy rather than a parse.  dictionary codes do not
+ * outlive the process, so the text of dictionary-encoded columns is
+ * written in the tuple, to be interned again when it is loaded.  the file is written
+ * under a temporary name and renamed into place, and is memory-mapped when
+ * it is loaded
+ *
+ * persistent tables are captured with all of them locked, together with
+ * the position in the write-ahead log, so that only the later part of the
+ * log is replayed after the checkpoint is loaded; each stream table is
+ * captured in a snapshot, so inserts carry on while it is written
+ *
+ * stream rows are loaded in timestamp order across tables, so that the
+ * regions evict them in the order in which they were first inserted
+ *
+ * the rows of a compressed table are written as its chunks, each stamped
+ * like the node that holds it; its open rows are encoded as chunks too
+ */
+
+#include "checkpoint.h"
+#include "indextable.h"
+#include "table.h"
+#include "node.h"
+#include "tuple.h"
+#include "mb.h"
+#include "chunk.h"
+#include "wal.h"
+#include "typetable.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CKPT_MAGIC "HWDBCKPT"
+#define CKPT_VERSION 5
+#define CKPT_BUFSIZ (1024 * 1024)	/* stdio buffer used when writing */
+
+struct ckpt_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int ptrsize;	/* sizeof(char *) where it was written */
+    unsigned long long walpos;	/* log position the checkpoint covers */
+    unsigned int ntables;
+};
+
+/*
+ * followed by the NUL-terminated name of the table, and then the
+ * NUL-terminated name and type name of each column, and a byte that is 1
+ * if the column is dictionary-encoded
+ */
+struct ckpt_table {
+    short tabletype;
+    short primary_column;
+    int ncols;
+    int compress;		/* rows that follow are chunks */
+    long long quota;		/* limits of a private region, else 0 */
+    long long rows;
+    tstamp_t ttl;		/* age at which rows expire, 0 if never */
+    long long count;		/* number of rows that follow */
+};
+
+/*
+ * followed by `len' bytes of encoded tuple, or of chunk
+ */
+struct ckpt_row {
+    tstamp_t tstamp;
+    unsigned int len;
+};
+
+/*
+ * position in a mapped checkpoint
+ */
+typedef struct cursor {
+    unsigned char *p;
+    unsigned char *end;
+    Table *tb;			/* table whose rows are being read */
+    long long left;		/* rows of tb still to be read */
+} Cursor;
+
+static char *ckpt_file = NULL;		/* checkpoint to load, if any */
+
+static int put(FILE *fp, void *p, size_t n) {
+    return (fwrite(p, 1, n, fp) == n);
+}
+
+static int put_string(FILE *fp, const char *s) {
+    return put(fp, (void *)s, strlen(s) + 1);
+}
+
+static int write_schema(FILE *fp, Table *tn, long long count) {
+    struct ckpt_table ct;
+    int i, ok;
+    char dict;
+
+    memset(&ct, 0, sizeof(ct));
+    ct.tabletype = tn->tabletype;
+    ct.primary_column = tn->primary_column;
+    ct.ncols = tn->ncols;
+    ct.compress = (tn->chunks != NULL);
+    mb_region_limits(tn, &ct.quota, &ct.rows);
+    ct.ttl = tn->ttl;
+    ct.count = count;
+    ok = put(fp, &ct, sizeof(ct)) && put_string(fp, tn->name);
+    for (i = 0; ok && i < tn->ncols; i++) {
+        dict = (tn->dict && tn->dict[i]) ? 1 : 0;
+        ok = put_string(fp, tn->colname[i]) &&
+             put_string(fp, primtype_name[*(tn->coltype[i])]) &&
+             put(fp, &dict, 1);
+    }
+    return ok;
+}
+
+/*
+ * write the `count' rows of `tn' from `first' on; `snap', if not NULL, is
+ * the snapshot holding them, which is moved on as they are written
+ */
+static int write_rows(FILE *fp, Table *tn, Node *first, long long count,
+                      Snapshot *snap) {
+    struct ckpt_row cr;
+    union Tuple buf;
+    unsigned char *t;
+    Node *n;
+    long long i;
+
+    memset(&cr, 0, sizeof(cr));
+    for (i = 0, n = first; i < count; i++, n = n->next) {
+        if (snap && i > 0 && i % MB_SNAPSHOT_STEP == 0)
+            mb_snapshot_advance(tn, snap, n->tstamp);
+        cr.tstamp = n->tstamp;
+        cr.len = n->real_len;
+        t = n->tuple;
+        if (tn->dict) {
+            cr.len = tuple_inline(tn, n->tuple, buf.bytes, sizeof(buf));
+            if (cr.len > sizeof(buf)) {
+                errorf("row of %s too long for checkpoint\n", tn->name);
+                return 0;
+            }
+            t = buf.bytes;
+        }
+        if (! put(fp, &cr, sizeof(cr)) || ! put(fp, t, cr.len))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * a chunk of open rows, encoded for writing
+ */
+typedef struct pending {
+    unsigned char *chunk;
+    int len;
+    tstamp_t tstamp;
+} Pending;
+
+/*
+ * encode the `open' rows of compressed table `tn' as chunks, stamped no
+ * earlier than `after', in `pend', which has room for one per row
+ *
+ * returns the number of chunks
+ */
+static long encode_open(Table *tn, Chunks *open, tstamp_t after,
+                        Pending *pend) {
+    long n = 0, nrows;
+    CHeader hdr;
+
+    while (open->nrows > 0) {
+        if ((pend[n].len = chunk_encode(tn, open, &pend[n].chunk, &nrows))) {
+            memcpy(&hdr, pend[n].chunk, sizeof(hdr));
+            pend[n].tstamp = (hdr.newest > after) ? hdr.newest : after;
+            n++;
+        } else {
+            errorf("unable to checkpoint %ld rows of %s\n", nrows, tn->name);
+        }
+        chunk_drop(open, nrows);
+    }
+    return n;
+}
+
+static int write_pending(FILE *fp, Pending *pend, long n) {
+    struct ckpt_row cr;
+    long i;
+
+    memset(&cr, 0, sizeof(cr));
+    for (i = 0; i < n; i++) {
+        cr.tstamp = pend[i].tstamp;
+        cr.len = pend[i].len;
+        if (! put(fp, &cr, sizeof(cr)) || ! put(fp, pend[i].chunk, cr.len))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * ckpt_write() - write every table in `itab' to `file', returning the
+ * number of rows written in `nrows'
+ *
+ * return 1 if successful, 0 if not
+ */
+int ckpt_write(Indextable *itab, char *file, long *nrows) {
+    struct ckpt_header h;
+    Table **tables, *tn;
+    char *tmp;
+    FILE *fp;
+    long n, i;
+    int ok = 1;
+
+    *nrows = 0;
+    if (! (tables = itab_tables(itab, &n)))
+        return 0;
+    if (! (tmp = (char *)malloc(strlen(file) + 5))) {
+        free(tables);
+        return 0;
+    }
+    sprintf(tmp, "%s.tmp", file);
+    if (! (fp = fopen(tmp, "w"))) {
+        errorf("unable to create checkpoint %s\n", tmp);
+        free(tmp);
+        free(tables);
+        return 0;
+    }
+    (void) setvbuf(fp, NULL, _IOFBF, CKPT_BUFSIZ);
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CKPT_MAGIC, sizeof(h.magic));
+    h.version = CKPT_VERSION;
+    h.ptrsize = sizeof(char *);
+    h.ntables = n;
+    ok = put(fp, &h, sizeof(h));
+
+    /* persistent tables, all locked so that they agree with the log */
+    for (i = 0; i < n; i++)
+        if (table_persistent(tables[i]))
+            table_lock(tables[i]);
+    h.walpos = wal_position();
+    for (i = 0; i < n; i++) {
+        tn = tables[i];
+        if (! table_persistent(tn))
+            continue;
+        ok = ok && write_schema(fp, tn, tn->count) &&
+             write_rows(fp, tn, tn->oldest, tn->count, NULL);
+        *nrows += tn->count;
+    }
+    for (i = 0; i < n; i++)
+        if (table_persistent(tables[i]))
+            table_unlock(tables[i]);
+
+    /* stream tables, each from a snapshot */
+    for (i = 0; ok && i < n; i++) {
+        Snapshot snap;
+        Node *first;
+        long long count;
+        Chunks open;
+        Pending *pend = NULL;
+        long j, npend = 0;
+        tstamp_t after = 0;
+        tn = tables[i];
+        if (table_persistent(tn))
+            continue;
+        memset(&open, 0, sizeof(open));
+        mb_lock(tn);
+        first = tn->oldest;
+        count = tn->count;
+        if (count) {
+            mb_snapshot_take(tn, &snap, first->tstamp);
+            after = tn->newest->tstamp;
+        }
+        if (tn->chunks && tn->chunks->nrows &&
+            (open.rows = (unsigned char *)malloc(tn->chunks->lrows))) {
+            memcpy(open.rows, tn->chunks->rows, tn->chunks->lrows);
+            open.nrows = tn->chunks->nrows;
+            open.lrows = open.srows = tn->chunks->lrows;
+        }
+        mb_unlock(tn);
+        if (open.nrows &&
+            (pend = (Pending *)malloc(open.nrows * sizeof(Pending))))
+            npend = encode_open(tn, &open, after, pend);
+        ok = write_schema(fp, tn, count + npend) &&
+             write_rows(fp, tn, first, count, &snap) && write_pending(fp, pend, npend);
+        if (count)
+            mb_snapshot_release(tn, &snap);
+        *nrows += count + npend;
+        for (j = 0; j < npend; j++)
+            free(pend[j].chunk);
+        free(pend);
+        free(open.rows);
+    }
+
+    ok = ok && fseek(fp, 0L, SEEK_SET) == 0 && put(fp, &h, sizeof(h));
+    ok = (fflush(fp) == 0) && ok && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok && rename(tmp, file) != 0)
+        ok = 0;
+    if (! ok) {
+        errorf("unable to write checkpoint %s\n", file);
+        (void) unlink(tmp);
+    }
+    free(tmp);
+    free(tables);
+    return ok;
+}
+
+static int get(Cursor *c, void *dst, size_t n) {
+    if ((size_t)(c->end - c->p) < n)
+        return 0;
+    memcpy(dst, c->p, n);
+    c->p += n;
+    return 1;
+}
+
+static char *get_string(Cursor *c) {
+    char *s = (char *)c->p;
+    unsigned char *q = memchr(c->p, '\0', c->end - c->p);
+    if (! q)
+        return NULL;
+    c->p = q + 1;
+    return s;
+}
+
+/*
+ * read the schema of a table at `c' and create the table
+ *
+ * returns the table, or NULL if the schema is malformed or the table
+ * cannot be created
+ */
+static Table *load_schema(Indextable *itab, Cursor *c, struct ckpt_table *ct) {
+    char *name, *tname, **names, *coldict;
+    int **types, i, idx;
+    Table *tn = NULL;
+
+    if (! get(c, ct, sizeof(*ct)) || ct->ncols <= 0 || ct->count < 0 ||
+            ! (name = get_string(c)))
+        return NULL;
+    names = (char **)malloc(ct->ncols * sizeof(char *));
+    types = (int **)malloc(ct->ncols * sizeof(int *));
+    coldict = (char *)malloc(ct->ncols);
+    for (i = 0; names && types && coldict && i < ct->ncols; i++) {
+        if (! (names[i] = get_string(c)) || ! (tname = get_string(c)) ||
+                ! get(c, &coldict[i], 1))
+            break;
+        if ((idx = typetable_index(tname)) < 0)
+            break;
+        types[i] = &primtype_val[idx];
+    }
+    if (names && types && coldict && i == ct->ncols &&
+            itab_create_table(itab, name, ct->ncols, names, types, coldict,
+                              ct->tabletype, ct->primary_column,
+                              ct->quota, ct->rows, ct->compress))
+        tn = itab_table_lookup(itab, name);
+    if (tn && ct->ttl && ! mb_ttl(tn, ct->ttl))
+        tn = NULL;
+    free(names);
+    free(types);
+    free(coldict);
+    return tn;
+}
+
+/*
+ * check the `c->left' rows of `c->tb' at `c', leaving `c' at the first of
+ * them and `next' after the last
+ */
+static int skip_rows(Cursor *c, Cursor *next) {
+    struct ckpt_row cr;
+    long long i;
+    unsigned int max = (c->tb->chunks) ? CHUNK_MAX : MAX_TUPLE_SIZE;
+
+    *next = *c;
+    for (i = 0; i < c->left; i++) {
+        if (! get(next, &cr, sizeof(cr)) || cr.len == 0 || cr.len > max ||
+                (size_t)(next->end - next->p) < cr.len)
+            return 0;
+        next->p += cr.len;
+    }
+    return 1;
+}
+
+/*
+ * load the next row at `c' into its table
+ */
+static int load_row(Cursor *c) {
+    struct ckpt_row cr;
+
+    (void) get(c, &cr, sizeof(cr));
+    if (c->tb->chunks) {
+        if (! mb_restore_chunk(c->tb, c->p, cr.len, cr.tstamp))
+            return 0;
+    } else if (! mb_restore_tuple(c->tb, c->p, cr.len, cr.tstamp))
+        return 0;
+    c->p += cr.len;
+    c->left--;
+    return 1;
+}
+
+static tstamp_t next_tstamp(Cursor *c) {
+    struct ckpt_row cr;
+    memcpy(&cr, c->p, sizeof(cr));
+    return cr.tstamp;
+}
+
+/*
+ * ckpt_configure() - load `file' when the database is initialized
+ */
+void ckpt_configure(char *file) {
+    ckpt_file = file;
+}
+
+/*
+ * ckpt_load() - create the tables held in the configured checkpoint, if
+ * any, calling `restored' for each, and load their rows; the position in
+ * the log from which to replay is returned in `walpos'
+ *
+ * return 1 if successful, 0 if not
+ */
+int ckpt_load(Indextable *itab, CkptRestored restored, unsigned long long *walpos) {
+    struct ckpt_header h;
+    struct ckpt_table ct;
+    struct stat st;
+    unsigned char *map;
+    Cursor c, *streams = NULL;
+    unsigned int i;
+    int fd, nstreams = 0, ok = 0;
+    long long nrows = 0;
+
+    *walpos = 0;
+    if (! ckpt_file)
+        return 1;
+    if ((fd = open(ckpt_file, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        errorf("unable to open checkpoint %s\n", ckpt_file);
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    map = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        errorf("unable to map checkpoint %s\n", ckpt_file);
+        return 0;
+    }
+#ifdef MADV_SEQUENTIAL
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+    c.p = map;
+    c.end = map + st.st_size;
+    if (! get(&c, &h, sizeof(h)) ||
+            memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) != 0 ||
+            h.version != CKPT_VERSION || h.ptrsize != sizeof(char *)) {
+        errorf("%s is not a checkpoint written by this version\n", ckpt_file);
+        goto done;
+    }
+    streams = (Cursor *)malloc((h.ntables + 1) * sizeof(Cursor));
+    for (i = 0; streams && i < h.ntables; i++) {
+        Cursor next;
+        if (! (c.tb = load_schema(itab, &c, &ct)))
+            break;
+        c.left = ct.count;
+        if (! skip_rows(&c, &next))
+            break;
+        restored(c.tb);
+        nrows += ct.count;
+        if (table_persistent(c.tb)) {
+            while (c.left > 0)
+                if (! load_row(&c))
+                    goto done;
+        } else if (c.left > 0)
+            streams[nstreams++] = c;
+        c = next;
+    }
+    if (! streams || i < h.ntables) {
+        errorf("checkpoint %s is malformed\n", ckpt_file);
+        goto done;
+    }
+    /* merge the stream tables, oldest row first */
+    for (;;) {
+        int j, k = -1;
+        for (j = 0; j < nstreams; j++)
+            if (streams[j].left > 0 &&
+                    (k < 0 || next_tstamp(&streams[j]) < next_tstamp(&streams[k])))
+                k = j;
+        if (k < 0)
+            break;
+        if (! load_row(&streams[k]))
+            goto done;
+    }
+    *walpos = h.walpos;
+    ok = 1;
+    debugf("loaded %u tables and %lld rows from checkpoint %s\n",
+           h.ntables, nrows, ckpt_file);
+done:
+    free(streams);
+    (void) munmap(map, st.st_size);
+    return ok;
+}
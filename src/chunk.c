@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * chunk.c - compressed storage for stream tables
+ *
+ * a select decodes the chunks in its window one at a time, after taking
+ * a snapshot of the table and a copy of its open rows, so that inserts
+ * carry on while it runs
+ */
+
+#include "chunk.h"
+#include "codec.h"
+#include "mb.h"
+#include "node.h"
+#include "tuple.h"
+#include "nodecrawler.h"
+#include "gram.h"
+#include "util.h"
+#include "adts/linkedlist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS_INITIAL 16384	/* initial bytes for open rows */
+
+Chunks *chunk_new(void) {
+    Chunks *c = (Chunks *)calloc(1, sizeof(Chunks));
+
+    if (c && ! (c->rows = (unsigned char *)malloc(ROWS_INITIAL))) {
+        free(c);
+        return NULL;
+    }
+    if (c)
+        c->srows = ROWS_INITIAL;
+    return c;
+}
+
+int chunk_append(Chunks *c, tstamp_t ts, unsigned char *tuple, int len) {
+    long need = sizeof(CRow) + CHUNK_PADDED(len);
+    CRow *r;
+
+    if (c->lrows + need > c->srows) {
+        long size = 2 * c->srows;
+        unsigned char *p;
+        while (size < c->lrows + need)
+            size *= 2;
+        if (! (p = (unsigned char *)realloc(c->rows, size)))
+            return 0;
+        c->rows = p;
+        c->srows = size;
+    }
+    r = (CRow *)(c->rows + c->lrows);
+    r->tstamp = ts;
+    r->len = len;
+    memcpy(c->rows + c->lrows + sizeof(CRow), tuple, len);
+    c->lrows += need;
+    c->nrows++;
+    return 1;
+}
+
+/*
+ * return the row after the `nrows' rows at `p'
+ */
+static unsigned char *skip(unsigned char *p, long nrows) {
+    while (nrows-- > 0)
+        p += sizeof(CRow) + CHUNK_PADDED(((CRow *)p)->len);
+    return p;
+}
+
+void chunk_drop(Chunks *c, long nrows) {
+    unsigned char *p = skip(c->rows, nrows);
+
+    c->lrows -= p - c->rows;
+    c->nrows -= nrows;
+    memmove(c->rows, p, c->lrows);
+}
+
+/*
+ * encode the `n' rows at `rows' in the malloc'ed buffer `*chunk'
+ *
+ * returns the length of the chunk, or 0 if out of memory
+ */
+static int encode(Table *tb, unsigned char *rows, long n,
+                  unsigned char **chunk) {
+    unsigned char *tuples[CHUNK_ROWS], *p, *q;
+    long long delta, last;
+    CHeader hdr;
+    long i, text;
+    int c;
+
+    memset(&hdr, 0, sizeof(hdr));
+    for (i = 0, q = rows; i < n; i++) {
+        CRow *r = (CRow *)q;
+        tuples[i] = q + sizeof(CRow);
+        if (! i)
+            hdr.oldest = r->tstamp;
+        hdr.newest = r->tstamp;
+        q += sizeof(CRow) + CHUNK_PADDED(r->len);
+    }
+    hdr.nrows = n;
+    text = q - rows;
+    if (! (*chunk = (unsigned char *)malloc(sizeof(hdr) + n * VARINT_MAX +
+                                            tb->ncols * codec_bound(n, text))))
+        return 0;
+    memcpy(*chunk, &hdr, sizeof(hdr));
+    p = *chunk + sizeof(hdr);
+    for (i = 1, q = rows, last = 0; i < n; i++) {
+        tstamp_t prev = ((CRow *)q)->tstamp;
+        q += sizeof(CRow) + CHUNK_PADDED(((CRow *)q)->len);
+        delta = (long long)(((CRow *)q)->tstamp - prev);
+        p = put_varint(p, zigzag(delta - last));
+        last = delta;
+    }
+    for (c = 0; c < tb->ncols; c++)
+        if (! (p = codec_put_column(p, tuples, n, tb->ncols, c,
+                                    tb->coltype[c]))) {
+            free(*chunk);
+            return 0;
+        }
+    return p - *chunk;
+}
+
+int chunk_encode(Table *tb, Chunks *c, unsigned char **chunk, long *nrows) {
+    unsigned char *p;
+    long n;
+    int len;
+
+    /* up to CHUNK_ROWS rows, stopping once CHUNK_BYTES have been taken */
+    for (n = 0, p = c->rows; n < c->nrows && n < CHUNK_ROWS &&
+                             p - c->rows < CHUNK_BYTES; n++)
+        p = skip(p, 1);
+    while ((len = encode(tb, c->rows, n, chunk)) > CHUNK_MAX) {
+        free(*chunk);
+        if (n == 1) {	/* a row too long for any chunk */
+            len = 0;
+            break;
+        }
+        n /= 2;
+    }
+    *nrows = n;
+    return len;
+}
+
+/*
+ * decode the `len' byte chunk at `chunk' into the timestamps `ts' and the
+ * column values `vals', row by row; the text of numbers is written to
+ * `text', which has room for CHUNK_ROWS * ncols * CODEC_TEXT bytes
+ *
+ * returns the number of rows, or -1 if the chunk is malformed
+ */
+static long decode(Table *tn, unsigned char *chunk, int len, tstamp_t *ts,
+                   char **vals, char *text) {
+    CHeader *hdr = (CHeader *)chunk;
+    unsigned char *p = chunk + sizeof(CHeader), *end = chunk + len;
+    unsigned long long u;
+    long long delta = 0;
+    long i, n;
+    int c;
+
+    if (len < (int)sizeof(CHeader) || (n = hdr->nrows) < 1 ||
+        n > CHUNK_ROWS)
+        return -1;
+    ts[0] = hdr->oldest;
+    for (i = 1; i < n; i++) {
+        if (! get_varint(&p, end, &u))
+            return -1;
+        delta += unzigzag(u);
+        ts[i] = ts[i - 1] + delta;
+    }
+    for (c = 0; c < tn->ncols; c++)
+        if (! codec_get_column(&p, end, n, vals + c, tn->ncols,
+                               text + c * n * CODEC_TEXT))
+            return -1;
+    return n;
+}
+
+/*
+ * the bounds of a window, as in the file crawler
+ */
+typedef struct bounds {
+    tstamp_t from;		/* lower bound, if fromop != 0 */
+    int fromop;
+    tstamp_t to;		/* upper bound, if toop != 0 */
+    int toop;
+    long long last;		/* only the last `last' rows, if >= 0 */
+} Bounds;
+
+/*
+ * return true if "ts op then" is true, false otherwise
+ */
+static int compts(int op, tstamp_t ts, tstamp_t then) {
+    switch(op) {
+    case LESS:
+        return (ts < then);
+    case LESSEQ:
+        return (ts <= then);
+    case GREATER:
+        return (ts > then);
+    case GREATEREQ:
+        return (ts >= then);
+    }
+    return 0;
+}
+
+/*
+ * set `b' from `win'; returns 0 if nothing can be in the window
+ */
+static int set_bounds(Bounds *b, sqlwindow *win) {
+    memset(b, 0, sizeof(Bounds));
+    b->last = -1;
+    switch(win->type) {
+    case SQL_WINTYPE_TPL:
+        b->last = win->num;
+        return (b->last > 0);
+    case SQL_WINTYPE_TIME:
+        b->fromop = GREATEREQ;
+        return nodecrawler_time_bound(win, &b->from);
+    case SQL_WINTYPE_SINCE:
+        b->from = win->tstampv;
+        b->fromop = GREATER;
+        break;
+    case SQL_WINTYPE_INTERVAL:
+        b->from = (win->intv).leftTs;
+        b->fromop = (win->intv).leftOp;
+        b->to = (win->intv).rightTs;
+        b->toop = (win->intv).rightOp;
+        break;
+    }
+    return 1;
+}
+
+static int in_window(Bounds *b, tstamp_t ts) {
+    if (b->fromop && ! compts(b->fromop, ts, b->from))
+        return 0;
+    if (b->toop && ! compts(b->toop, ts, b->to))
+        return 0;
+    return 1;
+}
+
+struct projection {
+    Table *tn;
+    Rtab *results;
+    LinkedList *rowlist;
+    Predicate *pred;
+    long long skip;	/* rows to pass over before projecting */
+};
+
+static void project_row(struct projection *p, Node *n) {
+    Rrow *r;
+    int i, colIdx;
+
+    if (p->skip > 0) {
+        p->skip--;
+        return;
+    }
+    if (! predicate_test(p->pred, n))
+        return;
+    r = malloc(sizeof(Rrow));
+    r->cols = malloc(p->results->ncols * sizeof(char *));
+    for (i = 0; i < p->results->ncols; i++) {
+        colIdx = table_lookup_colindex(p->tn, p->results->colnames[i]);
+        if (colIdx == -1)	/* was timestamp */
+            r->cols[i] = timestamp_to_string(n->tstamp);
+        else
+            r->cols[i] = strdup(tuple_text(n->tuple, colIdx));
+    }
+    (void)ll_add(p->rowlist, r);
+}
+
+/*
+ * the part of a compressed table captured by chunk_window()
+ */
+struct chunkwindow {
+    Bounds b;
+    Snapshot snap;		/* pins the chunks from `first' on */
+    Node *first;		/* oldest chunk that may hold rows, or NULL */
+    Node *last;			/* newest chunk */
+    unsigned char *open;	/* copy of the open rows, or NULL */
+    long nopen;			/* number of open rows */
+    long total;			/* rows in the chunks from `first' on */
+};
+
+ChunkWindow *chunk_window(Table *tn, sqlwindow *win) {
+    ChunkWindow *cw;
+    Node *n;
+    int empty;
+
+    if (! (cw = (ChunkWindow *)calloc(1, sizeof(ChunkWindow)))) {
+        errorf("unable to allocate window of %s\n", tn->name);
+        return NULL;
+    }
+    empty = ! set_bounds(&(cw->b), win);
+    cw->last = tn->newest;
+    if (! empty && tn->chunks->nrows) {
+        if (! (cw->open = (unsigned char *)malloc(tn->chunks->lrows))) {
+            errorf("unable to copy open rows of %s\n", tn->name);
+            free(cw);
+            return NULL;
+        }
+        memcpy(cw->open, tn->chunks->rows, tn->chunks->lrows);
+        cw->nopen = tn->chunks->nrows;
+    }
+    for (n = cw->last; ! empty && n; n = n->prev) {
+        CHeader *hdr = (CHeader *)(n->tuple);
+        if ((cw->b.last >= 0 && cw->total + cw->nopen >= cw->b.last) ||
+            (cw->b.fromop && ! compts(cw->b.fromop, hdr->newest, cw->b.from)))
+            break;
+        cw->total += hdr->nrows;
+        cw->first = n;
+    }
+    if (cw->first)
+        mb_snapshot_take(tn, &(cw->snap), cw->first->tstamp);
+    return cw;
+}
+
+void chunk_project(Table *tn, ChunkWindow *cw, Predicate *pred,
+                   Rtab *results) {
+    struct projection p;
+    union Tuple buf;
+    Bounds *b = &(cw->b);
+    Node row, *n, *next;
+    unsigned char *q;
+    tstamp_t ts[CHUNK_ROWS];
+    char **vals;
+    char *text;
+    long nrows, i;
+
+    p.tn = tn;
+    p.results = results;
+    p.rowlist = ll_create();
+    p.pred = pred;
+    p.skip = (b->last >= 0 && cw->total + cw->nopen > b->last) ?
+             cw->total + cw->nopen - b->last : 0;
+    memset(&row, 0, sizeof(row));
+    vals = (char **)malloc(CHUNK_ROWS * tn->ncols * sizeof(char *));
+    text = (char *)malloc(CHUNK_ROWS * tn->ncols * CODEC_TEXT);
+    for (n = cw->first; n && vals && text; n = next) {
+        next = (n == cw->last) ? NULL : n->next;
+        if (b->toop &&
+            ! compts(b->toop, ((CHeader *)(n->tuple))->oldest, b->to))
+            break;
+        nrows = decode(tn, n->tuple, n->real_len, ts, vals, text);
+        if (next)	/* done with the chunk, so writers may recycle it */
+            mb_snapshot_advance(tn, &(cw->snap), next->tstamp);
+        if (nrows < 0) {
+            errorf("corrupt chunk in table %s\n", tn->name);
+            continue;
+        }
+        for (i = 0; i < nrows; i++) {
+            char **v = vals + i * tn->ncols;
+            if (! in_window(b, ts[i]))
+                continue;
+            if ((row.real_len = tuple_length(tn, tn->ncols, v)) > sizeof(buf))
+                continue;
+            if (! tuple_encode(tn, tn->ncols, v, buf.bytes))
+                continue;
+            row.tuple = buf.bytes;
+            row.tstamp = ts[i];
+            project_row(&p, &row);
+        }
+    }
+    free(vals);
+    free(text);
+    if (cw->first)
+        mb_snapshot_release(tn, &(cw->snap));
+    for (i = 0, q = cw->open; i < cw->nopen; i++, q = skip(q, 1)) {
+        row.tuple = q + sizeof(CRow);
+        row.real_len = ((CRow *)q)->len;
+        row.tstamp = ((CRow *)q)->tstamp;
+        if (! in_window(b, row.tstamp))
+            continue;
+        project_row(&p, &row);
+    }
+    free(cw->open);
+    free(cw);
+    debugf("Chunks: %ld rows from %s\n", ll_size(p.rowlist), tn->name);
+
+    results->nrows = (int)ll_size(p.rowlist);
+    results->rows = (Rrow **)ll_toArray(p.rowlist, &nrows);
+    ll_destroy(p.rowlist, NULL);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * chunk.h - compressed storage for stream tables
+ *
+ * a stream table created "with (compress)" keeps its rows in chunks of up
+ * to CHUNK_ROWS rows, each one the tuple of a single node in the region
+ * of the table; rows are collected in an open chunk, under the mutex of
+ * the region, until there are enough of them, and the chunk is then
+ * encoded and stored
+ *
+ * an encoded chunk is a CHeader, then the timestamp of each row after the
+ * first as a zig-zag varint delta-of-delta, then each column as described
+ * in codec.h; it holds no pointers, so it can be written out as it is
+ */
+#ifndef _CHUNK_H_
+#define _CHUNK_H_
+
+#include "table.h"
+#include "sqlstmts.h"
+#include "rtab.h"
+#include "predicate.h"
+#include "timestamp.h"
+
+#define CHUNK_ROWS 256		/* most rows in a chunk */
+#define CHUNK_BYTES (48 * 1024)	/* bytes of open tuples that seal a chunk */
+#define CHUNK_MAX 65528		/* most bytes in an encoded chunk */
+
+typedef struct cheader {
+    tstamp_t oldest;		/* timestamp of first row */
+    tstamp_t newest;		/* timestamp of last row */
+    unsigned int nrows;		/* rows in the chunk */
+    unsigned int pad;
+} CHeader;
+
+/*
+ * an open row: its header is followed by the `len' byte tuple, padded to
+ * a multiple of CHUNK_ALIGN
+ */
+typedef struct crow {
+    tstamp_t tstamp;
+    unsigned int len;
+} CRow;
+
+#define CHUNK_ALIGN 8
+#define CHUNK_PADDED(len) ((((len) - 1) / CHUNK_ALIGN + 1) * CHUNK_ALIGN)
+
+typedef struct chunks {
+    unsigned char *rows;	/* rows of the open chunk, as CRow's */
+    long nrows;			/* rows in the open chunk */
+    long lrows;			/* bytes used in rows */
+    long srows;			/* bytes allocated to rows */
+    int sealing;		/* set while a chunk is being stored */
+} Chunks;
+
+#define chunk_full(c) ((c)->nrows >= CHUNK_ROWS || (c)->lrows >= CHUNK_BYTES)
+
+Chunks *chunk_new(void);
+
+/*
+ * add the `len' byte tuple `tuple', stamped `ts', to the open chunk; the
+ * tuple must hold the text of every column
+ *
+ * returns 1 if successful, 0 if out of memory
+ */
+int chunk_append(Chunks *c, tstamp_t ts, unsigned char *tuple, int len);
+
+/*
+ * encode the oldest rows of `c', open rows of table `tb', as a chunk in
+ * the malloc'ed buffer `*chunk', setting `*nrows' to the number of rows
+ * taken; `c' must not be empty
+ *
+ * returns the length of the chunk, or 0 if the rows could not be encoded
+ */
+int chunk_encode(Table *tb, Chunks *c, unsigned char **chunk, long *nrows);
+
+/*
+ * remove the oldest `nrows' open rows, once they have been stored
+ */
+void chunk_drop(Chunks *c, long nrows);
+
+typedef struct chunkwindow ChunkWindow;
+
+/*
+ * capture the part of compressed stream table `tn' in window `win': a copy
+ * of its open rows, and a snapshot of the chunks that may hold rows in the
+ * window; must be called with mb_lock() held, which may be given up as
+ * soon as it returns
+ *
+ * returns NULL if out of memory
+ */
+ChunkWindow *chunk_window(Table *tn, sqlwindow *win);
+
+/*
+ * add the rows of `cw', captured from `tn', that pass `pred' to `results',
+ * then release the snapshot and free `cw'; called without mb_lock() held
+ */
+void chunk_project(Table *tn, ChunkWindow *cw, Predicate *pred,
+                   Rtab *results);
+
+#endif /* _CHUNK_H_ */
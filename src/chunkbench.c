@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * chunkbench - measures how many more rows a region holds when a table is
+ * compressed, and how fast compressed rows can be selected
+ *
+ * usage: ./chunkbench [-n rows] [-q quota]
+ *
+ * inserts readings from 64 sensors - a name, a temperature and a
+ * humidity, each drifting slowly - into a plain and a compressed table,
+ * each with a region of `quota' bytes (16m by default), then reports the
+ * rows each table still holds and the rate at which they can be selected
+ * in full and for a single sensor
+ */
+#include "mb.h"
+#include "chunk.h"
+#include "node.h"
+#include "nodecrawler.h"
+#include "table.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include "rtab.h"
+#include "sqlstmts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USAGE "./chunkbench [-n rows] [-q quota]"
+#define NCOLS 3
+#define NSENSORS 64
+
+static char *colnames[NCOLS] = {"sensor", "temp", "humidity"};
+
+static Rtab *new_results(Table *tb) {
+    Rtab *results = rtab_new();
+    int i;
+
+    results->ncols = NCOLS;
+    results->colnames = (char **)malloc(NCOLS * sizeof(char *));
+    for (i = 0; i < NCOLS; i++)
+        results->colnames[i] = strdup(colnames[i]);
+    table_extract_relevant_types(tb, results);
+    return results;
+}
+
+/*
+ * select every row of `tb' with `nfilters' filters, and report the rate
+ */
+static void scan(char *label, Table *tb, long long nrows, int nfilters,
+                 sqlfilter **filters) {
+    sqlwindow win;
+    Rtab *results = new_results(tb);
+    Predicate *p;
+    tstamp_t start, finish;
+
+    memset(&win, 0, sizeof(win));
+    win.type = SQL_WINTYPE_NONE;
+    start = timestamp_now();
+    p = predicate_new(tb, nfilters, filters, SQL_FILTER_TYPE_AND);
+    mb_lock(tb);
+    if (tb->chunks) {
+        ChunkWindow *cw = chunk_window(tb, &win);
+        mb_unlock(tb);
+        if (cw)
+            chunk_project(tb, cw, p, results);
+    } else {
+        Nodecrawler *nc = nodecrawler_new(tb->oldest, tb->newest);
+        nodecrawler_apply_filter(nc, p);
+        nodecrawler_project_cols(nc, tb, results);
+        nodecrawler_free(nc);
+        mb_unlock(tb);
+    }
+    predicate_free(p);
+    finish = timestamp_now();
+    printf("%-24s %10.0f rows/s, %d rows selected\n", label,
+           (double)nrows / ((double)(finish - start) / 1.0e9), results->nrows);
+    rtab_free(results);
+}
+
+/*
+ * the number of rows held by compressed table `tb'
+ */
+static long long chunk_rows(Table *tb) {
+    long long n;
+    Node *x;
+
+    mb_lock(tb);
+    n = tb->chunks->nrows;
+    for (x = tb->oldest; x; x = x->next)
+        n += ((CHeader *)(x->tuple))->nrows;
+    mb_unlock(tb);
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    int *coltypes[NCOLS] = {PRIMTYPE_VARCHAR, PRIMTYPE_REAL, PRIMTYPE_INTEGER};
+    char sensor[16], temp[32], humidity[16];
+    char *vals[NCOLS];
+    double temps[NSENSORS];
+    int humid[NSENSORS];
+    long long nrows = 2000000LL, quota = 16LL * 1024LL * 1024LL;
+    long long plain, packed;
+    tstamp_t start, finish;
+    sqlfilter filter, *filters[1];
+    Table *tb[2];
+    long long k;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-n") == 0)
+            nrows = atoll(argv[j]);
+        else if (strcmp(argv[i], "-q") == 0)
+            quota = atoll(argv[j]);
+        else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+            exit(1);
+        }
+        i = j + 1;
+    }
+    if (nrows < 1 || quota < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    if (! mb_init()) {
+        fprintf(stderr, "unable to initialize the memory buffer\n");
+        exit(1);
+    }
+    for (i = 0; i < 2; i++) {
+        tb[i] = table_new(NCOLS, colnames, coltypes);
+        table_tabletype(tb[i], 0, -1);
+        tb[i]->name = (i) ? "Packed" : "Plain";
+        if (! mb_region_create(tb[i], tb[i]->name, quota, 0) ||
+            (i && ! (tb[i]->chunks = chunk_new()))) {
+            fprintf(stderr, "unable to create table %s\n", tb[i]->name);
+            exit(1);
+        }
+    }
+    vals[0] = sensor;
+    vals[1] = temp;
+    vals[2] = humidity;
+    for (i = 0; i < 2; i++) {	/* both tables get the same readings */
+        srandom(42);
+        for (j = 0; j < NSENSORS; j++) {
+            temps[j] = 18.0 + (random() % 60) / 10.0;
+            humid[j] = 40 + random() % 20;
+        }
+        start = timestamp_now();
+        for (k = 0; k < nrows; k++) {
+            long r = random();
+            j = k % NSENSORS;
+            temps[j] += ((r & 3) == 0) ? 0.1 : ((r & 3) == 1) ? -0.1 : 0.0;
+            humid[j] += ((r & 12) == 0) ? 1 : ((r & 12) == 4) ? -1 : 0;
+            sprintf(sensor, "sensor%02d", j);
+            sprintf(temp, "%.15g", (double)(long)(temps[j] * 10.0 + 0.5) / 10.0);
+            sprintf(humidity, "%d", humid[j]);
+            if (! mb_insert_tuple(NCOLS, vals, tb[i]))
+                exit(1);
+        }
+        finish = timestamp_now();
+        printf("%-24s %10.0f rows/s\n", (i) ? "insert compressed" : "insert",
+               (double)nrows / ((double)(finish - start) / 1.0e9));
+    }
+    plain = tb[0]->count;
+    packed = chunk_rows(tb[1]);
+    printf("%lld rows into %lld bytes: %lld rows held plain, %lld compressed, ratio %.2f\n",
+           nrows, quota, plain, packed, (double)packed / (double)plain);
+    scan("select", tb[0], plain, 0, NULL);
+    scan("select compressed", tb[1], packed, 0, NULL);
+    memset(&filter, 0, sizeof(filter));
+    filter.varname = "temp";
+    filter.sign = SQL_FILTER_GREATER;
+    filter.value.realv = 22.0;
+    filters[0] = &filter;
+    scan("temp > 22", tb[0], plain, 1, filters);
+    scan("temp > 22 compressed", tb[1], packed, 1, filters);
+    return 0;
+}
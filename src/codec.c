@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * codec.c - column encodings shared by archive blocks and compressed
+ * chunks
+ */
+
+#include "codec.h"
+#include "tuple.h"
+#include "typetable.h"
+#include "adts/hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define is_integer(t) ((t) == PRIMTYPE_INTEGER || (t) == PRIMTYPE_TINYINT || \
+                        (t) == PRIMTYPE_SMALLINT)
+
+unsigned char *put_varint(unsigned char *p, unsigned long long v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+int get_varint(unsigned char **p, unsigned char *end, unsigned long long *v) {
+    unsigned char *q = *p;
+    int shift = 0;
+
+    *v = 0;
+    while (q < end && shift < 64) {
+        *v |= (unsigned long long)(*q & 0x7f) << shift;
+        if (! (*q++ & 0x80)) {
+            *p = q;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+/*
+ * the text printed for each native value
+ */
+static void int_text(union Value *v, char *text) {
+    sprintf(text, "%lld", v->intv);
+}
+
+static void real_text(union Value *v, char *text) {
+    sprintf(text, "%.15g", v->realv);
+}
+
+static void tstamp_text(union Value *v, char *text) {
+    sprintf(text, "@%016llx@", v->tstampv);
+}
+
+/*
+ * returns true if each value in column `c' of the `n' tuples in `tuples'
+ * is the text that `print' gives for its native value
+ */
+static int canonical(unsigned char **tuples, long n, int ncols, int c,
+                     void (*print)(union Value *, char *)) {
+    char text[CODEC_TEXT];
+    long i;
+
+    for (i = 0; i < n; i++) {
+        print(tuple_values(tuples[i], ncols) + c, text);
+        if (strcmp(text, tuple_text(tuples[i], c)) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * encode column `c' of the `n' tuples in `tuples' at `p' as a dictionary
+ *
+ * returns the end of the encoded column, or NULL if out of memory
+ */
+static unsigned char *encode_dict(unsigned char *p, unsigned char **tuples,
+                                  long n, int c) {
+    HashMap *hm;
+    long *idx;
+    long i, ndict = 0;
+
+    if (! (idx = (long *)malloc(n * sizeof(long))))
+        return NULL;
+    if (! (hm = hm_create(2 * n, 2.0))) {
+        free(idx);
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {	/* number the distinct values */
+        char *s = tuple_text(tuples[i], c);
+        void *v;
+        if (hm_get(hm, s, &v))
+            idx[i] = (long)v - 1;
+        else {
+            idx[i] = ndict;
+            (void) hm_put(hm, s, (void *)(ndict + 1), &v);
+            ndict++;
+        }
+    }
+    hm_destroy(hm, NULL);
+    *p++ = ENC_DICT;
+    p = put_varint(p, ndict);
+    for (i = 0, ndict = 0; i < n; i++)
+        if (idx[i] == ndict) {	/* first use of a value */
+            char *s = tuple_text(tuples[i], c);
+            long len = strlen(s) + 1;
+            memcpy(p, s, len);
+            p += len;
+            ndict++;
+        }
+    for (i = 0; i < n; i++)
+        p = put_varint(p, idx[i]);
+    free(idx);
+    return p;
+}
+
+/*
+ * encode column `c' of integers or timestamps as zig-zag deltas
+ */
+static unsigned char *encode_delta(unsigned char *p, unsigned char **tuples,
+                                   long n, int ncols, int c, int tag) {
+    long long v, last = 0;
+    long i;
+
+    *p++ = tag;
+    for (i = 0; i < n; i++) {
+        v = tuple_values(tuples[i], ncols)[c].intv;
+        p = put_varint(p, zigzag(v - last));
+        last = v;
+    }
+    return p;
+}
+
+/*
+ * encode column `c' of reals as the XOR of successive values; each is
+ * written as a control byte, holding the count of trailing zero bytes in
+ * its top four bits and the count of bytes that follow in the bottom four,
+ * then the bytes between; 0 means the value repeats
+ */
+static unsigned char *encode_xor(unsigned char *p, unsigned char **tuples,
+                                 long n, int ncols, int c) {
+    unsigned long long bits, x, last = 0;
+    int lo, hi;
+    long i;
+
+    *p++ = ENC_XOR;
+    for (i = 0; i < n; i++) {
+        memcpy(&bits, &tuple_values(tuples[i], ncols)[c].realv, sizeof bits);
+        x = bits ^ last;
+        last = bits;
+        if (! x) {
+            *p++ = 0;
+            continue;
+        }
+        for (lo = 0; ! ((x >> (8 * lo)) & 0xff); lo++)
+            ;
+        for (hi = 7; ! ((x >> (8 * hi)) & 0xff); hi--)
+            ;
+        *p++ = (unsigned char)((lo << 4) | (hi - lo + 1));
+        for (; lo <= hi; lo++)
+            *p++ = (unsigned char)(x >> (8 * lo));
+    }
+    return p;
+}
+
+unsigned char *codec_put_column(unsigned char *p, unsigned char **tuples,
+                                long n, int ncols, int c, int *type) {
+    unsigned char *q, *end;
+
+    if (is_integer(type) && canonical(tuples, n, ncols, c, int_text))
+        q = encode_delta(p, tuples, n, ncols, c, ENC_DELTA);
+    else if (type == PRIMTYPE_TIMESTAMP &&
+             canonical(tuples, n, ncols, c, tstamp_text))
+        q = encode_delta(p, tuples, n, ncols, c, ENC_TSTAMP);
+    else if (type == PRIMTYPE_REAL && canonical(tuples, n, ncols, c, real_text))
+        q = encode_xor(p, tuples, n, ncols, c);
+    else
+        return encode_dict(p, tuples, n, c);
+    /* a column of few distinct values may be smaller as a dictionary */
+    if (! (end = encode_dict(q, tuples, n, c)))
+        return NULL;
+    if (end - q >= q - p)
+        return q;
+    memmove(p, q, end - q);
+    return p + (end - q);
+}
+
+int codec_get_column(unsigned char **pp, unsigned char *end, long n,
+                     char **vals, int stride, char *text) {
+    unsigned char *p = *pp;
+    unsigned long long u, bits = 0;
+    long long v = 0;
+    long i, ndict;
+    char **dict;
+    double d;
+    int tag;
+
+    if (p >= end)
+        return 0;
+    tag = *p++;
+    switch (tag) {
+    case ENC_DELTA:
+    case ENC_TSTAMP:
+        for (i = 0; i < n; i++, text += CODEC_TEXT) {
+            if (! get_varint(&p, end, &u))
+                return 0;
+            v += unzigzag(u);
+            if (tag == ENC_DELTA)
+                sprintf(text, "%lld", v);
+            else
+                sprintf(text, "@%016llx@", (unsigned long long)v);
+            vals[i * stride] = text;
+        }
+        break;
+    case ENC_XOR:
+        for (i = 0; i < n; i++, text += CODEC_TEXT) {
+            int lo, nb;
+            if (p >= end)
+                return 0;
+            lo = *p >> 4;
+            nb = *p++ & 0xf;
+            if (lo + nb > 8 || nb > end - p)
+                return 0;
+            for (u = 0; nb--; lo++)
+                u |= (unsigned long long)*p++ << (8 * lo);
+            bits ^= u;
+            memcpy(&d, &bits, sizeof d);
+            sprintf(text, "%.15g", d);
+            vals[i * stride] = text;
+        }
+        break;
+    case ENC_DICT:
+        if (! get_varint(&p, end, &u) || u > (unsigned long long)(end - p))
+            return 0;
+        ndict = (long)u;
+        if (! (dict = (char **)malloc((ndict + 1) * sizeof(char *))))
+            return 0;
+        for (i = 0; i < ndict; i++) {
+            unsigned char *q = memchr(p, '\0', end - p);
+            if (! q) {
+                free(dict);
+                return 0;
+            }
+            dict[i] = (char *)p;
+            p = q + 1;
+        }
+        for (i = 0; i < n; i++) {
+            if (! get_varint(&p, end, &u) || u >= (unsigned long long)ndict) {
+                free(dict);
+                return 0;
+            }
+            vals[i * stride] = dict[u];
+        }
+        free(dict);
+        break;
+    default:
+        return 0;
+    }
+    *pp = p;
+    return 1;
+}
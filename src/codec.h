@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * codec.h - column encodings shared by archive blocks and compressed
+ * chunks
+ *
+ * a column of a run of tuples is written as a tag, saying how it is
+ * encoded, followed by its values:
+ *
+ *	ENC_DELTA	integers, as zig-zag varint deltas
+ *	ENC_XOR		reals, as the XOR of each value with the one before,
+ *			less its leading and trailing zero bytes
+ *	ENC_TSTAMP	timestamps, as zig-zag varint deltas
+ *	ENC_DICT	a dictionary of the distinct values, then the index
+ *			of each value as a varint
+ *
+ * a numeric encoding is only used if the text of every value is the text
+ * that would be printed for its native value, so that decoding gives back
+ * exactly what was inserted, and only if it is smaller than the dictionary
+ *
+ * varints are written 7 bits at a time, least significant first, with the
+ * top bit of each byte set if more follow
+ */
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#define VARINT_MAX 10		/* most bytes in a varint */
+#define CODEC_TEXT 32		/* room for the text of a decoded number */
+
+#define ENC_DELTA 'D'
+#define ENC_DICT 'S'
+#define ENC_XOR 'X'
+#define ENC_TSTAMP 'T'
+
+#define zigzag(v) ((unsigned long long)(((v) << 1) ^ ((v) >> 63)))
+#define unzigzag(u) ((long long)(((u) >> 1) ^ -((long long)((u) & 1))))
+
+/*
+ * write `v' at `p', returning the byte after it
+ */
+unsigned char *put_varint(unsigned char *p, unsigned long long v);
+
+/*
+ * read the varint at `*p' into `*v', stopping at `end', and advance `*p'
+ * past it; returns 0 if the varint is truncated
+ */
+int get_varint(unsigned char **p, unsigned char *end, unsigned long long *v);
+
+/*
+ * the most bytes that codec_put_column() may write for `n' values whose
+ * text takes `text' bytes, NULs included
+ */
+#define codec_bound(n,text) ((text) + 2 * ((n) + 1) * VARINT_MAX)
+
+/*
+ * encode column `c', of type `type', of the `n' tuples of `ncols' columns
+ * in `tuples' at `p'; the tuples must hold the text of every column
+ *
+ * returns the end of the encoded column, or NULL if out of memory
+ */
+unsigned char *codec_put_column(unsigned char *p, unsigned char **tuples,
+                                long n, int ncols, int c, int *type);
+
+/*
+ * decode the column of `n' values at `*p', stopping at `end', pointing
+ * vals[0], vals[stride], ... at their text, and advance `*p' past it; the
+ * text of numbers is written to `text', which has room for n * CODEC_TEXT
+ * bytes, or may be NULL if the column is tagged ENC_DICT
+ *
+ * returns 0 if the column is malformed
+ */
+int codec_get_column(unsigned char **p, unsigned char *end, long n,
+                     char **vals, int stride, char *text);
+
+#endif /* _CODEC_H_ */
@@ -44,6 +44,9 @@
 
 /* Index */
 #define TT_BUCKETS 100
+#define TT_INDEX_BUCKETS 1024	/* initial size of a primary key index */
+#define TT_TIME_STRIDE 64	/* inserts between time index entries */
+#define TT_TIME_ENTRIES 256	/* initial size of a time index ring */
 
 /* Saved-queries hashtable */
 #define HT_QUERYTAB_BUCKETS 100
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * dict.c - string dictionaries for dictionary-encoded varchar columns
+ *
+ * the strings are held in chunks of DICT_CHUNK entries that are never
+ * moved, so that dict_string() can index them without the mutex while
+ * other threads intern new strings
+ */
+#include "dict.h"
+#include "adts/hashmap.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DICT_CHUNK 4096		/* strings in each chunk */
+#define DICT_CHUNKS (DICT_MAX / DICT_CHUNK)	/* most chunks in a dictionary */
+
+struct dict {
+    HashMap *codes;		/* string -> code + 1 */
+    char **chunks[DICT_CHUNKS];	/* code -> string */
+    unsigned int count;		/* strings interned */
+    long bytes;			/* bytes of interned strings */
+    pthread_mutex_t mutex;
+};
+
+/* append `s' to the strings of `d'; called with d->mutex held */
+static char *add(Dict *d, char *s) {
+    unsigned int c = d->count;
+    char ***chunk = &(d->chunks[c / DICT_CHUNK]);
+    char *p;
+    void *prev;
+
+    if (c >= DICT_CHUNK * DICT_CHUNKS)
+        return NULL;
+    if (! *chunk &&
+            ! (*chunk = (char **)malloc(DICT_CHUNK * sizeof(char *))))
+        return NULL;
+    if (! (p = strdup(s)))
+        return NULL;
+    if (! hm_put(d->codes, p, (void *)(long)(c + 1), &prev)) {
+        free(p);
+        return NULL;
+    }
+    (*chunk)[c % DICT_CHUNK] = p;
+    d->bytes += strlen(p) + 1;
+    d->count++;
+    return p;
+}
+
+Dict *dict_new(void) {
+    Dict *d = (Dict *)calloc(1, sizeof(Dict));
+
+    if (! d)
+        return NULL;
+    if (! (d->codes = hm_create(1024L, 2.0)) || ! add(d, "")) {
+        if (d->codes)
+            hm_destroy(d->codes, NULL);
+        free(d);
+        return NULL;
+    }
+    pthread_mutex_init(&(d->mutex), NULL);
+    return d;
+}
+
+void dict_free(Dict *d) {
+    unsigned int c;
+
+    hm_destroy(d->codes, NULL);
+    for (c = 0; c < d->count; c++)
+        free(dict_string(d, c));
+    for (c = 0; c < DICT_CHUNKS && d->chunks[c]; c++)
+        free(d->chunks[c]);
+    (void) pthread_mutex_destroy(&(d->mutex));
+    free(d);
+}
+
+long dict_intern(Dict *d, char *s) {
+    long code;
+    void *v;
+
+    (void) pthread_mutex_lock(&(d->mutex));
+    if (hm_get(d->codes, s, &v))
+        code = (long)v - 1;
+    else if (add(d, s))
+        code = (long)d->count - 1;
+    else {
+        errorf("unable to intern \"%s\": %s\n", s,
+               (d->count >= DICT_MAX) ? "dictionary full" : "out of memory");
+        code = -1;
+    }
+    (void) pthread_mutex_unlock(&(d->mutex));
+    return code;
+}
+
+long dict_lookup(Dict *d, char *s) {
+    long code = -1;
+    void *v;
+
+    (void) pthread_mutex_lock(&(d->mutex));
+    if (hm_get(d->codes, s, &v))
+        code = (long)v - 1;
+    (void) pthread_mutex_unlock(&(d->mutex));
+    return code;
+}
+
+char *dict_string(Dict *d, unsigned int code) {
+    return d->chunks[code / DICT_CHUNK][code % DICT_CHUNK];
+}
+
+unsigned int dict_size(Dict *d, long *bytes) {
+    unsigned int n;
+
+    (void) pthread_mutex_lock(&(d->mutex));
+    n = d->count;
+    *bytes = d->bytes;
+    (void) pthread_mutex_unlock(&(d->mutex));
+    return n;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * dict.h - string dictionaries for dictionary-encoded varchar columns
+ *
+ * each distinct string is interned once and given a 32-bit code, in the
+ * order in which the strings are first seen; code 0 is the empty string.
+ * interned strings are never freed, so a string returned by dict_string()
+ * stays valid; nor are they freed when the rows holding them are evicted,
+ * so a column with many distinct values grows until the dictionary is full
+ * (DICT_MAX strings), after which rows with new values are rejected
+ *
+ * dict_intern() and dict_lookup() take the dictionary's mutex;
+ * dict_string() does not, since a code is only ever obtained from an
+ * interned string
+ */
+#ifndef _DICT_H_
+#define _DICT_H_
+
+typedef struct dict Dict;
+
+#define DICT_MAX (4096 * 4096)	/* most strings in a dictionary */
+
+Dict *dict_new(void);
+
+/*
+ * free `d' and its strings; nothing may refer to them any more
+ */
+void dict_free(Dict *d);
+
+/*
+ * return the code of `s', interning it if it is new; -1 if it is new and
+ * the dictionary is full or memory is exhausted
+ */
+long dict_intern(Dict *d, char *s);
+
+/*
+ * return the code of `s', or -1 if it has not been interned
+ */
+long dict_lookup(Dict *d, char *s);
+
+/*
+ * return the string with code `code'
+ */
+char *dict_string(Dict *d, unsigned int code);
+
+/*
+ * return the number of strings, and the bytes holding them in `*bytes'
+ */
+unsigned int dict_size(Dict *d, long *bytes);
+
+#endif /* _DICT_H_ */
@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * filecrawler.c
+ *
+ * File Crawler
+ *
+ * The files to read, and where to start reading each of them, are taken
+ * from the archive under its mutex, together with a copy of the tuples
+ * not yet written to a block; the files are then read without it, so
+ * tuples can be archived while a query reads older ones.  Blocks whose
+ * timestamps lie outside the window are passed over unread.
+ */
+#include "filecrawler.h"
+
+#include "util.h"
+#include "adts/linkedlist.h"
+#include "node.h"
+#include "tuple.h"
+#include "nodecrawler.h"
+#include "gram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCAN_BUFSIZ (256 * 1024)	/* stdio buffer used when reading */
+
+/*
+ * part of a file to be read
+ */
+typedef struct span {
+    char *name;
+    off_t start; /* offset of first block to read */
+    off_t end; /* size of the file */
+    long long row; /* index in the file of the first tuple at start */
+    long long limit; /* index in the file of the first tuple not to read */
+} Span;
+
+Filecrawler *filecrawler_new(T *t, long long end) {
+    Filecrawler *fc;
+
+    fc = malloc(sizeof(Filecrawler));
+    fc->t = t;
+    fc->end = end;
+    fc->fromop = 0;
+    fc->toop = 0;
+    fc->last = -1;
+    fc->empty = 0;
+    fc->pred = NULL;
+    return fc;
+}
+
+void filecrawler_free(Filecrawler *fc) {
+    free(fc);
+}
+
+/*
+ * return true if "ts op then" is true, false otherwise
+ */
+static int compts(int op, tstamp_t ts, tstamp_t then) {
+    switch(op) {
+    case LESS:
+        return (ts < then);
+    case LESSEQ:
+        return (ts <= then);
+    case GREATER:
+        return (ts > then);
+    case GREATEREQ:
+        return (ts >= then);
+    }
+    return 0;
+}
+
+void filecrawler_window(Filecrawler *fc, sqlwindow *win, long inmemory) {
+
+    switch(win->type) {
+
+    case SQL_WINTYPE_TPL:
+        fc->last = win->num - inmemory;
+        if (fc->last <= 0)
+            fc->empty = 1;
+        break;
+
+    case SQL_WINTYPE_TIME:
+        if (! nodecrawler_time_bound(win, &fc->from))
+            fc->empty = 1;
+        fc->fromop = GREATEREQ;
+        break;
+
+    case SQL_WINTYPE_SINCE:
+        fc->from = win->tstampv;
+        fc->fromop = GREATER;
+        break;
+
+    case SQL_WINTYPE_INTERVAL:
+        fc->from = (win->intv).leftTs;
+        fc->fromop = (win->intv).leftOp;
+        fc->to = (win->intv).rightTs;
+        fc->toop = (win->intv).rightOp;
+        break;
+
+    default:	/* unwindowed selects only see the tuples in memory */
+        fc->empty = 1;
+        break;
+    }
+}
+
+void filecrawler_filter(Filecrawler *fc, Predicate *pred) {
+    fc->pred = pred;
+}
+
+/*
+ * return true if a tuple stamped `ts' is in the window
+ */
+static int in_window(Filecrawler *fc, tstamp_t ts) {
+    if (fc->fromop && ! compts(fc->fromop, ts, fc->from))
+        return 0;
+    if (fc->toop && ! compts(fc->toop, ts, fc->to))
+        return 0;
+    return 1;
+}
+
+/*
+ * the entry in the index of `f' for the first block that may hold tuples
+ * stamped `from' or later; blocks are indexed by their oldest timestamp
+ */
+static Ndx *start_of(F *f, tstamp_t from) {
+    long lo = 0, hi = f->nndx, mid;
+
+    while (lo < hi) {	/* last block starting before `from' */
+        mid = (lo + hi) / 2;
+        if (f->ndx[mid].timeStamp < from)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return &(f->ndx[(lo > 0) ? lo - 1 : 0]);
+}
+
+/*
+ * number of tuples of `f' that had been archived at position `end'
+ */
+static long long archived(F *f, long long end) {
+    if (end - f->base >= f->count)
+        return f->count;
+    return (end > f->base) ? end - f->base : 0;
+}
+
+/*
+ * number of bytes taken by the first `n' of the pending tuples at `p'
+ */
+static long pending_length(unsigned char *p, long long n) {
+    unsigned char *q;
+
+    for (q = p; n > 0; n--)
+        q += sizeof(ARow) + ARC_PADDED(((ARow *)q)->len);
+    return q - p;
+}
+
+/*
+ * determine the parts of the archive files that may hold tuples in the
+ * window, oldest first, and copy the pending tuples that had been
+ * archived when the select started; those of the block being written
+ * come before those still being collected
+ *
+ * returns the number of spans in the malloc'ed array `*spans', or -1 if
+ * memory runs out, leaving `*spans' and `*pend' NULL
+ */
+static int find_spans(Filecrawler *fc, Span **spans, unsigned char **pend,
+                      long *lpend) {
+    T *t = fc->t;
+    Span *s;
+    int i, first, n = 0;
+    long long count, npend, nfull;
+    long lfull, len;
+
+    *spans = NULL;
+    *pend = NULL;
+    *lpend = 0;
+    (void) pthread_mutex_lock(&(t->t_mutex));
+    if (! (s = (Span *)malloc((t->nfiles + 1) * sizeof(Span))))
+        goto nomem;
+    t_flush(t);
+    npend = fc->end - (t->position - t->npend - t->nfull);
+    if (npend < 0)
+        npend = 0;
+    first = 0;
+    if (fc->last >= 0) {	/* enough of the newest files to hold `last' */
+        count = npend;
+        for (i = t->nfiles - 1; i >= 0 && count < fc->last; i--)
+            if (f_index(t->files[i]))
+                count += archived(t->files[i], fc->end);
+        first = i + 1;
+    }
+    for (i = first; i < t->nfiles; i++) {
+        F *f = t->files[i];
+        Ndx *x;
+        if (! f_index(f) || ! f->count)
+            continue;
+        if (! archived(f, fc->end) ||
+            (fc->toop && ! compts(fc->toop, f->oldest, fc->to)))
+            break;
+        if (fc->fromop && ! compts(fc->fromop, f->newest, fc->from))
+            continue;
+        x = start_of(f, (fc->fromop) ? fc->from : 0);
+        if (! (s[n].name = strdup(f->name)))
+            goto nomem;
+        s[n].start = x->byteOffset;
+        s[n].end = f->size;
+        s[n].row = x->row;
+        s[n].limit = archived(f, fc->end);
+        n++;
+    }
+    nfull = (npend < t->nfull) ? npend : t->nfull;
+    lfull = pending_length(t->full, nfull);
+    len = lfull + pending_length(t->pend, npend - nfull);
+    if (len > 0) {
+        if (! (*pend = (unsigned char *)malloc(len)))
+            goto nomem;
+        memcpy(*pend, t->full, lfull);
+        memcpy(*pend + lfull, t->pend, len - lfull);
+        *lpend = len;
+    }
+    (void) pthread_mutex_unlock(&(t->t_mutex));
+    *spans = s;
+    return n;
+
+nomem:
+    (void) pthread_mutex_unlock(&(t->t_mutex));
+    errorf("Filecrawler: unable to allocate spans of the archive\n");
+    for (i = 0; s && i < n; i++)
+        free(s[i].name);
+    free(s);
+    return -1;
+}
+
+/*
+ * read the header of the next block in span `s' that may hold tuples in
+ * the window, passing over those that cannot; `*row' is the index in the
+ * file of the first tuple of the block
+ *
+ * returns 1 if there is one, 0 otherwise
+ */
+static int next_block(Filecrawler *fc, FILE *fs, Span *s, off_t *off,
+                      long long *row, ABlock *hdr) {
+    while (*off < s->end && *row < s->limit &&
+           fread(hdr, sizeof(ABlock), 1, fs) == 1) {
+        if (fc->toop && ! compts(fc->toop, hdr->oldest, fc->to))
+            return 0;
+        *off += sizeof(ABlock) + hdr->len;
+        if (! fc->fromop || compts(fc->fromop, hdr->newest, fc->from))
+            return 1;
+        *row += hdr->nrows;
+        if (fseeko(fs, *off, SEEK_SET) != 0)
+            return 0;
+    }
+    return 0;
+}
+
+static FILE *open_span(Span *s) {
+    FILE *fs;
+
+    if (! (fs = fopen(s->name, "r"))) {
+        errorf("Filecrawler: unable to open %s\n", s->name);
+        return NULL;
+    }
+    (void) setvbuf(fs, NULL, _IOFBF, SCAN_BUFSIZ);
+    if (fseeko(fs, s->start, SEEK_SET) != 0) {
+        (void) fclose(fs);
+        return NULL;
+    }
+    return fs;
+}
+
+/*
+ * read the tuples in span `s', calling `visit' for each one in the window
+ */
+static void scan(Filecrawler *fc, Span *s, Table *tn,
+                 void (*visit)(Filecrawler *, Node *, void *), void *arg) {
+    union Tuple buf;
+    ABlock hdr;
+    Block b;
+    Node n;
+    FILE *fs;
+    off_t off = s->start;
+    long long row = s->row;
+    int i;
+
+    if (! (fs = open_span(s)))
+        return;
+    memset(&n, 0, sizeof(n));
+    n.tuple = buf.bytes;
+    while (next_block(fc, fs, s, &off, &row, &hdr) &&
+           f_read_block(fs, tn->ncols, &hdr, &b)) {
+        for (i = 0; i < b.nrows && row + i < s->limit; i++) {
+            char **vals = &b.vals[i * tn->ncols];
+            if (! in_window(fc, b.tstamp[i]))
+                continue;
+            if ((n.real_len = tuple_length(tn, tn->ncols, vals)) > sizeof(buf))
+                continue;
+            if (! tuple_encode(tn, tn->ncols, vals, buf.bytes))
+                continue;
+            n.tstamp = b.tstamp[i];
+            visit(fc, &n, arg);
+        }
+        row += hdr.nrows;
+        block_free(&b);
+    }
+    (void) fclose(fs);
+}
+
+/*
+ * count the tuples in span `s' from the block headers; only used for row
+ * windows, which have no time bounds
+ */
+static long long count_span(Filecrawler *fc, Span *s) {
+    ABlock hdr;
+    FILE *fs;
+    off_t off = s->start;
+    long long row = s->row;
+
+    if (! (fs = open_span(s)))
+        return 0;
+    while (next_block(fc, fs, s, &off, &row, &hdr)) {
+        row += hdr.nrows;
+        if (fseeko(fs, off, SEEK_SET) != 0)
+            break;
+    }
+    (void) fclose(fs);
+    return ((row < s->limit) ? row : s->limit) - s->row;
+}
+
+/*
+ * call `visit' for each of the pending tuples in `pend' that is in the
+ * window; like the blocks, they hold the text of every column, so those
+ * of a table with dictionaries are encoded again
+ */
+static void scan_pending(Filecrawler *fc, Table *tn, unsigned char *pend,
+                         long lpend,
+                         void (*visit)(Filecrawler *, Node *, void *),
+                         void *arg) {
+    union Tuple buf;
+    unsigned char *p;
+    ARow *r;
+    Node n;
+    int len;
+
+    memset(&n, 0, sizeof(n));
+    for (p = pend; p < pend + lpend; p += sizeof(ARow) + ARC_PADDED(r->len)) {
+        r = (ARow *)p;
+        n.tuple = p + sizeof(ARow);
+        n.real_len = r->len;
+        n.tstamp = r->tstamp;
+        if (! in_window(fc, n.tstamp))
+            continue;
+        if (tn->dict) {
+            len = tuple_intern(tn, n.tuple, buf.bytes, sizeof(buf));
+            if (len < 0 || (size_t)len > sizeof(buf))
+                continue;
+            n.real_len = (unsigned short)len;
+            n.tuple = buf.bytes;
+        }
+        visit(fc, &n, arg);
+    }
+}
+
+static void count_tuple(__attribute__ ((unused)) Filecrawler *fc,
+                        __attribute__ ((unused)) Node *n, void *arg) {
+    (*(long long *)arg)++;
+}
+
+struct projection {
+    Table *tn;
+    Rtab *results;
+    LinkedList *rowlist;
+    long long skip;	/* tuples to pass over before projecting */
+};
+
+static void project_tuple(Filecrawler *fc, Node *n, void *arg) {
+    struct projection *p = (struct projection *)arg;
+    Rrow *r;
+    int i, colIdx;
+
+    if (p->skip > 0) {
+        p->skip--;
+        return;
+    }
+    if (! predicate_test(fc->pred, n))
+        return;
+    r = malloc(sizeof(Rrow));
+    r->cols = malloc(p->results->ncols * sizeof(char *));
+    for (i = 0; i < p->results->ncols; i++) {
+        colIdx = table_lookup_colindex(p->tn, p->results->colnames[i]);
+        if (colIdx == -1)	/* was timestamp */
+            r->cols[i] = timestamp_to_string(n->tstamp);
+        else
+            r->cols[i] = strdup(tuple_column(p->tn, n->tuple, colIdx));
+    }
+    (void)ll_add(p->rowlist, r);
+}
+
+/*
+ * project the selected archived tuples, placing them before the rows
+ * already in `results'
+ *
+ * returns 1 if successful, 0 if memory ran out before the archive could
+ * be read
+ */
+int filecrawler_project(Filecrawler *fc, Table *tn, Rtab *results) {
+    struct projection p;
+    Span *spans;
+    Rrow **rows, **old;
+    unsigned char *pend;
+    long nrows, lpend;
+    int i, n;
+
+    if (fc->empty) {
+        debugvf("Filecrawler: empty window! (Doing nothing)\n");
+        return 1;
+    }
+
+    if ((n = find_spans(fc, &spans, &pend, &lpend)) < 0)
+        return 0;
+    p.tn = tn;
+    p.results = results;
+    p.rowlist = ll_create();
+    p.skip = 0;
+    if (fc->last >= 0) {	/* pass over all but the last `last' tuples */
+        long long count = 0;
+        for (i = 0; i < n; i++)
+            count += count_span(fc, &spans[i]);
+        scan_pending(fc, tn, pend, lpend, count_tuple, &count);
+        if (count > fc->last)
+            p.skip = count - fc->last;
+    }
+    for (i = 0; i < n; i++) {
+        scan(fc, &spans[i], tn, project_tuple, &p);
+        free(spans[i].name);
+    }
+    scan_pending(fc, tn, pend, lpend, project_tuple, &p);
+    free(spans);
+    free(pend);
+    debugf("Filecrawler: %ld rows from the archive\n", ll_size(p.rowlist));
+
+    if (ll_size(p.rowlist) > 0) {
+        for (i = 0; i < results->nrows; i++)
+            (void)ll_add(p.rowlist, results->rows[i]);
+        rows = (Rrow **)ll_toArray(p.rowlist, &nrows);
+        if (rows) {
+            old = results->rows;
+            results->rows = rows;
+            results->nrows = (int)nrows;
+            free(old);
+        }
+    }
+    ll_destroy(p.rowlist, NULL);
+    return 1;
+}
@@ -31,43 +31,49 @@
 
 /*
  * filecrawler.h
+ *
+ * File Crawler
+ *
+ * The archive counterpart of the node crawler: it runs over the tuples
+ * of a table that had been evicted to its archive when the select started,
+ * selecting those that fit the window and pass the filter rules, and
+ * prepends their projected columns to the results of the in-memory part.
  */
 #ifndef HW_FILECRAWLER_H
 #define HW_FILECRAWLER_H
 
 #include "sqlstmts.h"
 #include "rtab.h"
+#include "predicate.h"
+#include "table.h"
+#include "timestamp.h"
 
 #include "map.h"
 
-#include <unistd.h>
-
-#include <sys/types.h>
-#include <sys/stat.h>
-
 typedef struct filecrawler {
-    Ndx *n;
-    struct stat sb;
+    T *t;
+    long long end; /* archive position when the select started */
+    tstamp_t from; /* lower bound of window, if fromop != 0 */
+    int fromop;
+    tstamp_t to; /* upper bound of window, if toop != 0 */
+    int toop;
+    long long last; /* only the last `last' tuples, if >= 0 */
     int empty;
-    int *drop;
+
+    /* Set by filecrawler_filter */
+    Predicate *pred;
 } Filecrawler;
 
-Filecrawler *filecrawler_new(char *tablename);
+Filecrawler *filecrawler_new(T *t, long long end);
 
 void filecrawler_free(Filecrawler *fc);
 
-void filecrawler_window(Filecrawler *fc, sqlwindow *win);
-
-void filecrawler_filter(Filecrawler *fc, T *t, int nfilters,
-                        sqlfilter **filters, int filtertype);
-
-void filecrawler_project (Filecrawler *fc, T *t, Rtab *results);
-
-long long filecrawler_count (Filecrawler *fc); /* count non-dropped */
+/* `inmemory' is the number of tuples of the table in memory
+ */
+void filecrawler_window(Filecrawler *fc, sqlwindow *win, long inmemory);
 
-void filecrawler_reset (Filecrawler *fc); /* clear dropped */
+void filecrawler_filter(Filecrawler *fc, Predicate *pred);
 
-long long filecrawler_dump (Filecrawler *fc);
+int filecrawler_project(Filecrawler *fc, Table *tn, Rtab *results);
 
 #endif
-
@@ -33,70 +33,50 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include "util.h"
 #include "timestamp.h"
 #include "sqlstmts.h"
 #include "adts/linkedlist.h"
 #include "typetable.h"
+#include "parser.h"
 
-extern int yylex();
+%}
 
-void yyerror(const char *str) {
-    fprintf(stderr,"error: %s\n",str);
-}
+/*
+ * a pure parser: the state of a parse is in `ps', and the flex scanner
+ * is reentrant, so that several statements may be parsed at once
+ */
+%define api.pure
+%parse-param {void *scanner} {struct sqlparser *ps}
+%lex-param {void *scanner}
 
-int yywrap() {
-    return 1;
+%code requires {
+struct sqlparser;
+struct sqlexpr;
 }
 
-/* SQL statement to be returned after parsing */
-extern sqlstmt stmt;
-
-/* Temporary lists used while parsing */
-/* Select */
-LinkedList *clist;
-LinkedList *cattriblist;
-LinkedList *tlist;
-LinkedList *flist;
-LinkedList *wlist;
-LinkedList *plist; /* pair list */
-sqlwindow *tmpwin;
-int tmpunit;
-sqlfilter *tmpfilter;
-sqlpair *tmppair;
-int tmpvaltype;
-char *tmpvalstr;
-int filtertype;
-char *orderby;
-int countstar;
-LinkedList *grouplist;
-sqlinterval tmpinterval;
-/* Create */
-char *tablename;
-LinkedList *colnames;
-LinkedList *coltypes;
-short tabletype;
-short primary_column;
-short column;
-/* Insert */
-/* -- tablename definition from above */
-/* -- coltypes definition from above */
-LinkedList *colvals;
-short transform;
-/* dummy long for calls to ll_toArray */
-static long dummyLong;
-
-%}
-
 %union {
     long long number;
     double numfloat;
     char character;
     char *string;
     unsigned long long tstamp;
+    struct sqlexpr *expr;
 }
 
+%{
+
+extern int yylex(YYSTYPE *lvalp, void *scanner);
+
+void yyerror(__attribute__ ((unused)) void *scanner,
+             __attribute__ ((unused)) struct sqlparser *ps, const char *str) {
+    fprintf(stderr,"error: %s\n",str);
+}
+
+%}
+
 /*%token <number> NUMBER
 %token <numfloat> NUMFLOAT
 */
@@ -112,7 +92,7 @@ static long dummyLong;
 %token SELECT FROM WHERE LESSEQ GREATEREQ LESS GREATER EQUALS COMMA STAR 
 %token SEMICOLON CREATE INSERT TABLETK OPENBRKT CLOSEBRKT TABLE INTO VALUES
 %token BOOLEAN INTEGER REAL CHARACTER VARCHAR BLOB TINYINT SMALLINT
-%token TRUETK FALSETK SINGLEQUOTE PRIMARY KEY
+%token TRUETK FALSETK SINGLEQUOTE PARAM PRIMARY KEY
 %token OPENSQBRKT CLOSESQBRKT MILLIS SECONDS MINUTES HOURS RANGE
 %token SINCE INTERVAL NOW ROWS LAST
 %token SHOW TABLES AND OR
@@ -124,8 +104,15 @@ static long dummyLong;
 %token UPDATE SET ADD SUB ON DUPLICATETK
 %token DELETE
 %token CONTAINS NOTCONTAINS
+%token WITH QUOTA
 
 %type <string> tstamp_expr
+%type <expr> whereExpr
+
+/* NOT binds more tightly than AND, and AND than OR */
+%left OR
+%left AND
+%right NOT
 
 %%
 
@@ -138,164 +125,182 @@ top:          sqlStmt {
             ;
 sqlStmt:      selectStmt {
                 debugvf("Select statment.\n");
-                stmt.type = SQL_TYPE_SELECT;
+                ps->stmt->type = SQL_TYPE_SELECT;
                 /* Columns */
-                stmt.sql.select.ncols =  (int)ll_size(clist);
-                stmt.sql.select.cols = (char **) ll_toArray(clist, &dummyLong);
-                ll_destroy(clist, NULL);
-                clist=NULL;
+                ps->stmt->sql.select.ncols =  (int)ll_size(ps->clist);
+                ps->stmt->sql.select.cols = (char **) ll_toArray(ps->clist, &ps->dummyLong);
+                ll_destroy(ps->clist, NULL);
+                ps->clist=NULL;
                 /* Column attribs (count, min, max, avg, sum) */
-                stmt.sql.select.colattrib = (int **) ll_toArray(cattriblist, &dummyLong);
-                ll_destroy(cattriblist, NULL);
-                cattriblist = NULL;
+                ps->stmt->sql.select.colattrib = (int **) ll_toArray(ps->cattriblist, &ps->dummyLong);
+                ll_destroy(ps->cattriblist, NULL);
+                ps->cattriblist = NULL;
                 /* From Tables */
-                stmt.sql.select.ntables = (int)ll_size(tlist);
-                stmt.sql.select.tables = (char **) ll_toArray(tlist, &dummyLong);
-                ll_destroy(tlist, NULL);
-                tlist=NULL;
+                ps->stmt->sql.select.ntables = (int)ll_size(ps->tlist);
+                ps->stmt->sql.select.tables = (char **) ll_toArray(ps->tlist, &ps->dummyLong);
+                ll_destroy(ps->tlist, NULL);
+                ps->tlist=NULL;
                 /* Table windows */
-                if (wlist) {
-                  stmt.sql.select.windows = (sqlwindow **) ll_toArray(wlist, &dummyLong);
-                  ll_destroy(wlist, NULL);
-                  wlist=NULL;
+                if (ps->wlist) {
+                  ps->stmt->sql.select.windows = (sqlwindow **) ll_toArray(ps->wlist, &ps->dummyLong);
+                  ll_destroy(ps->wlist, NULL);
+                  ps->wlist=NULL;
                 }
                 /* Where filters */
-                if (flist) {
-                  stmt.sql.select.nfilters = (int)ll_size(flist);
-                  stmt.sql.select.filters = (sqlfilter **) ll_toArray(flist, &dummyLong);
-                  stmt.sql.select.filtertype = filtertype;
-                  ll_destroy(flist, NULL);
-                  flist=NULL;
+                if (ps->flist) {
+                  ps->stmt->sql.select.nfilters = (int)ll_size(ps->flist);
+                  ps->stmt->sql.select.filters = (sqlfilter **) ll_toArray(ps->flist, &ps->dummyLong);
+                  ps->stmt->sql.select.where = ps->where;
+                  ps->where = NULL;
+                  ll_destroy(ps->flist, NULL);
+                  ps->flist=NULL;
                 }
                 /* Order by */
-                if (orderby) {
-                  stmt.sql.select.orderby = orderby;
+                if (ps->orderby) {
+                  ps->stmt->sql.select.orderby = ps->orderby;
                 } else {
-                  stmt.sql.select.orderby = NULL;
+                  ps->stmt->sql.select.orderby = NULL;
                 }
                 /* Count(*) ? */
-                if (countstar) {
+                if (ps->countstar) {
                   debugvf("Is count(*)\n");
-                  stmt.sql.select.isCountStar = 1;
+                  ps->stmt->sql.select.isCountStar = 1;
                 } else {
                   debugvf("Not count(*)\n");
-                  stmt.sql.select.isCountStar = 0;
+                  ps->stmt->sql.select.isCountStar = 0;
                 }
                 /* Group by */
-                if (grouplist) {
-                  stmt.sql.select.groupby_ncols =  (int)ll_size(grouplist);
-                  stmt.sql.select.groupby_cols = (char **) ll_toArray(grouplist, &dummyLong);
-                  ll_destroy(grouplist, NULL);
-                  grouplist=NULL;
+                if (ps->grouplist) {
+                  ps->stmt->sql.select.groupby_ncols =  (int)ll_size(ps->grouplist);
+                  ps->stmt->sql.select.groupby_cols = (char **) ll_toArray(ps->grouplist, &ps->dummyLong);
+                  ll_destroy(ps->grouplist, NULL);
+                  ps->grouplist=NULL;
                 } else {
-                  stmt.sql.select.groupby_ncols = 0;
-                  stmt.sql.select.groupby_cols = NULL;
+                  ps->stmt->sql.select.groupby_ncols = 0;
+                  ps->stmt->sql.select.groupby_cols = NULL;
                 }
               }
             | createStmt {
                 debugvf("Create statement.\n");
-                stmt.type = SQL_TYPE_CREATE;
-                stmt.sql.create.tablename = tablename;
-                stmt.sql.create.ncols = (int)ll_size(colnames);
-                stmt.sql.create.colname = (char **) ll_toArray(colnames, &dummyLong);
-                stmt.sql.create.coltype = (int **) ll_toArray(coltypes, &dummyLong);
-                ll_destroy(colnames, NULL);
-                colnames=NULL;
-                ll_destroy(coltypes, NULL);
-                coltypes=NULL;
-                stmt.sql.create.tabletype = tabletype;
-                stmt.sql.create.primary_column = primary_column;
+                ps->stmt->type = SQL_TYPE_CREATE;
+                ps->stmt->sql.create.tablename = ps->tablename;
+                ps->stmt->sql.create.ncols = (int)ll_size(ps->colnames);
+                ps->stmt->sql.create.colname = (char **) ll_toArray(ps->colnames, &ps->dummyLong);
+                ps->stmt->sql.create.coltype = (int **) ll_toArray(ps->coltypes, &ps->dummyLong);
+                ps->stmt->sql.create.coldict = NULL;
+                if (ps->dictcols) {
+                  void *c;
+                  long j;
+                  ps->stmt->sql.create.coldict = (char *)calloc(ps->stmt->sql.create.ncols, 1);
+                  for (j = 0; ll_get(ps->dictcols, j, &c); j++)
+                    ps->stmt->sql.create.coldict[(long)c - 1] = 1;
+                  ll_destroy(ps->dictcols, NULL);
+                  ps->dictcols = NULL;
+                }
+                ll_destroy(ps->colnames, NULL);
+                ps->colnames=NULL;
+                ll_destroy(ps->coltypes, NULL);
+                ps->coltypes=NULL;
+                ps->stmt->sql.create.tabletype = ps->tabletype;
+                ps->stmt->sql.create.primary_column = ps->primary_column;
+                ps->stmt->sql.create.quota = ps->tabquota;
+                ps->stmt->sql.create.rows = ps->tabrows;
+                ps->stmt->sql.create.archive = ps->tabarchive;
+                ps->stmt->sql.create.compress = ps->tabcompress;
+                ps->stmt->sql.create.ttl = ps->tabttl;
               }
             | insertStmt {
                 debugvf("Insert statement.\n");
-                stmt.type = SQL_TYPE_INSERT;
-                stmt.sql.insert.tablename = tablename;
-                stmt.sql.insert.ncols = (int)ll_size(colvals);
-                stmt.sql.insert.colval = (char **) ll_toArray(colvals, &dummyLong);
-                stmt.sql.insert.coltype = (int **) ll_toArray(coltypes, &dummyLong);
-                stmt.sql.insert.transform = transform;
-                ll_destroy(colvals, NULL);
-                colvals=NULL;
-                ll_destroy(coltypes, NULL);
-                coltypes=NULL;
+                ps->stmt->type = SQL_TYPE_INSERT;
+                ps->stmt->sql.insert.tablename = ps->tablename;
+                ps->stmt->sql.insert.ncols = (int)ll_size(ps->colvals);
+                ps->stmt->sql.insert.colval = (char **) ll_toArray(ps->colvals, &ps->dummyLong);
+                ps->stmt->sql.insert.coltype = (int **) ll_toArray(ps->coltypes, &ps->dummyLong);
+                ps->stmt->sql.insert.transform = ps->transform;
+                ll_destroy(ps->colvals, NULL);
+                ps->colvals=NULL;
+                ll_destroy(ps->coltypes, NULL);
+                ps->coltypes=NULL;
               }
             | deleteStmt {
                 debugvf("Delete statement.\n");
-                stmt.type = SQL_TYPE_DELETE;
-                stmt.sql.delete.tablename = tablename;
-                if (flist) {
-                  stmt.sql.delete.nfilters = (int)ll_size(flist);
-                  stmt.sql.delete.filters = (sqlfilter **)ll_toArray(flist, &dummyLong);
-                  stmt.sql.delete.filtertype = filtertype;
-                  ll_destroy(flist, NULL);
-                  flist = NULL;
+                ps->stmt->type = SQL_TYPE_DELETE;
+                ps->stmt->sql.delete.tablename = ps->tablename;
+                if (ps->flist) {
+                  ps->stmt->sql.delete.nfilters = (int)ll_size(ps->flist);
+                  ps->stmt->sql.delete.filters = (sqlfilter **)ll_toArray(ps->flist, &ps->dummyLong);
+                  ps->stmt->sql.delete.where = ps->where;
+                  ps->where = NULL;
+                  ll_destroy(ps->flist, NULL);
+                  ps->flist = NULL;
                 }
               }
             | updateStmt {
                 debugvf("Update statement.\n");
-                stmt.type = SQL_TYPE_UPDATE;
-                stmt.sql.update.tablename = tablename;
+                ps->stmt->type = SQL_TYPE_UPDATE;
+                ps->stmt->sql.update.tablename = ps->tablename;
                 /* Set pairs */
-                if (plist) {
-                  stmt.sql.update.npairs = (int)ll_size(plist);
-                  stmt.sql.update.pairs = (sqlpair **) ll_toArray(plist, &dummyLong);
-                  ll_destroy(plist, NULL);
-                  plist=NULL;
+                if (ps->plist) {
+                  ps->stmt->sql.update.npairs = (int)ll_size(ps->plist);
+                  ps->stmt->sql.update.pairs = (sqlpair **) ll_toArray(ps->plist, &ps->dummyLong);
+                  ll_destroy(ps->plist, NULL);
+                  ps->plist=NULL;
                 }
                 /* Where filters */
-                if (flist) {
-                  stmt.sql.update.nfilters = (int)ll_size(flist);
-                  stmt.sql.update.filters = (sqlfilter **) ll_toArray(flist, &dummyLong);
-                  stmt.sql.update.filtertype = filtertype;
-                  ll_destroy(flist, NULL);
-                  flist=NULL;
+                if (ps->flist) {
+                  ps->stmt->sql.update.nfilters = (int)ll_size(ps->flist);
+                  ps->stmt->sql.update.filters = (sqlfilter **) ll_toArray(ps->flist, &ps->dummyLong);
+                  ps->stmt->sql.update.where = ps->where;
+                  ps->where = NULL;
+                  ll_destroy(ps->flist, NULL);
+                  ps->flist=NULL;
                 }
               }
             | SHOW TABLES {
                 debugvf("Show tables.\n");
-                stmt.type = SQL_SHOW_TABLES;
+                ps->stmt->type = SQL_SHOW_TABLES;
               }
             | SHOW TABLETK WORD {
                 debugvf("Show table %s.\n", (char *)$3);
-                stmt.sql.meta.table = $3;
-                stmt.type = SQL_TABLE_META;
+                ps->stmt->sql.meta.table = $3;
+                ps->stmt->type = SQL_TABLE_META;
               }
             | REGISTER QUOTEDSTRING IPADDR NUMBER WORD {
                 debugvf("Register statement: automaton: %s\nip:port:service: %s:%s:%s\n", 
                         (char*)$2,(char*)$3,(char*)$4,(char*)$5);
-                stmt.type = SQL_TYPE_REGISTER;
-                stmt.sql.regist.automaton = $2;
-                stmt.sql.regist.ipaddr = $3;
-                stmt.sql.regist.port = $4;
-                stmt.sql.regist.service = $5;
+                ps->stmt->type = SQL_TYPE_REGISTER;
+                ps->stmt->sql.regist.automaton = $2;
+                ps->stmt->sql.regist.ipaddr = $3;
+                ps->stmt->sql.regist.port = $4;
+                ps->stmt->sql.regist.service = $5;
               }
             | UNREGISTER NUMBER {
                 debugvf("Unregister statement: automaton id: %s\n", (char *)$2);
-                stmt.type = SQL_TYPE_UNREGISTER;
-                stmt.sql.unregist.id = $2;
+                ps->stmt->type = SQL_TYPE_UNREGISTER;
+                ps->stmt->sql.unregist.id = $2;
               }
             ;
 
-selectStmt:   SELECT all FROM tableList { orderby = NULL;}
-            | SELECT all FROM tableList WHERE filterList {orderby = NULL;}
+selectStmt:   SELECT all FROM tableList { ps->orderby = NULL;}
+            | SELECT all FROM tableList WHERE filterList {ps->orderby = NULL;}
             | SELECT all FROM tableList ORDER BY orderList
             | SELECT all FROM tableList WHERE filterList ORDER BY orderList
-            | SELECT colList FROM tableList { orderby = NULL; countstar = 0; }
+            | SELECT colList FROM tableList { ps->orderby = NULL; ps->countstar = 0; }
             | SELECT colList FROM tableList WHERE filterList {
-                orderby = NULL; countstar = 0;
+                ps->orderby = NULL; ps->countstar = 0;
               }
-            | SELECT colList FROM tableList ORDER BY orderList {countstar = 0;}
+            | SELECT colList FROM tableList ORDER BY orderList {ps->countstar = 0;}
             | SELECT colList FROM tableList WHERE filterList ORDER BY orderList {
-                countstar = 0;
+                ps->countstar = 0;
               }
             | SELECT colList FROM tableList GROUP BY groupList {
-                orderby = NULL; countstar = 0;
+                ps->orderby = NULL; ps->countstar = 0;
               }
             | SELECT colList FROM tableList WHERE filterList GROUP BY groupList {
-                orderby = NULL; countstar = 0;
+                ps->orderby = NULL; ps->countstar = 0;
               }
             | SELECT colList FROM tableList WHERE filterList GROUP BY groupList ORDER BY orderList {
-                countstar = 0;
+                ps->countstar = 0;
               }
             ;
 
@@ -305,88 +310,88 @@ colList:      col
 
 col:          WORD {
                 debugvf("Col: %s\n", (char *)$1);
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, (void *)$1);
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_NONE);
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, (void *)$1);
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_NONE);
               }
               /*| COUNT OPENBRKT WORD CLOSEBRKT {
                 debugvf("Col (COUNT): %s\n", (char *)$3);
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, (void *)$3);
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_COUNT);
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, (void *)$3);
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_COUNT);
               } */
             | MIN OPENBRKT WORD CLOSEBRKT {
                 debugvf("Col (MIN): %s\n", (char *)$3);
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, (void *)$3);
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_MIN);
-                stmt.sql.select.containsMinMaxAvgSum = 1;
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, (void *)$3);
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_MIN);
+                ps->stmt->sql.select.containsMinMaxAvgSum = 1;
               }
             | MAX OPENBRKT WORD CLOSEBRKT {
                 debugvf("Col (MAX): %s\n", (char *)$3);
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, (void *)$3);
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_MAX);
-                stmt.sql.select.containsMinMaxAvgSum = 1;
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, (void *)$3);
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_MAX);
+                ps->stmt->sql.select.containsMinMaxAvgSum = 1;
               }
             | AVG OPENBRKT WORD CLOSEBRKT {
                 debugvf("Col (AVG): %s\n", (char *)$3);
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, (void *)$3);
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_AVG);
-                stmt.sql.select.containsMinMaxAvgSum = 1;
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, (void *)$3);
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_AVG);
+                ps->stmt->sql.select.containsMinMaxAvgSum = 1;
               }
             | SUM OPENBRKT WORD CLOSEBRKT {
                 debugvf("Col (SUM): %s\n", (char *)$3);
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, (void *)$3);
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_SUM);
-                stmt.sql.select.containsMinMaxAvgSum = 1;
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, (void *)$3);
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_SUM);
+                ps->stmt->sql.select.containsMinMaxAvgSum = 1;
               }
             ;
 
 all:          STAR {
                 debugvf("Select *\n");
                 /* no accumulated list possible with STAR */
-                if (clist) {
-                  ll_destroy(clist, NULL);
-                  clist = NULL;
+                if (ps->clist) {
+                  ll_destroy(ps->clist, NULL);
+                  ps->clist = NULL;
                 }
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, strdup("*"));
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_NONE);
-                countstar = 0;
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, strdup("*"));
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_NONE);
+                ps->countstar = 0;
               }
             | COUNT OPENBRKT STAR CLOSEBRKT {
                 debugvf("Select count(*)\n");
-                if (!clist)
-                  clist = ll_create();
-                (void)ll_add(clist, strdup("*"));
-                if (!cattriblist)
-                  cattriblist = ll_create();
-                (void)ll_add(cattriblist, (void *)SQL_COLATTRIB_COUNT);
-                countstar = 1;
+                if (!ps->clist)
+                  ps->clist = ll_create();
+                (void)ll_add(ps->clist, strdup("*"));
+                if (!ps->cattriblist)
+                  ps->cattriblist = ll_create();
+                (void)ll_add(ps->cattriblist, (void *)SQL_COLATTRIB_COUNT);
+                ps->countstar = 1;
               }
             ;
 
@@ -396,24 +401,24 @@ tableList:    table
 
 table:        WORD {
                 debugvf("Table: %s\n", (char *)$1);
-                if (!tlist)
-                  tlist = ll_create();
-                (void)ll_add(tlist, (void *)$1);
+                if (!ps->tlist)
+                  ps->tlist = ll_create();
+                (void)ll_add(ps->tlist, (void *)$1);
                 /* Add empty stub window */
-                if (!wlist)
-                  wlist = ll_create();
-                tmpwin = sqlstmt_new_stubwindow();
-                (void)ll_add(wlist, (void *)tmpwin);
+                if (!ps->wlist)
+                  ps->wlist = ll_create();
+                ps->tmpwin = sqlstmt_new_stubwindow();
+                (void)ll_add(ps->wlist, (void *)ps->tmpwin);
               }
             | WORD OPENSQBRKT window CLOSESQBRKT {
                 debugvf("Table with window: %s\n", (char*)$1);
-                if (!tlist)
-                  tlist = ll_create();
-                (void)ll_add(tlist, (void *)$1);
+                if (!ps->tlist)
+                  ps->tlist = ll_create();
+                (void)ll_add(ps->tlist, (void *)$1);
                 /* Add window */
-                if (!wlist)
-                  wlist = ll_create();
-                (void)ll_add(wlist, (void *)tmpwin);
+                if (!ps->wlist)
+                  ps->wlist = ll_create();
+                (void)ll_add(ps->wlist, (void *)ps->tmpwin);
               }
             ;
 
@@ -423,22 +428,22 @@ window:       timewindow
 
 timewindow:   NOW {
                 debugvf("TimeWindow NOW\n");
-                tmpwin = sqlstmt_new_timewindow_now();
+                ps->tmpwin = sqlstmt_new_timewindow_now();
               }
             | RANGE NUMBER unit {
-                debugvf("TimeWindow Range %d, unit:%d\n", atoi($2), tmpunit);
-                tmpwin = sqlstmt_new_timewindow(atoi($2), tmpunit);
+                debugvf("TimeWindow Range %d, unit:%d\n", atoi($2), ps->tmpunit);
+                ps->tmpwin = sqlstmt_new_timewindow(atoi($2), ps->tmpunit);
                 /* NB: memory leak. need to free $2 */
                 free($2);
               }
             | SINCE tstamp_expr {
                 debugvf("TimeWindow Since %s\n", $2);
-                tmpwin = sqlstmt_new_timewindow_since($2);
+                ps->tmpwin = sqlstmt_new_timewindow_since($2);
                 free($2);
               }
             | INTERVAL intvl_expr {
                 debugvf("Timewindow Interval\n");
-                tmpwin = sqlstmt_new_timewindow_interval(&tmpinterval);
+                ps->tmpwin = sqlstmt_new_timewindow_interval(&ps->tmpinterval);
               }
             ;
 
@@ -456,34 +461,34 @@ tstamp_expr:  TSTAMP {
             ;
 
 intvl_expr:   OPENBRKT tstamp_expr COMMA tstamp_expr CLOSEBRKT {
-                tmpinterval.leftOp = GREATER;
-                tmpinterval.rightOp = LESS;
-                tmpinterval.leftTs = string_to_timestamp($2);
-                tmpinterval.rightTs = string_to_timestamp($4);
+                ps->tmpinterval.leftOp = GREATER;
+                ps->tmpinterval.rightOp = LESS;
+                ps->tmpinterval.leftTs = string_to_timestamp($2);
+                ps->tmpinterval.rightTs = string_to_timestamp($4);
                 free($2);
                 free($4);
               }
             | OPENBRKT tstamp_expr COMMA tstamp_expr CLOSESQBRKT {
-                tmpinterval.leftOp = GREATER;
-                tmpinterval.rightOp = LESSEQ;
-                tmpinterval.leftTs = string_to_timestamp($2);
-                tmpinterval.rightTs = string_to_timestamp($4);
+                ps->tmpinterval.leftOp = GREATER;
+                ps->tmpinterval.rightOp = LESSEQ;
+                ps->tmpinterval.leftTs = string_to_timestamp($2);
+                ps->tmpinterval.rightTs = string_to_timestamp($4);
                 free($2);
                 free($4);
               }
             | OPENSQBRKT tstamp_expr COMMA tstamp_expr CLOSEBRKT {
-                tmpinterval.leftOp = GREATEREQ;
-                tmpinterval.rightOp = LESS;
-                tmpinterval.leftTs = string_to_timestamp($2);
-                tmpinterval.rightTs = string_to_timestamp($4);
+                ps->tmpinterval.leftOp = GREATEREQ;
+                ps->tmpinterval.rightOp = LESS;
+                ps->tmpinterval.leftTs = string_to_timestamp($2);
+                ps->tmpinterval.rightTs = string_to_timestamp($4);
                 free($2);
                 free($4);
               }
             | OPENSQBRKT tstamp_expr COMMA tstamp_expr CLOSESQBRKT {
-                tmpinterval.leftOp = GREATEREQ;
-                tmpinterval.rightOp = LESSEQ;
-                tmpinterval.leftTs = string_to_timestamp($2);
-                tmpinterval.rightTs = string_to_timestamp($4);
+                ps->tmpinterval.leftOp = GREATEREQ;
+                ps->tmpinterval.rightOp = LESSEQ;
+                ps->tmpinterval.leftTs = string_to_timestamp($2);
+                ps->tmpinterval.rightTs = string_to_timestamp($4);
                 free($2);
                 free($4);
               }
@@ -491,42 +496,56 @@ intvl_expr:   OPENBRKT tstamp_expr COMMA tstamp_expr CLOSEBRKT {
 
 unit:         MILLIS {
                 debugvf("TimeWindow unit MILLIS\n");
-                tmpunit = SQL_WINTYPE_TIME_MILLIS;
+                ps->tmpunit = SQL_WINTYPE_TIME_MILLIS;
               }
             | SECONDS {
                 debugvf("TimeWindow unit SECONDS\n");
-                tmpunit = SQL_WINTYPE_TIME_SECONDS;
+                ps->tmpunit = SQL_WINTYPE_TIME_SECONDS;
               }
             | MINUTES {
                 debugvf("TimeWindow unit MINUTES\n");
-                tmpunit = SQL_WINTYPE_TIME_MINUTES;
+                ps->tmpunit = SQL_WINTYPE_TIME_MINUTES;
               }
             | HOURS {
                 debugvf("TimeWindow unit HOURS\n");
-                tmpunit = SQL_WINTYPE_TIME_HOURS;
+                ps->tmpunit = SQL_WINTYPE_TIME_HOURS;
               }
             ;
 
 tplwindow:    ROWS NUMBER {
                 debugvf("TupleWindow ROWS %d\n", atoi($2));
-                tmpwin = sqlstmt_new_tuplewindow(atoi($2));
+                ps->tmpwin = sqlstmt_new_tuplewindow(atoi($2));
                 /* NB: memory leak. need to free $2 */
                 free($2);
               }
             | LAST {
                 debugvf("TupleWindow LAST\n");
-                tmpwin = sqlstmt_new_tuplewindow(1);
+                ps->tmpwin = sqlstmt_new_tuplewindow(1);
               }
             ;
 
-filterList:   filter
-            | filterList AND filter {
+filterList:   whereExpr {
+                ps->where = $1;
+              }
+            ;
+
+whereExpr:    filter {
+                $$ = sqlstmt_new_expr(SQL_EXPR_FILTER, ps->tmpfilter, NULL, NULL);
+              }
+            | whereExpr AND whereExpr {
                 debugvf("Filter type: AND\n");
-                filtertype = SQL_FILTER_TYPE_AND;
+                $$ = sqlstmt_new_expr(SQL_EXPR_AND, NULL, $1, $3);
               }
-            | filterList OR filter {
+            | whereExpr OR whereExpr {
                 debugvf("Filter type: OR\n");
-                filtertype = SQL_FILTER_TYPE_OR;
+                $$ = sqlstmt_new_expr(SQL_EXPR_OR, NULL, $1, $3);
+              }
+            | NOT whereExpr {
+                debugvf("Filter type: NOT\n");
+                $$ = sqlstmt_new_expr(SQL_EXPR_NOT, NULL, $2, NULL);
+              }
+            | OPENBRKT whereExpr CLOSEBRKT {
+                $$ = $2;
               }
             ;
 
@@ -537,112 +556,112 @@ pairList:     pair
             ;
 
 pair:         WORD EQUALS constant {
-                debugvf("Pair (WORD=constant): %s = %s\n", (char *)$1, tmpvalstr);
-                if (!plist)
-                  plist = ll_create();
-                tmppair = sqlstmt_new_pair(EQUALS, (char*)$1, tmpvaltype, tmpvalstr);
-                (void)ll_add(plist, (void *)tmppair);
-                free(tmpvalstr);
+                debugvf("Pair (WORD=constant): %s = %s\n", (char *)$1, ps->tmpvalstr);
+                if (!ps->plist)
+                  ps->plist = ll_create();
+                ps->tmppair = sqlstmt_new_pair(EQUALS, (char*)$1, ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->plist, (void *)ps->tmppair);
+                free(ps->tmpvalstr);
               }
             | WORD ADD constant {
-                debugvf("Pair (WORD+=constant): %s += %s\n", (char *)$1, tmpvalstr);
-                if (!plist)
-                  plist = ll_create();
-                tmppair = sqlstmt_new_pair(ADD, (char*)$1, tmpvaltype, tmpvalstr);
-                (void)ll_add(plist, (void *)tmppair);
-                free(tmpvalstr);
+                debugvf("Pair (WORD+=constant): %s += %s\n", (char *)$1, ps->tmpvalstr);
+                if (!ps->plist)
+                  ps->plist = ll_create();
+                ps->tmppair = sqlstmt_new_pair(ADD, (char*)$1, ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->plist, (void *)ps->tmppair);
+                free(ps->tmpvalstr);
               }
             | WORD SUB constant {
-                debugvf("Pair (WORD-=constant): %s -= %s\n", (char *)$1, tmpvalstr);
-                if (!plist)
-                  plist = ll_create();
-                tmppair = sqlstmt_new_pair(SUB, (char*)$1, tmpvaltype, tmpvalstr);
-                (void)ll_add(plist, (void *)tmppair);
-                free(tmpvalstr);
+                debugvf("Pair (WORD-=constant): %s -= %s\n", (char *)$1, ps->tmpvalstr);
+                if (!ps->plist)
+                  ps->plist = ll_create();
+                ps->tmppair = sqlstmt_new_pair(SUB, (char*)$1, ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->plist, (void *)ps->tmppair);
+                free(ps->tmpvalstr);
               }
             ;
 
 filter:       WORD EQUALS constant {
                 debugvf("Filter (WORD==constant): %s == %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(EQUALS, (char*)$1,
-                                               tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(EQUALS, (char*)$1,
+                                               ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             | WORD LESS constant {
                 debugvf("Filter (WORD<constant): %s == %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(LESS, (char*)$1,
-                                               tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(LESS, (char*)$1,
+                                               ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             | WORD GREATER constant {
                 debugvf("Filter (WORD>constant): %s == %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(GREATER, (char*)$1,
-                                               tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(GREATER, (char*)$1,
+                                               ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             | WORD LESSEQ constant {
                 debugvf("Filter (WORD<=constant): %s == %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(LESSEQ, (char*)$1,
-                                               tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(LESSEQ, (char*)$1,
+                                               ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             | WORD GREATEREQ constant {
                 debugvf("Filter (WORD>=constant): %s == %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(GREATEREQ, (char*)$1,
-                                               tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(GREATEREQ, (char*)$1,
+                                               ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             | WORD CONTAINS constant {
                 debugvf("Filter (WORD contains constant): %s contains %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(CONTAINS, (char*)$1, tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(CONTAINS, (char*)$1, ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             | WORD NOTCONTAINS constant {
                 debugvf("Filter (WORD notcontains constant): %s notcontains %s\n",
-                        (char *)$1, tmpvalstr);
-                if (!flist)
-                  flist = ll_create();
-                tmpfilter = sqlstmt_new_filter(NOTCONTAINS, (char*)$1, tmpvaltype, tmpvalstr);
-                (void)ll_add(flist, (void *)tmpfilter);
-                free(tmpvalstr);
+                        (char *)$1, ps->tmpvalstr);
+                if (!ps->flist)
+                  ps->flist = ll_create();
+                ps->tmpfilter = sqlstmt_new_filter(NOTCONTAINS, (char*)$1, ps->tmpvaltype, ps->tmpvalstr);
+                (void)ll_add(ps->flist, (void *)ps->tmpfilter);
+                free(ps->tmpvalstr);
               }
             ;
 
 constant:     NUMBER {
-                tmpvaltype = INTEGER;
-                tmpvalstr = (char *)$1;
+                ps->tmpvaltype = INTEGER;
+                ps->tmpvalstr = (char *)$1;
               }
             | NUMFLOAT {
-                tmpvaltype = REAL;
-                tmpvalstr = (char *)$1;
+                ps->tmpvaltype = REAL;
+                ps->tmpvalstr = (char *)$1;
               }
             | tstamp_expr {
-                tmpvaltype = TSTAMP;
-                tmpvalstr = (char *)$1;
+                ps->tmpvaltype = TSTAMP;
+                ps->tmpvalstr = (char *)$1;
               }
             | QUOTEDSTRING {
                 char *p = (char *)malloc(strlen($1));
@@ -651,14 +670,14 @@ constant:     NUMBER {
                 debugvf("Value varchar: %s\n", $1);
                 i = strlen(p) - 1;	/* will point at \" || \n*/
                 p[i] = '\0';		/* overwrite it */
-                tmpvaltype = VARCHAR;
-                tmpvalstr = strdup(p);
+                ps->tmpvaltype = VARCHAR;
+                ps->tmpvalstr = strdup(p);
               }
             ;
 
 orderList:    WORD {
                 debugvf("Order by: %s\n", (char *)$1);
-                orderby = $1;
+                ps->orderby = $1;
               }
             ;
 
@@ -668,26 +687,113 @@ groupList:    groupcol
 
 groupcol:     WORD {
                 debugvf("Group by col: %s\n", (char *)$1);
-                if (!grouplist)
-                  grouplist = ll_create();
-                (void)ll_add(grouplist, (void *)$1);
+                if (!ps->grouplist)
+                  ps->grouplist = ll_create();
+                (void)ll_add(ps->grouplist, (void *)$1);
               }
 
-createStmt:   CREATE tabDecl WORD { column = 0; } OPENBRKT varDecls CLOSEBRKT {
+createStmt:   CREATE tabDecl WORD { ps->column = 0; } OPENBRKT varDecls CLOSEBRKT withClause {
                 debugvf("Tablename: %s\n", (char *)$3);
-                tablename = $3;
+                ps->tablename = $3;
               }
             ;
 
 tabDecl:      TABLETK {
                 debugvf("tabDec: table\n");
-                tabletype = 0;
-                primary_column = -1;
+                ps->tabletype = 0;
+                ps->primary_column = -1;
+                ps->tabquota = 0;
+                ps->tabrows = 0;
+                ps->tabarchive = 0;
+                ps->tabcompress = 0;
+                ps->tabttl = 0;
+                if (ps->dictcols)
+                  ll_destroy(ps->dictcols, NULL);
+                ps->dictcols = NULL;
               }
             | PERSISTENTTABLETK {
                 debugvf("tabDec: persistenttable\n");
-                tabletype = 1;
-                primary_column = -1;
+                ps->tabletype = 1;
+                ps->primary_column = -1;
+                ps->tabquota = 0;
+                ps->tabrows = 0;
+                ps->tabarchive = 0;
+                ps->tabcompress = 0;
+                ps->tabttl = 0;
+                if (ps->dictcols)
+                  ll_destroy(ps->dictcols, NULL);
+                ps->dictcols = NULL;
+              }
+            ;
+
+withClause:   /* empty */
+            | WITH OPENBRKT withOpts CLOSEBRKT
+            ;
+
+withOpts:     withOpt
+            | withOpts COMMA withOpt
+            ;
+
+withOpt:      QUOTA EQUALS NUMBER {
+                debugvf("withOpt: quota = %s\n", $3);
+                ps->tabquota = strtoll($3, NULL, 10);
+                free($3);
+              }
+            | QUOTA EQUALS NUMBER WORD {
+                long long mult;
+                debugvf("withOpt: quota = %s%s\n", $3, $4);
+                if (strcasecmp($4, "k") == 0)
+                  mult = 1024LL;
+                else if (strcasecmp($4, "m") == 0)
+                  mult = 1024LL * 1024LL;
+                else if (strcasecmp($4, "g") == 0)
+                  mult = 1024LL * 1024LL * 1024LL;
+                else {
+                  errorf("quota units must be k, m or g: %s\n", $4);
+                  free($3);
+                  free($4);
+                  YYABORT;
+                }
+                ps->tabquota = mult * strtoll($3, NULL, 10);
+                free($3);
+                free($4);
+              }
+            | ROWS EQUALS NUMBER {
+                debugvf("withOpt: rows = %s\n", $3);
+                ps->tabrows = strtoll($3, NULL, 10);
+                free($3);
+              }
+            | WORD EQUALS NUMBER unit {
+                long long mult = 1LL;
+                debugvf("withOpt: %s = %s, unit:%d\n", $1, $3, ps->tmpunit);
+                if (strcasecmp($1, "ttl") != 0) {
+                  errorf("unknown table option: %s\n", $1);
+                  free($1);
+                  free($3);
+                  YYABORT;
+                }
+                if (ps->tmpunit == SQL_WINTYPE_TIME_SECONDS)
+                  mult = 1000LL;
+                else if (ps->tmpunit == SQL_WINTYPE_TIME_MINUTES)
+                  mult = 60LL * 1000LL;
+                else if (ps->tmpunit == SQL_WINTYPE_TIME_HOURS)
+                  mult = 3600LL * 1000LL;
+                ps->tabttl = mult * strtoll($3, NULL, 10);
+                free($1);
+                free($3);
+              }
+            | WORD {
+                debugvf("withOpt: %s\n", $1);
+                if (strcasecmp($1, "archive") == 0)
+                  ps->tabarchive = 1;
+                else if (strcasecmp($1, "compress") == 0)
+                  ps->tabcompress = 1;
+                else {
+                  errorf("unknown table option: %s\n", $1);
+                  free($1);
+                  YYABORT;
+                }
+                free($1);
               }
             ;
 	
@@ -697,133 +803,155 @@ varDecls:     varDec
 	
 varDec:       WORD BOOLEAN SQLattrib {
                 debugvf("varDec boolean: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_BOOLEAN);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_BOOLEAN);
               }
             | WORD INTEGER SQLattrib {
                 debugvf("varDec integer: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_INTEGER);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_INTEGER);
               }
             | WORD REAL SQLattrib {
                 debugvf("varDec real: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_REAL);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_REAL);
               }
             | WORD CHARACTER SQLattrib {
                 debugvf("varDec character: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_CHARACTER);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_CHARACTER);
               }
             | WORD VARCHAR OPENBRKT NUMBER CLOSEBRKT SQLattrib {
                 debugvf("varDec varchar: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_VARCHAR);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_VARCHAR);
+                free($4);
+              }
+            | WORD VARCHAR OPENBRKT NUMBER CLOSEBRKT WORD SQLattrib {
+                debugvf("varDec varchar %s: %s\n", $6, $1);
+                if (strcasecmp($6, "dictionary") != 0) {
+                  errorf("unknown column option: %s\n", $6);
+                  free($1);
+                  free($4);
+                  free($6);
+                  YYABORT;
+                }
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_VARCHAR);
+                if (!ps->dictcols)
+                  ps->dictcols = ll_create();
+                (void)ll_add(ps->dictcols, (void *)(long)ps->column);
                 free($4);
+                free($6);
               }
             | WORD BLOB OPENBRKT NUMBER CLOSEBRKT SQLattrib {
                 debugvf("varDec blob: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_BLOB);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_BLOB);
               }
             | WORD TINYINT SQLattrib {
                 debugvf("varDec tinyint: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_TINYINT);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_TINYINT);
               }
             | WORD SMALLINT SQLattrib {
                 debugvf("varDec smallint: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_SMALLINT);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_SMALLINT);
               }
             | WORD TSTAMP SQLattrib {
                 debugvf("varDec timestamp: %s\n", $1);
-                column++;
-                if (!colnames)
-                  colnames = ll_create();
-                (void)ll_add(colnames, (void *)$1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_TIMESTAMP);
+                ps->column++;
+                if (!ps->colnames)
+                  ps->colnames = ll_create();
+                (void)ll_add(ps->colnames, (void *)$1);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_TIMESTAMP);
               }
             ;
 
 SQLattrib:    /* empty */ { /* do nothing */
               }
             | PRIMARY KEY {
-                if (! tabletype) {
+                if (! ps->tabletype) {
                   errorf("primary key defined for non-persistent table.\n");
                   YYABORT;
-                } else if (primary_column != -1) {
+                } else if (ps->primary_column != -1) {
                   errorf("two or more primary keys declared\n");
                   YYABORT;
                 } else {
-                  primary_column = column;
+                  ps->primary_column = ps->column;
                 }
               }
             ;
 
 insertStmt:   INSERT INTO WORD VALUES OPENBRKT valList CLOSEBRKT {
                 debugvf("Tablename: %s\n", (char *)$3);
-                tablename = $3;
-                transform = 0;
+                ps->tablename = $3;
+                ps->transform = 0;
               }
             | INSERT INTO WORD VALUES OPENBRKT valList CLOSEBRKT ON DUPLICATETK KEY UPDATE {
                 debugvf("Tablename: %s\n", (char *)$3);
-                tablename = $3;
-                transform = 1;
+                ps->tablename = $3;
+                ps->transform = 1;
               } 
             ;
 
 deleteStmt:   DELETE FROM WORD WHERE filterList {
                 debugvf("Delete records from %s\n", (char *)$3);
-                tablename = $3;
+                ps->tablename = $3;
               }
             ;
 
 updateStmt:   UPDATE WORD SET pairList WHERE filterList {
                 debugvf("Update table %s\n", (char *)$2);
-                tablename = $2;
+                ps->tablename = $2;
               }
             ;
 	
@@ -833,57 +961,57 @@ valList:      val
 
 val:          SINGLEQUOTE TRUETK SINGLEQUOTE {
                 debugvf("Value bool true\n");
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, strdup("1"));
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_BOOLEAN);
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, strdup("1"));
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_BOOLEAN);
               }
             | SINGLEQUOTE FALSETK SINGLEQUOTE {
                 debugvf("Value bool false\n");
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, strdup("0"));
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_BOOLEAN);
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, strdup("0"));
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_BOOLEAN);
               }
             | SINGLEQUOTE NUMBER SINGLEQUOTE {
                 debugvf("Value int: %s\n", $2);
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, (void *)$2);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_INTEGER);
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, (void *)$2);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_INTEGER);
               }
             | SINGLEQUOTE NUMFLOAT SINGLEQUOTE {
                 debugvf("Value real: %s\n", $2);
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, (void *)$2);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_REAL);
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, (void *)$2);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_REAL);
               }
             | SINGLEQUOTE TSTAMP SINGLEQUOTE {
                 debugvf("Value tstamp: %s\n", $2);
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, (void *)$2);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_TIMESTAMP);
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, (void *)$2);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_TIMESTAMP);
               }
             | SINGLEQUOTE WORD SINGLEQUOTE {
                 debugvf("Value varchar: %s\n", $2);
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, (void *)$2);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_VARCHAR);
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, (void *)$2);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_VARCHAR);
               }
             | QUOTEDSTRING {
                 char *p = $1;
@@ -891,13 +1019,22 @@ val:          SINGLEQUOTE TRUETK SINGLEQUOTE {
                 debugvf("Value varchar: %s\n", $1);
                 i = strlen(p) - 1;	/* will point at \" || \n*/
                 p[i] = '\0';		/* overwrite it */
-                if (!colvals)
-                  colvals = ll_create();
-                (void)ll_add(colvals, (void *)strdup(p+1));
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, (void *)strdup(p+1));
                 free($1);
-                if (!coltypes)
-                  coltypes = ll_create();
-                (void)ll_add(coltypes, (void *)PRIMTYPE_VARCHAR);
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, (void *)PRIMTYPE_VARCHAR);
+              }
+            | PARAM {
+                debugvf("Value parameter\n");
+                if (!ps->colvals)
+                  ps->colvals = ll_create();
+                (void)ll_add(ps->colvals, strdup("?"));
+                if (!ps->coltypes)
+                  ps->coltypes = ll_create();
+                (void)ll_add(ps->coltypes, NULL);
               }
             | error {
                 debugvf("Wrong value.\n");
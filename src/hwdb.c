@@ -52,11 +52,17 @@
 #include "automaton.h"
 #include "topic.h"
 #include "node.h"
+#include "typetable.h"
+#include "wal.h"
+#include "checkpoint.h"
+#include "map.h"
+#include "adts/linkedlist.h"
 #include "logdefs.h"
 
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
+#include <strings.h>
 
 extern char *progname;
 extern void ap_init();
@@ -66,23 +72,38 @@ extern void ap_init();
  */
 static Indextable *itab;
 static int ifUsesRpc = 1;
+static LinkedList *recovered;	/* tables recovered at startup */
+static Map *amap;		/* archive of evicted tuples, NULL if none */
+static HashMap *prepared;	/* prepared inserts, by name */
+static pthread_rwlock_t prepared_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t create_lock = PTHREAD_MUTEX_INITIALIZER;
 #ifdef HWDB_PUBLISH_IN_BACKGROUND
 static TSUQueue *workQ;
 static TSUQueue *cleanQ;
 static pthread_t pubthr[NUM_THREADS];
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
 
-/* Used by sql parser */
-sqlstmt stmt;
+/*
+ * an insert prepared by hwdb_prepare: its table and the types of its
+ * columns are checked once, and each execution only supplies the values
+ * of the parameters
+ */
+typedef struct prepared {
+    Table *tn;
+    int ncols;
+    char **colval;	/* value of each column, NULL for a parameter */
+    short transform;
+} Prepared;
 
 /*
  * forward declarations for functions in this file
  */
-Rtab *hwdb_exec_stmt(int isreadonly);
+Rtab *hwdb_exec_stmt(sqlstmt *stmt, int isreadonly);
 Rtab *hwdb_select(sqlselect *select);
 Rtab *hwdb_table_meta(char *tablename);
 int hwdb_create(sqlcreate *create);
 tstamp_t hwdb_insert(sqlinsert *insert);
+static tstamp_t insert_row(Table *tn, sqlinsert *insert);
 Rtab *hwdb_showtables(void);
 int hwdb_register(sqlregister *regist);
 int hwdb_unregister(sqlunregister *unregist);
@@ -93,14 +114,97 @@ int hwdb_send_event(Automaton *au, char *buf, int ifdisconnect);
 void *do_publish(void *args);
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
 
+/*
+ * apply a record from the write-ahead log to the persistent tables
+ */
+static void replay(int type, int nfields, char **fields) {
+    Table *tn;
+    Node *n;
+
+    if (nfields < 2) {
+        errorf("short log record of type %c\n", type);
+        return;
+    }
+    if (type == WAL_CREATE) {
+        int i, idx, ncols = atoi(fields[1]);
+        char **names, *coldict = NULL;
+        int **types;
+        if (ncols > 0 && nfields == 4 + 2 * ncols) {	/* dictionaries */
+            char *flags = fields[3 + 2 * ncols];
+            if ((coldict = (char *)calloc(ncols, 1)))
+                for (i = 0; i < ncols && flags[i]; i++)
+                    coldict[i] = (flags[i] == '1');
+            nfields--;
+        }
+        if (ncols <= 0 || nfields != 3 + 2 * ncols) {
+            errorf("malformed log record for table %s\n", fields[0]);
+            free(coldict);
+            return;
+        }
+        names = (char **)malloc(ncols * sizeof(char *));
+        types = (int **)malloc(ncols * sizeof(int *));
+        for (i = 0; i < ncols; i++) {
+            names[i] = fields[3 + 2 * i];
+            if ((idx = typetable_index(fields[4 + 2 * i])) < 0)
+                break;
+            types[i] = &primtype_val[idx];
+        }
+        if (i == ncols &&
+                itab_create_table(itab, fields[0], ncols, names, types,
+                                  coldict, 1, atoi(fields[2]), 0, 0, 0))
+            (void)ll_add(recovered, itab_table_lookup(itab, fields[0]));
+        free(names);
+        free(types);
+        free(coldict);
+        return;
+    }
+    if (! (tn = itab_table_lookup(itab, fields[0])) || ! table_persistent(tn)) {
+        errorf("log record for unknown table %s\n", fields[0]);
+        return;
+    }
+    if (type == WAL_PUT && nfields == tn->ncols + 2) {
+        table_lock(tn);
+        n = table_lookup_key(tn, fields[2 + table_key(tn)]);
+        table_unlock(tn);
+        if (heap_insert_tuple(tn->ncols, fields + 2, tn, n)) {
+            table_lock(tn);	/* keep the row's original timestamp */
+            tn->newest->tstamp = strtoull(fields[1], NULL, 10);
+            table_unlock(tn);
+        }
+    } else if (type == WAL_DELETE) {
+        table_lock(tn);
+        if ((n = table_lookup_key(tn, fields[1])))
+            heap_remove_node(n, tn);
+        table_unlock(tn);
+    } else {
+        errorf("malformed log record for table %s\n", fields[0]);
+    }
+}
+
+/*
+ * note a table restored from a checkpoint
+ */
+static void restored(Table *tb) {
+    (void)ll_add(recovered, tb);
+}
+
 int hwdb_init(int usesRPC) {
+    unsigned long long walpos;
 
     progname = "cache";
     ifUsesRpc = usesRPC;
-    mb_init();
+    if (! mb_init())
+        return 0;
     itab = itab_new();
     top_init();			/* initialize the topic system */
     au_init();			/* initialize the automaton system */
+    recovered = ll_create();
+    prepared = hm_create(25L, 0.75);
+    amap = map_init();
+    if (! ckpt_load(itab, restored, &walpos))
+        return 0;
+    if (! wal_init(replay, walpos))
+        return 0;
 #ifdef HWDB_PUBLISH_IN_BACKGROUND
     int i;
     workQ = tsuq_create();
@@ -128,62 +232,74 @@ static void do_cleanup(void) {
 }
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
 
+/*
+ * parse and execute `query'; the statement is private to this call, so
+ * that queries may be executed on several threads at once
+ */
 Rtab *hwdb_exec_query(char *query, int isreadonly) {
-    void *result;
+    sqlstmt stmt;
 #ifdef HWDB_PUBLISH_IN_BACKGROUND
     do_cleanup();
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
-    result = sql_parse(query);
+    if (! sql_parse(query, &stmt)) {
+        reset_statement(&stmt);
+        return  rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    }
 #ifdef VDEBUG
-    sql_print();
+    sql_print(&stmt);
 #endif /* VDEBUG */
-    if (! result)
-        return  rtab_new_msg(RTAB_MSG_ERROR, NULL);
 
-    return hwdb_exec_stmt(isreadonly);
+    return hwdb_exec_stmt(&stmt, isreadonly);
+}
+
+/*
+ * return the results of an insert that yielded the timestamp `ts', 0 if
+ * it failed
+ */
+static Rtab *insert_results(tstamp_t ts) {
+    char buf[20];
+    char *s;
+
+    if (! ts)
+        return rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
+    s = timestamp_to_string(ts);
+    strcpy(buf, s);
+    free(s);
+    return rtab_new_msg(RTAB_MSG_SUCCESS, buf);
 }
 
-Rtab *hwdb_exec_stmt(int isreadonly) {
+Rtab *hwdb_exec_stmt(sqlstmt *stmt, int isreadonly) {
     Rtab *results = NULL;
 
-    switch (stmt.type) {
+    switch (stmt->type) {
     case SQL_TABLE_META:
-        results = hwdb_table_meta(stmt.sql.meta.table);
+        results = hwdb_table_meta(stmt->sql.meta.table);
         break;
     case SQL_TYPE_SELECT:
-        results = hwdb_select(&stmt.sql.select);
+        results = hwdb_select(&stmt->sql.select);
         if (!results)
             results = rtab_new_msg(RTAB_MSG_SELECT_FAILED, NULL);
         break;
     case SQL_TYPE_CREATE:
-        if (isreadonly || !hwdb_create(&stmt.sql.create)) {
+        if (isreadonly || !hwdb_create(&stmt->sql.create)) {
             results = rtab_new_msg(RTAB_MSG_CREATE_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
         }
         break;
-    case SQL_TYPE_INSERT: {
-        tstamp_t ts;
-        if (isreadonly || !(ts = hwdb_insert(&stmt.sql.insert))) {
-            results = rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
-        } else {
-            static char buf[20];
-            char *s = timestamp_to_string(ts);
-            strcpy(buf, s);
-            free(s);
-            results = rtab_new_msg(RTAB_MSG_SUCCESS, buf);
-        }
+    case SQL_TYPE_INSERT:
+        results = insert_results((isreadonly) ? (tstamp_t)0 :
+                                 hwdb_insert(&stmt->sql.insert));
         break;
-    }
     case SQL_TYPE_DELETE:
-        if (isreadonly || !hwdb_delete(&stmt.sql.delete)) {
+        if (isreadonly || !hwdb_delete(&stmt->sql.delete)) {
             results = rtab_new_msg(RTAB_MSG_DELETE_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
         }
         break;
     case SQL_TYPE_UPDATE:
-        if (isreadonly || !hwdb_update(&stmt.sql.update)) {
+        if (isreadonly || !hwdb_update(&stmt->sql.update)) {
             results = rtab_new_msg(RTAB_MSG_UPDATE_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
@@ -194,17 +310,17 @@ Rtab *hwdb_exec_stmt(int isreadonly) {
         break;
     case SQL_TYPE_REGISTER: {
         int v;
-        if (isreadonly || !(v = hwdb_register(&stmt.sql.regist))) {
+        if (isreadonly || !(v = hwdb_register(&stmt->sql.regist))) {
             results = rtab_new_msg(RTAB_MSG_REGISTER_FAILED, NULL);
         } else {
-            static char buf[20];
+            char buf[20];
             sprintf(buf, "%d", v);
             results = rtab_new_msg(RTAB_MSG_SUCCESS, buf);
         }
         break;
     }
     case SQL_TYPE_UNREGISTER:
-        if (isreadonly ||  !hwdb_unregister(&stmt.sql.unregist)) {
+        if (isreadonly ||  !hwdb_unregister(&stmt->sql.unregist)) {
             results = rtab_new_msg(RTAB_MSG_UNREGISTER_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
@@ -215,12 +331,13 @@ Rtab *hwdb_exec_stmt(int isreadonly) {
         results = rtab_new_msg(RTAB_MSG_PARSING_FAILED, NULL);
         break;
     }
-    reset_statement();
+    reset_statement(stmt);
     return results;
 }
 
 Rtab *hwdb_select(sqlselect *select) {
     Rtab *results;
+    Table *tn;
     char *tablename;
 
     debugf("HWDB: Executing SELECT:\n");
@@ -229,7 +346,7 @@ Rtab *hwdb_select(sqlselect *select) {
     tablename = select->tables[0];
 
     /* Check table exists */
-    if (!itab_table_exists(itab, tablename)) {
+    if (! (tn = itab_table_lookup(itab, tablename))) {
         errorf("HWDB: no such table\n");
         return NULL;
     }
@@ -241,55 +358,143 @@ Rtab *hwdb_select(sqlselect *select) {
     }
 
     /* Check column names match */
-    if (!itab_colnames_match(itab, tablename, select)) {
+    if (!itab_colnames_match(tn, select)) {
         errorf("HWDB: Column names in SELECT don't match with this table.\n");
         return NULL;
     }
 
-    results = itab_build_results(itab, tablename, select);
+    results = itab_build_results(tn, select);
 
     return results;
 }
 
 int hwdb_update(sqlupdate *update) {
+    Table *tn;
+    int ans;
+
     debugf("HWDB: Executing UPDATE:\n");
     /* Check table exists */
-    if (!itab_table_exists(itab, update->tablename)) {
+    if (! (tn = itab_table_lookup(itab, update->tablename))) {
         errorf("HWDB: %s no such table\n", update->tablename);
         return 0;
     }
 
-    if (itab_update_table(itab, update)) {
-        /* Note that no notification is generated for updates */
-        return 1;
-    }
-    return 0;
+    /*
+     * the rows updated before one that could not be are logged, so the
+     * log is committed either way; no notification is generated
+     */
+    ans = itab_update_table(tn, update);
+    if (! wal_commit())
+        return 0;
+    return ans;
 }
 
 int hwdb_delete(sqldelete *delete) {
+    Table *tn;
+
     debugf("HWDB: Executing DELETE:\n");
     /* Check table exists */
-    if (!itab_table_exists(itab, delete->tablename)) {
+    if (! (tn = itab_table_lookup(itab, delete->tablename))) {
         errorf("HWDB: %s no such table\n", delete->tablename);
         return 0;
     }
-    if (itab_delete_rows(itab, delete)) {
+    if (itab_delete_rows(tn, delete))
+        return wal_commit();
+    return 0;
+}
+
+/*
+ * returns true if `create' declares a table that was recovered from a
+ * checkpoint or the log, of the same kind and with the same column types;
+ * a table is only matched once
+ */
+static int was_recovered(sqlcreate *create) {
+    Table *tn, *t;
+    long i;
+
+    if (! (tn = itab_table_lookup(itab, create->tablename)))
+        return 0;
+    for (i = 0; ll_get(recovered, i, (void **)&t); i++)
+        if (t == tn) {
+            (void)ll_remove(recovered, i, (void **)&t);
+            return (tn->tabletype == create->tabletype &&
+                    itab_is_compatible(tn, create->ncols, create->coltype));
+        }
+    return 0;
+}
+
+/*
+ * archive the tuples evicted from table `tn' in `t'
+ */
+static void attach_archive(Table *tn, T *t) {
+    mb_lock(tn);
+    tn->archive = t;
+    mb_unlock(tn);
+}
+
+static int create_table(sqlcreate *create) {
+    Table *tn;
+    T *t = NULL;
+
+
+    if (create->archive) {
+        if (create->tabletype || ! amap) {
+            errorf("Only stream tables can be archived, and only with -a\n");
+            return 0;
+        }
+        if (create->compress) {
+            errorf("Compressed tables cannot be archived\n");
+            return 0;
+        }
+        if (! (t = map_create_table(amap, create->tablename, create->ncols,
+                                    create->colname, create->coltype)))
+            return 0;
+    }
+    if (create->ttl && create->tabletype) {
+        errorf("Only stream tables can have a ttl\n");
+        return 0;
+    }
+    if (was_recovered(create)) {
+        if (t)
+            attach_archive(itab_table_lookup(itab, create->tablename), t);
         return 1;
     }
-    return 0;
+    if (! itab_create_table(itab, create->tablename, create->ncols,
+                            create->colname, create->coltype,
+                            create->coldict, create->tabletype,
+                            create->primary_column, create->quota,
+                            create->rows, create->compress))
+        return 0;
+    tn = itab_table_lookup(itab, create->tablename);
+    if (t)
+        attach_archive(tn, t);
+    if (create->ttl && ! mb_ttl(tn, (tstamp_t)create->ttl * 1000000ULL))
+        return 0;
+    if (create->tabletype) {
+        wal_create(tn);
+        return wal_commit();
+    }
+    return 1;
 }
 
-int  hwdb_create(sqlcreate *create) {
-    debugf("Executing CREATE:\n");
+/*
+ * creates are serialized so that two of them cannot both claim a
+ * recovered table or both archive the same name
+ */
+int hwdb_create(sqlcreate *create) {
+    int ok;
 
-    return itab_create_table(itab, create->tablename, create->ncols,
-                             create->colname, create->coltype,
-                             create->tabletype, create->primary_column);
+    debugf("Executing CREATE:\n");
+    pthread_mutex_lock(&create_lock);
+    ok = create_table(create);
+    pthread_mutex_unlock(&create_lock);
+    return ok;
 }
 
-static void gen_tuple_string(Table *t, int ncols, char **colvals, char *out) {
+static void gen_tuple_string(tstamp_t tstamp, int ncols, char **colvals,
+                             char *out) {
     char *p = out;
-    char *ts = timestamp_to_string(t->newest->tstamp);
+    char *ts = timestamp_to_string(tstamp);
     int i;
     p += sprintf(p, "%s<|>", ts);
     free(ts);
@@ -337,9 +542,6 @@ Rtab *hwdb_table_meta(char *tablename) {
 
 tstamp_t  hwdb_insert(sqlinsert *insert) {
     Table *tn;
-    char buf[2048];
-    Node *n;
-    tstamp_t ts;
 
     debugf("Executing INSERT:\n");
 
@@ -349,15 +551,25 @@ tstamp_t  hwdb_insert(sqlinsert *insert) {
     }
 
     /* Check columns are compatible */
-    if (!itab_is_compatible(itab, insert->tablename,
-                            insert->ncols, insert->coltype)) {
+    if (!itab_is_compatible(tn, insert->ncols, insert->coltype)) {
         errorf("Insert not compatible with table\n");
         return (tstamp_t)0;
     }
 
+    return insert_row(tn, insert);
+}
+
+/*
+ * insert the values of `insert' into `tn', whose columns they are known
+ * to match
+ */
+static tstamp_t insert_row(Table *tn, sqlinsert *insert) {
+    char buf[2048];
+    Node *n;
+    tstamp_t ts;
+
     /* Check values don't violate primary key constraint */
-    if ((n = itab_is_constrained(itab, insert->tablename,
-                                 insert->colval))) {
+    if ((n = itab_is_constrained(tn, insert->colval))) {
         debugf("Transformation %d\n", insert->transform);
         if (! insert->transform) {
             errorf("Insert violates primary key\n");
@@ -369,21 +581,25 @@ tstamp_t  hwdb_insert(sqlinsert *insert) {
      * node to end of table */
     if ( table_persistent(tn) ) {
         ts = heap_insert_tuple(insert->ncols, insert->colval, tn, n);
+        if (ts && ! wal_commit()) {
+            errorf("Insert could not be logged\n");
+            return (tstamp_t)0;
+        }
     } else {
         ts = mb_insert_tuple(insert->ncols, insert->colval, tn);
     }
-    gen_tuple_string(tn, insert->ncols, insert->colval, buf);
+    gen_tuple_string(ts, insert->ncols, insert->colval, buf);
     top_publish(insert->tablename, buf);
     /* Tuple sanity check */
 #ifdef DEBUG
 #ifdef VDEBUG
     {
         int i;
-        union Tuple *p;
+        unsigned char *p;
         debugvf("SANITY> tuple key: %s\n",insert->tablename);
-        p = (union Tuple *)(tn->newest->tuple);
-        for (i=0; i < insert->ncols; i++) {
-            debugvf("SANITY> colval[%d] = %s\n", i, p->ptrs[i]);
+        p = (tn->chunks) ? NULL : tn->newest->tuple;
+        for (i=0; p && i < insert->ncols; i++) {
+            debugvf("SANITY> colval[%d] = %s\n", i, tuple_column(tn, p, i));
         }
     }
 #endif /* VDEBUG */
@@ -395,6 +611,211 @@ tstamp_t  hwdb_insert(sqlinsert *insert) {
     return ts;
 }
 
+/*
+ * prepare an insert; `command' is `name AS insert into ... values (...)',
+ * where a `?' in the values stands for a parameter supplied by each
+ * hwdb_execute; a statement prepared earlier under the same name is
+ * replaced
+ *
+ * returns 1 if successful, 0 if not
+ */
+int hwdb_prepare(char *command) {
+    sqlstmt stmt;
+    sqlinsert *insert = &stmt.sql.insert;
+    char *name, *query;
+    Prepared *p, *old;
+    Table *tn;
+    int **coltype;
+    int i, ok;
+
+    name = command + strspn(command, " \t");
+    query = name + strcspn(name, " \t");
+    if (*query != '\0')
+        *query++ = '\0';
+    query += strspn(query, " \t");
+    if (*name == '\0' || strncasecmp(query, "as", 2) != 0 ||
+            (query[2] != ' ' && query[2] != '\t')) {
+        errorf("PREPARE expects a name, AS and an insert statement\n");
+        return 0;
+    }
+    debugf("Executing PREPARE %s:\n", name);
+    if (! sql_parse(query + 3, &stmt)) {
+        reset_statement(&stmt);
+        return 0;
+    }
+    if (stmt.type != SQL_TYPE_INSERT) {
+        errorf("Only inserts can be prepared\n");
+        reset_statement(&stmt);
+        return 0;
+    }
+    if (! (tn = itab_table_lookup(itab, insert->tablename))) {
+        errorf("Insert table name does not exist\n");
+        reset_statement(&stmt);
+        return 0;
+    }
+
+    /* a parameter takes the type of its column */
+    coltype = (int **)malloc(insert->ncols * sizeof(int *));
+    for (i = 0; coltype && i < insert->ncols; i++)
+        coltype[i] = (insert->coltype[i] || i >= tn->ncols) ?
+                     insert->coltype[i] : tn->coltype[i];
+    ok = (coltype && itab_is_compatible(tn, insert->ncols, coltype));
+    free(coltype);
+    if (! ok) {
+        errorf("Insert not compatible with table\n");
+        reset_statement(&stmt);
+        return 0;
+    }
+
+    p = (Prepared *)malloc(sizeof(Prepared));
+    p->tn = tn;
+    p->ncols = insert->ncols;
+    p->colval = (char **)malloc(insert->ncols * sizeof(char *));
+    p->transform = insert->transform;
+    for (i = 0; i < insert->ncols; i++)
+        p->colval[i] = (insert->coltype[i]) ? strdup(insert->colval[i]) : NULL;
+    reset_statement(&stmt);
+    pthread_rwlock_wrlock(&prepared_lock);
+    if (! hm_put(prepared, name, p, (void **)&old))
+        old = NULL;
+    if (old) {
+        for (i = 0; i < old->ncols; i++)
+            free(old->colval[i]);
+        free(old->colval);
+        free(old);
+    }
+    pthread_rwlock_unlock(&prepared_lock);
+    return 1;
+}
+
+/*
+ * split the next comma-separated value off `*args', removing its quotes;
+ * returns NULL if there is none
+ */
+static char *next_value(char **args) {
+    char *v = *args + strspn(*args, " \t"), *end, *e;
+
+    if (*v == '\'' || *v == '"') {
+        if (! (end = strchr(v + 1, *v)))
+            return NULL;
+        v++;
+        e = end + 1;
+    } else if ((end = e = v + strcspn(v, ", \t")) == v)
+        return NULL;
+    e += strspn(e, " \t");
+    if (*e == ',')
+        e++;
+    else if (*e != '\0')
+        return NULL;
+    *end = '\0';
+    *args = e;
+    return v;
+}
+
+/*
+ * check that `v' is a value for a column of type `type', returning it as
+ * it is to be stored - true and false become "1" and "0", as in the SQL
+ * parser - or NULL if it is not
+ */
+static char *column_value(int *type, char *v) {
+    char *e;
+
+    if (type == PRIMTYPE_BOOLEAN) {
+        if (strcasecmp(v, "true") == 0)
+            return "1";
+        if (strcasecmp(v, "false") == 0)
+            return "0";
+        type = PRIMTYPE_INTEGER;
+    }
+    if (type == PRIMTYPE_INTEGER || type == PRIMTYPE_TINYINT ||
+            type == PRIMTYPE_SMALLINT) {
+        (void)strtoll(v, &e, 10);
+        return (e != v && *e == '\0') ? v : NULL;
+    }
+    if (type == PRIMTYPE_REAL) {
+        (void)strtod(v, &e);
+        return (e != v && *e == '\0') ? v : NULL;
+    }
+    if (type == PRIMTYPE_TIMESTAMP)
+        return (strlen(v) == 18 && v[0] == '@' && v[17] == '@' &&
+                strspn(v + 1, "0123456789abcdefABCDEF") == 16) ? v : NULL;
+    return v;
+}
+
+/*
+ * insert a row of `p' with the parameter values in `args'
+ */
+static tstamp_t execute(Prepared *p, char *args) {
+    char *colval[p->ncols], *v;
+    sqlinsert insert;
+    int i;
+
+    for (i = 0; i < p->ncols; i++)
+        if (! (colval[i] = p->colval[i]) &&
+                (! (v = next_value(&args)) ||
+                 ! (colval[i] = column_value(p->tn->coltype[i], v)))) {
+            errorf("Wrong or missing value for column %d\n", i);
+            return (tstamp_t)0;
+        }
+    if (*args != '\0') {
+        errorf("Too many values\n");
+        return (tstamp_t)0;
+    }
+    insert.tablename = p->tn->name;
+    insert.ncols = p->ncols;
+    insert.colval = colval;
+    insert.coltype = p->tn->coltype;
+    insert.transform = p->transform;
+    return insert_row(p->tn, &insert);
+}
+
+/*
+ * execute a prepared insert without parsing it; `command' is
+ * `name (value, ...)', with a value, quoted as in SQL or not, for each
+ * parameter; `command' is overwritten
+ */
+Rtab *hwdb_execute(char *command, int isreadonly) {
+    char *name, *args, *end;
+    Prepared *p;
+    tstamp_t ts;
+
+#ifdef HWDB_PUBLISH_IN_BACKGROUND
+    do_cleanup();
+#endif /* HWDB_PUBLISH_IN_BACKGROUND */
+    name = command + strspn(command, " \t");
+    args = name + strcspn(name, " \t(");
+    args += strspn(args, " \t");
+    end = strrchr(args, ')');
+    if (*args != '(' || ! end || end[1 + strspn(end + 1, " \t")] != '\0') {
+        errorf("EXECUTE expects a name and a list of values\n");
+        return rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
+    }
+    name[strcspn(name, " \t(")] = '\0';
+    *args++ = '\0';
+    *end = '\0';
+    /* held until the insert is done, so that a PREPARE cannot free `p' */
+    pthread_rwlock_rdlock(&prepared_lock);
+    if (! hm_get(prepared, name, (void **)&p)) {
+        pthread_rwlock_unlock(&prepared_lock);
+        errorf("No prepared insert called %s\n", name);
+        return rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
+    }
+    ts = (isreadonly) ? (tstamp_t)0 : execute(p, args);
+    pthread_rwlock_unlock(&prepared_lock);
+    return insert_results(ts);
+}
+
+/*
+ * write every table to the checkpoint `file'; returns the number of rows
+ * written, or -1 if the checkpoint could not be written
+ */
+long hwdb_checkpoint(char *file) {
+    long nrows;
+
+    debugf("Executing CHECKPOINT %s:\n", file);
+    return ckpt_write(itab, file, &nrows) ? nrows : -1L;
+}
+
 Rtab *hwdb_showtables(void) {
     debugf("Executing SHOW TABLES\n");
     return itab_showtables(itab);
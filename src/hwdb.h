@@ -57,5 +57,8 @@ int hwdb_send_event(Automaton *au, char *buf, int ifdisconnect);
 Table *hwdb_table_lookup(char *name);
 void hwdb_queue_cleanup(CallBackInfo *info);
 tstamp_t hwdb_insert(sqlinsert *insert);
+int hwdb_prepare(char *command);
+Rtab *hwdb_execute(char *command, int isreadonly);
+long hwdb_checkpoint(char *file);
 
 #endif /* _HWDB_H_ */
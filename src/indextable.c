@@ -29,36 +29,122 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * indextable.c - the tables of the database, by name
+ *
+ * the tables are found through a catalog, an open-addressed hash table
+ * that is never changed once it has been published: creating a table
+ * copies the catalog, adds the table to the copy and publishes it with an
+ * atomic store, so that lookups take no lock.  creators are serialized by
+ * the masterlock.  a superseded catalog is kept, since a reader may still
+ * be using it; tables are created rarely and never dropped
+ */
+
 #include "indextable.h"
 
 #include "tuple.h"
-#include "adts/hashmap.h"
 #include "table.h"
 #include "sqlstmts.h"
 #include "util.h"
 #include "nodecrawler.h"
+#include "filecrawler.h"
+#include "chunk.h"
 #include "typetable.h"
 #include "rtab.h"
 #include "srpc/srpc.h"
 #include "pubsub.h"
 #include "topic.h"
 #include "ptable.h"
+#include "mb.h"
 
 #include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 
+#define CATALOG_SIZE 64	/* initial number of slots in a catalog */
+
+typedef struct centry {
+    char *name;			/* name of the table, NULL if slot unused */
+    Table *tn;
+} CEntry;
+
+typedef struct catalog {
+    long size;			/* number of slots, a power of 2 */
+    long count;			/* number of tables */
+    struct catalog *old;	/* catalog superseded by this one */
+    CEntry slots[];
+} Catalog;
+
 struct indextable {
-    HashMap *ht;
-    pthread_mutex_t *masterlock;
+    Catalog *cat;		/* current catalog, read without locks */
+    pthread_mutex_t *masterlock;	/* serializes changes to the catalog */
 };
 
+static unsigned long hash(char *s) {
+    unsigned long h = 5381;
+
+    while (*s)
+        h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+static Catalog *catalog_new(long size) {
+    Catalog *c = (Catalog *)calloc(1, sizeof(Catalog) + size * sizeof(CEntry));
+
+    if (c)
+        c->size = size;
+    return c;
+}
+
+static CEntry *catalog_slot(Catalog *c, char *name) {
+    long i;
+
+    for (i = hash(name) & (c->size - 1); c->slots[i].name;
+         i = (i + 1) & (c->size - 1))
+        if (strcmp(c->slots[i].name, name) == 0)
+            break;
+    return &(c->slots[i]);
+}
+
+/*
+ * return the catalog of `itab' as last published
+ */
+static Catalog *catalog_of(Indextable *itab) {
+    return __atomic_load_n(&(itab->cat), __ATOMIC_ACQUIRE);
+}
+
+/*
+ * publish a copy of the catalog of `itab' to which `tn' has been added;
+ * called with the masterlock held
+ *
+ * return 1 if successful, 0 if not
+ */
+static int catalog_add(Indextable *itab, Table *tn) {
+    Catalog *old = itab->cat, *c;
+    long i, size = old->size;
+    CEntry *e;
+
+    if (2 * (old->count + 1) > size)	/* keep it at most half full */
+        size *= 2;
+    if (! (c = catalog_new(size)))
+        return 0;
+    for (i = 0; i < old->size; i++)
+        if (old->slots[i].name)
+            *catalog_slot(c, old->slots[i].name) = old->slots[i];
+    e = catalog_slot(c, tn->name);
+    e->name = tn->name;
+    e->tn = tn;
+    c->count = old->count + 1;
+    c->old = old;
+    __atomic_store_n(&(itab->cat), c, __ATOMIC_RELEASE);
+    return 1;
+}
 
 Indextable *itab_new(void) {
     Indextable *itab;
 
     itab = malloc(sizeof(Indextable));
-    itab->ht = hm_create(TT_BUCKETS, 0.75);
+    itab->cat = catalog_new(CATALOG_SIZE);
 
     /* Init recursive lock */
     itab->masterlock = malloc(sizeof(pthread_mutex_t));
@@ -79,9 +165,12 @@ static int create_topic(char *tn, int nc, char **cnames, int **ctypes) {
 }
 
 int itab_create_table(Indextable *itab, char *tablename, int ncols,
-                      char **colnames, int **coltypes, short tabletype, short primary_column) {
+                      char **colnames, int **coltypes, char *coldict,
+                      short tabletype, short primary_column,
+                      long long quota, long long rows, short compress) {
 
     Table *tn;
+    int i;
 
     if (tabletype && primary_column == -1) {
         errorf("create persistenttable without a primary key.\n");
@@ -93,21 +182,57 @@ int itab_create_table(Indextable *itab, char *tablename, int ncols,
         return 0;
     }
 
+    if (tabletype && (quota || rows)) {
+        errorf("quotas only apply to stream tables.\n");
+        return 0;
+    }
+
+    if (quota < 0 || rows < 0) {
+        errorf("quotas must not be negative.\n");
+        return 0;
+    }
+
+    if (compress && (tabletype || rows)) {
+        errorf("only stream tables without a row quota can be compressed.\n");
+        return 0;
+    }
+
+    for (i = 0; compress && coldict && i < ncols; i++)
+        if (coldict[i]) {
+            errorf("compressed tables cannot have dictionary columns.\n");
+            return 0;
+        }
+
     itab_lock(itab);
 
     debugvf("Itab: creating table\n");
 
-    if (! hm_get(itab->ht, tablename, (void **)&tn)) {
-        void *dummyVal;
-
+    if (! catalog_slot(itab->cat, tablename)->name) {
         debugf("Adding new table to master table\n");
 
         /* Create new table node */
         tn = table_new(ncols, colnames, coltypes);
         table_tabletype(tn, tabletype, primary_column);
+        if (! table_dictionaries(tn, coldict)) {
+            itab_unlock(itab);
+            return 0;
+        }
+        if ((quota || rows) && ! mb_region_create(tn, tablename, quota, rows)) {
+            itab_unlock(itab);
+            return 0;
+        }
+        if (compress && ! (tn->chunks = chunk_new())) {
+            itab_unlock(itab);
+            return 0;
+        }
 
-        /* Add into hashtable */
-        (void)hm_put(itab->ht, strdup(tablename), tn, &dummyVal);
+        /* Add into catalog */
+        tn->name = strdup(tablename);
+        if (! catalog_add(itab, tn)) {
+            errorf("unable to add %s to the catalog\n", tablename);
+            itab_unlock(itab);
+            return 0;
+        }
         (void)create_topic(tablename, ncols, colnames, coltypes);
         if (tabletype)
             (void)ptab_create(tablename);
@@ -123,18 +248,11 @@ int itab_create_table(Indextable *itab, char *tablename, int ncols,
     return 1;
 }
 
-int itab_update_table(Indextable *itab, sqlupdate *update) {
-    Table *tn;
+int itab_update_table(Table *tn, sqlupdate *update) {
     Nodecrawler *nc;
-    int stat;
+    Predicate *p;
+    int ans;
     debugvf("Itab: updating table\n");
-    itab_lock(itab);
-    stat = hm_get(itab->ht, update->tablename, (void **)&tn);
-    itab_unlock(itab);
-    if (! stat) {
-        errorf("Table does not exist. Doing nothing.\n");
-        return 0;
-    }
     /* Lock table */
     table_lock(tn);
     if (! table_persistent(tn)) {
@@ -145,37 +263,25 @@ int itab_update_table(Indextable *itab, sqlupdate *update) {
 
     nc = nodecrawler_new(tn->oldest, tn->newest);
 
-    nodecrawler_apply_filter(nc, tn,
-                             update->nfilters, update->filters, update->filtertype);
+    p = (update->where) ? predicate_new_expr(tn, update->where) :
+        predicate_new(tn, update->nfilters, update->filters, update->filtertype);
+    nodecrawler_apply_filter(nc, p);
+    predicate_free(p);
 
-    nodecrawler_update_cols(nc, tn, update);
+    ans = nodecrawler_update_cols(nc, tn, update);
 
-    /* Reset dropped markers */
-    nodecrawler_reset_all_dropped(nc);
-    nodecrawler_free(nc);
-
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    nodecrawler_reset_all_dropped(nc);
     nodecrawler_free(nc);
 
     /* Unlock table */
     table_unlock(tn);
 
-    return 1;
+    return ans;
 }
 
-int itab_delete_rows(Indextable *itab, sqldelete *delete) {
-    Table *tn;
+int itab_delete_rows(Table *tn, sqldelete *delete) {
     Nodecrawler *nc;
-    int stat;
+    Predicate *p;
     debugvf("Itab: deleting rows from table\n");
-    itab_lock(itab);
-    stat = hm_get(itab->ht, delete->tablename, (void **)&tn);
-    itab_unlock(itab);
-    if (! stat) {
-        errorf("Table does not exist. Doing nothing.\n");
-        return 0;
-    }
     if (! table_persistent(tn)) {
         errorf("Only persistent tables support delete.\n");
         return 0;
@@ -185,16 +291,12 @@ int itab_delete_rows(Indextable *itab, sqldelete *delete) {
     table_lock(tn);
     nc = nodecrawler_new(tn->oldest, tn->newest);
 
-    nodecrawler_apply_filter(nc, tn, delete->nfilters, delete->filters,
-                             delete->filtertype);
+    p = (delete->where) ? predicate_new_expr(tn, delete->where) :
+        predicate_new(tn, delete->nfilters, delete->filters, delete->filtertype);
+    nodecrawler_apply_filter(nc, p);
+    predicate_free(p);
     nodecrawler_delete_rows(nc, tn, delete);
 
-    /* Reset dropped markers */
-    nodecrawler_reset_all_dropped(nc);
-    nodecrawler_free(nc);
-
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    nodecrawler_reset_all_dropped(nc);
     nodecrawler_free(nc);
 
     /* Unlock table */
@@ -204,19 +306,8 @@ int itab_delete_rows(Indextable *itab, sqldelete *delete) {
 }
 
 
-int itab_is_compatible(Indextable *itab, char *tablename, int ncols, int **coltypes) {
-    Table *tn;
-    int i, stat;
-
-    itab_lock(itab);
-    stat = hm_get(itab->ht, tablename, (void **)&tn);
-    itab_unlock(itab);
-
-    /* Check table exists */
-    if (! stat) {
-        errorf("Insert: No such table: %s\n", tablename);
-        return 0;
-    }
+int itab_is_compatible(Table *tn, int ncols, int **coltypes) {
+    int i;
 
     /* Check number of columns */
     table_lock(tn);
@@ -245,31 +336,18 @@ int itab_is_compatible(Indextable *itab, char *tablename, int ncols, int **colty
  * This function should be called after itab_is_compatible, which
  * performs the necessary checks.
  */
-Node *itab_is_constrained(Indextable *itab, char *tablename, char **colvals) {
+Node *itab_is_constrained(Table *tn, char **colvals) {
 
-    Table *tn;
-
-    Nodecrawler *nc;
     int key;
     Node *found = NULL;
 
-    itab_lock(itab);
-    (void)hm_get(itab->ht, tablename, (void **)&tn);
-    itab_unlock(itab);
-
     table_lock(tn);
     if (table_persistent(tn)) {
 
         key = table_key(tn);
-        /* If the key is the timestamp, ignore under the assumption
-         * that all timestamps are unique. In any case, the new re-
-         * cord has not been assigned a timestamp yet.
-         */
         debugvf("Value at key index is %s\n", colvals[key]);
 
-        nc = nodecrawler_new(tn->oldest, tn->newest);
-        found = nodecrawler_find_value(nc, key, colvals[key]);
-        nodecrawler_free(nc);
+        found = table_lookup_key(tn, colvals[key]);
 
         if (found) {
             /*errorf("Key %s already exists in %s\n", colvals[key],
@@ -279,18 +357,16 @@ Node *itab_is_constrained(Indextable *itab, char *tablename, char **colvals) {
         }
     }
     table_unlock(tn);
-    debugvf("Table %s is not persistent\n", tablename);
+    debugvf("Table %s is not persistent\n", tn->name);
     return NULL;
 }
 
+/*
+ * return the table called `tablename', or NULL if there is none; takes
+ * no lock
+ */
 Table *itab_table_lookup(Indextable *itab, char *tablename) {
-    Table *ans;
-    int stat;
-
-    itab_lock(itab);
-    stat = hm_get(itab->ht, tablename, (void **)&ans);
-    itab_unlock(itab);
-    return (stat) ? ans : NULL;
+    return catalog_slot(catalog_of(itab), tablename)->tn;
 }
 
 int itab_table_exists(Indextable *itab, char *tablename) {
@@ -299,19 +375,7 @@ int itab_table_exists(Indextable *itab, char *tablename) {
 
 }
 
-int itab_colnames_match(Indextable *itab, char *tablename, sqlselect *select) {
-    Table *tn;
-    int stat;
-
-    itab_lock(itab);
-    stat = hm_get(itab->ht, tablename, (void **)&tn);
-    itab_unlock(itab);
-
-    /* Check table exists */
-    if (! stat) {
-        errorf("itab: No such table: %s\n", tablename);
-        return 0;
-    }
+int itab_colnames_match(Table *tn, sqlselect *select) {
 
     table_lock(tn);
     if (!table_colnames_match(tn, select)) {
@@ -324,24 +388,52 @@ int itab_colnames_match(Indextable *itab, char *tablename, sqlselect *select) {
     return 1;
 }
 
-Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select) {
-    Table *tn;
+/*
+ * filter and project the window of stream table `tn' captured by `nc',
+ * MB_SNAPSHOT_STEP nodes at a time, moving snapshot `snap' on after each
+ * step so that writers in the region are not held up for the whole select
+ */
+static void project_stream(Nodecrawler *nc, Table *tn, Predicate *p,
+                           Snapshot *snap, Rtab *results) {
+    Nodecrawler *step;
+    Node *first = nc->first, *last;
+    long i;
+
+    for (;;) {
+        for (i = 1, last = first; i < MB_SNAPSHOT_STEP && last != nc->last;
+             i++)
+            last = last->next;
+        step = nodecrawler_new(first, last);
+        step->table = tn;
+        nodecrawler_apply_filter(step, p);
+        nodecrawler_project_cols(step, tn, results);
+        nodecrawler_free(step);
+        if (last == nc->last)
+            break;
+        first = last->next;
+        mb_snapshot_advance(tn, snap, first->tstamp);
+    }
+}
+
+Rtab *itab_build_results(Table *tn, sqlselect *select) {
     Rtab *results;
     Nodecrawler *nc;
-    int stat;
-
-    itab_lock(itab);
-    stat = hm_get(itab->ht, tablename, (void **)&tn);
-    itab_unlock(itab);
-
-    /* Check table exists */
-    if (! stat) {
-        errorf("itab: No such table: %s\n", tablename);
-        return NULL;
-    }
+    Filecrawler *fc = NULL;
+    ChunkWindow *cw;
+    Predicate *p;
+    Snapshot snap;
+    int snapped = 0, ok = 1;
 
     /* Lock table */
-    table_lock(tn);
+    mb_lock(tn);
+
+    /*
+     * the WHERE clause is compiled once for every part of the table, with
+     * the table locked so that its rows can be sampled
+     */
+    p = (select->where) ? predicate_new_expr(tn, select->where) :
+        predicate_new(tn, select->nfilters, select->filters,
+                      select->filtertype);
 
     /* Build results */
     results = rtab_new();
@@ -353,17 +445,70 @@ Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select) {
      *   -- apply_filter
      *   -- project columns
      *
-     * Note that the basic idea here is to manipulate a list
-     * of tuples, running over it and dropping tuples that
-     * don't pass the window or filter rules.
+     * Note that the basic idea here is to run over a list
+     * of tuples, narrowing it to the window and selecting the
+     * tuples that pass the filter rules.
      *
-     * The tuples that remain in the list are all ok and then
+     * The selected tuples are all ok and then
      * the columns are projected from these tuples.
+     *
+     * For a stream table, the window is captured in a snapshot and the
+     * table is unlocked, so that inserts carry on while the window is
+     * filtered and projected a step at a time; persistent tables stay
+     * locked, since their nodes are updated in place.
+     *
+     * Tuples of an archived table that had been evicted by now are read
+     * from the archive once the in-memory part is done.
+     *
+     * The rows of a compressed table are decoded chunk by chunk.
      */
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    nodecrawler_apply_window(nc, select->windows[0]); /* NB only one window */
-    nodecrawler_apply_filter(nc, tn, select->nfilters, select->filters, select->filtertype);
-    nodecrawler_project_cols(nc, tn, results);
+    if (tn->chunks) {
+        cw = chunk_window(tn, select->windows[0]);
+        mb_unlock(tn);
+        if (cw)
+            chunk_project(tn, cw, p, results);
+        else
+            ok = 0;
+        goto done;
+    }
+    if (tn->archive) {
+        fc = filecrawler_new(tn->archive, t_position(tn->archive));
+        filecrawler_window(fc, select->windows[0], tn->count);
+        filecrawler_filter(fc, p);
+    }
+    nc = nodecrawler_new_from_window(tn, select->windows[0]); /* NB only one window */
+    if (! table_persistent(tn)) {
+        if (! nc->empty) {
+            mb_snapshot_take(tn, &snap, nc->first->tstamp);
+            snapped = 1;
+        }
+        mb_unlock(tn);
+    }
+    if (snapped)
+        project_stream(nc, tn, p, &snap, results);
+    else {
+        nodecrawler_apply_filter(nc, p);
+        nodecrawler_project_cols(nc, tn, results);
+    }
+    nodecrawler_free(nc);
+
+    /* Release snapshot, or unlock table */
+    if (table_persistent(tn))
+        mb_unlock(tn);
+    else if (snapped)
+        mb_snapshot_release(tn, &snap);
+
+    if (fc) {
+        ok = filecrawler_project(fc, tn, results);
+        filecrawler_free(fc);
+    }
+
+done:
+    predicate_free(p);
+    if (! ok) {
+        rtab_free(results);
+        return NULL;
+    }
 
     /* group by */
     if (select->groupby_ncols > 0) {
@@ -382,57 +527,57 @@ Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select) {
     /* order by */
     rtab_orderby(results, select->orderby);
 
-    /* Reset dropped markers */
-    nodecrawler_reset_all_dropped(nc);
-
-    nodecrawler_free(nc);
-
-
-    /* Unlock table */
-    table_unlock(tn);
-
     return results;
 }
 
 Rtab *itab_showtables(Indextable *itab) {
     Rtab *results;
+    Catalog *c = catalog_of(itab);
     LinkedList *rowlist;
-    char **tnames;
     Rrow *r;
-    int j;
-    long N;
+    long j;
     long dummyLong;
 
-    itab_lock(itab);
-
-    tnames = hm_keyArray(itab->ht, &N);
-    if (! tnames) {
-        results = rtab_new_msg(RTAB_MSG_NO_TABLES_DEFINED, NULL);
-        itab_unlock(itab);
-        return results;
-    }
+    if (! c->count)
+        return rtab_new_msg(RTAB_MSG_NO_TABLES_DEFINED, NULL);
     results = rtab_new();
     results->ncols = 1;
-    results->nrows = N;
+    results->nrows = c->count;
     results->colnames = (char **)malloc(sizeof(char *));
     results->colnames[0] = strdup("Tablename");
     results->coltypes = (int **)malloc(sizeof(int *));
     results->coltypes[0] = PRIMTYPE_VARCHAR;
     rowlist = ll_create();
-    for (j = 0; j < results->nrows; j++) {
+    for (j = 0; j < c->size; j++) {
+        if (! c->slots[j].name)
+            continue;
         r = malloc(sizeof(Rrow));
         r->cols = malloc(sizeof(char *));
-        r->cols[0] = strdup(tnames[j]);
+        r->cols[0] = strdup(c->slots[j].name);
         (void)ll_add(rowlist, r);
     }
     results->rows = (Rrow **)ll_toArray(rowlist, &dummyLong);
     ll_destroy(rowlist, NULL);
-    free(tnames);
-    itab_unlock(itab);
 
     return results;
 }
 
+/*
+ * return a malloc'ed array of the `*n' tables in `itab'
+ */
+Table **itab_tables(Indextable *itab, long *n) {
+    Catalog *c = catalog_of(itab);
+    Table **tables;
+    long i;
+
+    *n = 0;
+    tables = (Table **)malloc((c->count + 1) * sizeof(Table *));
+    for (i = 0; tables && i < c->size; i++)
+        if (c->slots[i].name)
+            tables[(*n)++] = c->slots[i].tn;
+    return tables;
+}
+
 void itab_lock(Indextable *itab) {
     debugf("Itab: Acquiring masterlock...\n");
     pthread_mutex_lock(itab->masterlock);
@@ -445,15 +590,10 @@ void itab_unlock(Indextable *itab) {
 
 void itab_lock_table(Indextable *itab, char *tablename) {
     Table *tn;
-    int stat;
 
     debugf("Itab locking table: %s\n", tablename);
 
-    itab_lock(itab);
-    stat = hm_get(itab->ht, tablename, (void *)&tn);
-    itab_unlock(itab);
-
-    if (! stat) {
+    if (! (tn = itab_table_lookup(itab, tablename))) {
         errorf("itab: No such table: %s\n", tablename);
         return;
     }
@@ -463,15 +603,10 @@ void itab_lock_table(Indextable *itab, char *tablename) {
 
 void itab_unlock_table(Indextable *itab, char *tablename) {
     Table *tn;
-    int stat;
 
     debugf("Itab unlocking table: %s\n", tablename);
 
-    itab_lock(itab);
-    stat = hm_get(itab->ht, tablename, (void **)&tn);
-    itab_unlock(itab);
-
-    if (! stat) {
+    if (! (tn = itab_table_lookup(itab, tablename))) {
         errorf("itab: No such table: %s\n", tablename);
         return;
     }
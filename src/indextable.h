@@ -43,30 +43,43 @@ typedef struct indextable Indextable;
 
 Indextable *itab_new(void);
 
+/*
+ * `coldict', if not NULL, holds 1 for each column to be dictionary-encoded;
+ * a stream table with `compress' set keeps its rows in compressed chunks
+ */
 int itab_create_table(Indextable *itab, char *tablename, int ncols,
-                      char **colnames, int **coltypes, short tabletype, short primary_column);
+                      char **colnames, int **coltypes, char *coldict,
+                      short tabletype, short primary_column,
+                      long long quota, long long rows, short compress);
+
+/*
+ * the statement functions below take the table resolved once, by
+ * itab_table_lookup, for the whole statement
+ */
+int itab_update_table(Table *tn, sqlupdate *update);
 
-int itab_update_table(Indextable *itab, sqlupdate *update);
+int itab_delete_rows(Table *tn, sqldelete *delete);
 
-int itab_is_compatible(Indextable *itab, char *tablename,
-                       int ncols, int **coltypes);
+int itab_is_compatible(Table *tn, int ncols, int **coltypes);
 
 int itab_table_exists(Indextable *itab, char *tablename);
 
 Table *itab_table_lookup(Indextable *itab, char *tablename);
 
-int itab_colnames_match(Indextable *itab, char *tablename, sqlselect *select);
+int itab_colnames_match(Table *tn, sqlselect *select);
 
-Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select);
+Rtab *itab_build_results(Table *tn, sqlselect *select);
 
 Rtab *itab_showtables(Indextable *itab);
 
+Table **itab_tables(Indextable *itab, long *n);
+
 void itab_lock(Indextable *itab);
 void itab_unlock(Indextable *itab);
 
 void itab_lock_table(Indextable *itab, char *tablename);
 void itab_unlock_table(Indextable *itab, char *tablename);
 
-Node *itab_is_constrained(Indextable *itab, char *tablename, char **colvals);
+Node *itab_is_constrained(Table *tn, char **colvals);
 
 #endif
@@ -0,0 +1,777 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * map.c - the archive of tuples evicted from the memory buffer
+ *
+ * the files of an archived table live in <directory>/<table>/, and each is
+ * named after the timestamp of its first tuple, in hex, so that sorting
+ * the names sorts the files by time; only the newest file is ever appended
+ * to.  evicted tuples are collected in memory until there are enough of
+ * them for a block, which is then handed to the table's writer thread to
+ * be encoded, compressed and written through stdio, so that an eviction
+ * only ever copies its tuple; readers copy the tuples that are still
+ * pending, including those of a block the writer has not yet written
+ *
+ * in a block, the timestamps are stored as varint deltas from the oldest
+ * one, and each column as described in codec.h
+ *
+ * files left by an earlier run are only indexed when first needed
+ */
+
+#include "map.h"
+#include "tuple.h"
+#include "typetable.h"
+#include "codec.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef HWDB_ZLIB
+#include <zlib.h>
+#endif /* HWDB_ZLIB */
+
+#define ARC_MAGIC "HWDBARC1"	/* first bytes of each file */
+#define ARC_SUFFIX ".arc"
+#define NDX_INITIAL 64		/* initial slots in a file index */
+#define FILES_INITIAL 16	/* initial slots in a table's file array */
+#define PEND_INITIAL 65536	/* initial bytes for pending tuples */
+#define MAX_BLOCK (64 * 1024 * 1024)	/* longer blocks are torn headers */
+
+static char *map_directory = NULL;	/* archive directory, NULL if none */
+
+/*
+ * create directory `name' if it does not exist; returns 1 if successful
+ */
+static int make_directory(char *name) {
+    if (mkdir(name, 0755) == 0 || errno == EEXIST)
+        return 1;
+    errorf("unable to create archive directory %s: %s\n", name,
+           strerror(errno));
+    return 0;
+}
+
+F *f_init(char *filename) {
+    F *f;
+    struct stat sb;
+
+    if (! (f = (F *)calloc(1, sizeof(F))))
+        return NULL;
+    if (! (f->name = strdup(filename))) {
+        free(f);
+        return NULL;
+    }
+    f->base = ARC_EARLIER;
+    if (stat(filename, &sb) == 0)
+        f->size = sb.st_size;
+    return f;
+}
+
+static void f_free(F *f) {
+    if (f->fs)
+        (void) fclose(f->fs);
+    free(f->ndx);
+    free(f->name);
+    free(f);
+}
+
+/*
+ * record the block described by `hdr' that starts at `off'
+ */
+static void f_note(F *f, ABlock *hdr, off_t off) {
+    if (f->nndx == f->sndx) {
+        long size = (f->sndx) ? 2 * f->sndx : NDX_INITIAL;
+        Ndx *tmp = (Ndx *)realloc(f->ndx, size * sizeof(Ndx));
+        if (! tmp)
+            return;
+        f->ndx = tmp;
+        f->sndx = size;
+    }
+    f->ndx[f->nndx].timeStamp = hdr->oldest;
+    f->ndx[f->nndx].byteOffset = off;
+    f->ndx[f->nndx].row = f->count;
+    f->nndx++;
+    if (! f->count)
+        f->oldest = hdr->oldest;
+    f->newest = hdr->newest;
+    f->count += hdr->nrows;
+}
+
+/*
+ * read the block headers of an archive file, building its index; a torn
+ * block at the end of the file, left by a crash, is ignored
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+int f_index(F *f) {
+    FILE *fs;
+    ABlock hdr;
+    char magic[sizeof(ARC_MAGIC) - 1];
+    off_t off = sizeof(magic);
+
+    if (f->indexed)
+        return 1;
+    if (! (fs = fopen(f->name, "r"))) {
+        errorf("unable to open archive file %s: %s\n", f->name,
+               strerror(errno));
+        return 0;
+    }
+    if (fread(magic, sizeof(magic), 1, fs) != 1 ||
+        memcmp(magic, ARC_MAGIC, sizeof(magic)) != 0) {
+        errorf("%s is not an archive file\n", f->name);
+        (void) fclose(fs);
+        return 0;
+    }
+    f->nndx = 0;
+    f->count = 0;
+    while (fread(&hdr, sizeof(hdr), 1, fs) == 1) {
+        if (hdr.len > MAX_BLOCK || fseeko(fs, hdr.len, SEEK_CUR) != 0 ||
+            off + (off_t)sizeof(hdr) + hdr.len > f->size)
+            break;
+        f_note(f, &hdr, off);
+        off += sizeof(hdr) + hdr.len;
+    }
+    (void) fclose(fs);
+    if (off < f->size) {
+        errorf("archive file %s: ignoring %lld bytes after last block\n",
+               f->name, (long long)(f->size - off));
+    }
+    f->size = off;
+    f->indexed = 1;
+    return 1;
+}
+
+void block_free(Block *b) {
+    free(b->tstamp);
+    free(b->vals);
+    free(b->raw);
+    free(b->text);
+}
+
+/*
+ * decode the encoded block of `ncols' columns in `b->raw'
+ */
+static int decode(Block *b, int ncols, ABlock *hdr) {
+    unsigned char *p = b->raw, *end = b->raw + hdr->rawlen;
+    unsigned long long u;
+    long i;
+    int c;
+
+    if (! (b->tstamp = (tstamp_t *)malloc(b->nrows * sizeof(tstamp_t))) ||
+        ! (b->vals = (char **)malloc(b->nrows * ncols * sizeof(char *))))
+        return 0;
+    for (i = 0, u = 0; i < b->nrows; i++) {
+        unsigned long long delta;
+        if (! get_varint(&p, end, &delta))
+            return 0;
+        u += delta;
+        b->tstamp[i] = hdr->oldest + u;
+    }
+    for (c = 0; c < ncols; c++) {
+        char *text = NULL;		/* only numbers need text */
+        if (p < end && *p != ENC_DICT) {
+            if (! b->text &&
+                ! (b->text = (char *)malloc(b->nrows * ncols * CODEC_TEXT)))
+                return 0;
+            text = b->text + c * b->nrows * CODEC_TEXT;
+        }
+        if (! codec_get_column(&p, end, b->nrows, b->vals + c, ncols, text))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * read the block described by `hdr', which has just been read from `fs',
+ * into `b'
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+int f_read_block(FILE *fs, int ncols, ABlock *hdr, Block *b) {
+    unsigned char *data;
+
+    memset(b, 0, sizeof(Block));
+    b->nrows = hdr->nrows;
+    if (hdr->len > MAX_BLOCK || hdr->rawlen > MAX_BLOCK ||
+        ! (data = (unsigned char *)malloc(hdr->len + 1)))
+        return 0;
+    if (fread(data, hdr->len, 1, fs) != 1) {
+        free(data);
+        return 0;
+    }
+    if (hdr->codec == ARC_CODEC_NONE)
+        b->raw = data;
+    else {
+#ifdef HWDB_ZLIB
+        uLongf rawlen = hdr->rawlen;
+        if (hdr->codec == ARC_CODEC_ZLIB &&
+            (b->raw = (unsigned char *)malloc(hdr->rawlen + 1)) &&
+            (uncompress(b->raw, &rawlen, data, hdr->len) != Z_OK ||
+             rawlen != hdr->rawlen)) {
+            free(b->raw);
+            b->raw = NULL;
+        }
+#endif /* HWDB_ZLIB */
+        free(data);
+        if (! b->raw) {
+            errorf("unable to decompress archive block\n");
+            return 0;
+        }
+    }
+    if (! decode(b, ncols, hdr)) {
+        errorf("corrupt archive block\n");
+        block_free(b);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * encode the `n' tuples in the `len' bytes at `rows', as ARow's, as a
+ * block, compressing it if that makes it shorter; fills in `hdr' and sets
+ * `*data' to the malloc'ed block
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+static int encode_block(T *t, unsigned char *rows, long n, long len,
+                        ABlock *hdr, unsigned char **data) {
+    unsigned char **tuples, *raw, *p, *q;
+    long i;
+    int c, ans = 0;
+    tstamp_t prev;
+
+    tuples = (unsigned char **)malloc(n * sizeof(unsigned char *));
+    raw = (unsigned char *)malloc(len + n * VARINT_MAX +
+                                  t->n * codec_bound(n, 0));
+    if (! tuples || ! raw)
+        goto done;
+    for (i = 0, q = rows; i < n; i++) {
+        ARow *r = (ARow *)q;
+        tuples[i] = q + sizeof(ARow);
+        if (! i)
+            hdr->oldest = r->tstamp;
+        hdr->newest = r->tstamp;
+        q += sizeof(ARow) + ARC_PADDED(r->len);
+    }
+    p = raw;
+    prev = hdr->oldest;
+    for (i = 0, q = rows; i < n; i++) {
+        ARow *r = (ARow *)q;
+        p = put_varint(p, r->tstamp - prev);
+        prev = r->tstamp;
+        q += sizeof(ARow) + ARC_PADDED(r->len);
+    }
+    for (c = 0; c < t->n; c++)
+        if (! (p = codec_put_column(p, tuples, n, t->n, c, t->type[c])))
+            goto done;
+    hdr->nrows = n;
+    hdr->rawlen = hdr->len = p - raw;
+    hdr->codec = ARC_CODEC_NONE;
+    *data = raw;
+#ifdef HWDB_ZLIB
+    {
+        uLongf zlen = compressBound(hdr->rawlen);
+        unsigned char *z = (unsigned char *)malloc(zlen);
+        if (z && compress2(z, &zlen, raw, hdr->rawlen, Z_BEST_SPEED) == Z_OK &&
+            zlen < hdr->rawlen) {
+            hdr->len = zlen;
+            hdr->codec = ARC_CODEC_ZLIB;
+            *data = z;
+        } else
+            free(z);
+    }
+#endif /* HWDB_ZLIB */
+    ans = 1;
+
+done:
+    free(tuples);
+    if (! ans || *data != raw)
+        free(raw);
+    return ans;
+}
+
+/*
+ * write the block `data' described by `hdr' to the end of file `f';
+ * called with t->t_mutex held
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+static int put_block(F *f, ABlock *hdr, unsigned char *data) {
+    if (fwrite(hdr, sizeof(ABlock), 1, f->fs) != 1 ||
+        fwrite(data, hdr->len, 1, f->fs) != 1) {
+        errorf("unable to write archive block to %s\n", f->name);
+        return 0;
+    }
+    f_note(f, hdr, f->size);
+    f->size += sizeof(ABlock) + hdr->len;
+    return 1;
+}
+
+/*
+ * encode, compress and write the `n' tuples in the `len' bytes at `rows'
+ * as a block of file `f'; called with t->t_mutex held, so only used where
+ * the tuples cannot be left to the writer
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+static int t_write_block(T *t, F *f, unsigned char *rows, long n,
+                         long len) {
+    unsigned char *data;
+    ABlock hdr;
+    int ans;
+
+    if (! n)
+        return 1;
+    if (! encode_block(t, rows, n, len, &hdr, &data)) {
+        errorf("unable to encode archive block for %s\n", f->name);
+        return 0;
+    }
+    ans = put_block(f, &hdr, data);
+    free(data);
+    return ans;
+}
+
+/*
+ * the writer of `t': waits for a full block, and encodes, compresses and
+ * writes it without holding t->t_mutex, so that evictions, which append
+ * to the archive with the mutex of their region held, never wait for it;
+ * a block that cannot be written is retried when the next tuple arrives
+ */
+static void *t_writer(void *arg) {
+    T *t = (T *)arg;
+    unsigned char *data;
+    ABlock hdr;
+    int ok;
+
+    (void) pthread_mutex_lock(&(t->t_mutex));
+    for (;;) {
+        while (! t->stop && (! t->nfull || t->wfailed))
+            (void) pthread_cond_wait(&(t->wcond), &(t->t_mutex));
+        if (! t->nfull || t->wfailed)
+            break;
+        (void) pthread_mutex_unlock(&(t->t_mutex));
+        ok = encode_block(t, t->full, t->nfull, t->lfull, &hdr, &data);
+        (void) pthread_mutex_lock(&(t->t_mutex));
+        if (ok) {
+            ok = put_block(t->ffile, &hdr, data);
+            free(data);
+        } else {
+            errorf("unable to encode archive block for %s\n", t->ffile->name);
+        }
+        if (! (t->wfailed = ! ok)) {
+            t->nfull = 0;
+            t->lfull = 0;
+            if (t->ffile != t->files[t->nfiles - 1]) {
+                (void) fclose(t->ffile->fs);
+                t->ffile->fs = NULL;
+            }
+        }
+        (void) pthread_cond_broadcast(&(t->wdone));
+    }
+    (void) pthread_mutex_unlock(&(t->t_mutex));
+    return NULL;
+}
+
+/*
+ * wait until the writer of `t' has no block; one it has failed to write
+ * is written here instead, and dropped if that fails too; called with
+ * t->t_mutex held
+ */
+static void t_drain(T *t) {
+    while (t->nfull && ! t->wfailed)
+        (void) pthread_cond_wait(&(t->wdone), &(t->t_mutex));
+    if (t->nfull) {
+        (void) t_write_block(t, t->ffile, t->full, t->nfull, t->lfull);
+        if (t->ffile != t->files[t->nfiles - 1]) {
+            (void) fclose(t->ffile->fs);
+            t->ffile->fs = NULL;
+        }
+        t->nfull = 0;
+        t->lfull = 0;
+        t->wfailed = 0;
+    }
+}
+
+/*
+ * hand the pending tuples of `t', which belong to file `f', to the
+ * writer, starting it if necessary; called with t->t_mutex held, and only
+ * when it has no block
+ *
+ * returns 1 if successful, 0 if the writer could not be started
+ */
+static int t_handoff(T *t, F *f) {
+    unsigned char *p = t->full;
+    long size = t->sfull;
+
+    if (! t->writing) {
+        if (pthread_create(&(t->writer), NULL, t_writer, t) != 0) {
+            errorf("unable to start the archive writer for %s\n",
+                   t->directory);
+            return 0;
+        }
+        t->writing = 1;
+    }
+    t->full = t->pend;
+    t->nfull = t->npend;
+    t->lfull = t->lpend;
+    t->sfull = t->spend;
+    t->ffile = f;
+    t->pend = p;
+    t->spend = size;
+    t->npend = 0;
+    t->lpend = 0;
+    (void) pthread_cond_signal(&(t->wcond));
+    return 1;
+}
+
+/*
+ * start a new file in `t' for tuples from `tstamp' onwards, writing out
+ * the tuples pending for the current file first
+ *
+ * returns the file, or NULL if unable to create it
+ */
+static F *t_newfile(T *t, tstamp_t tstamp) {
+    char name[1024];
+    F *f;
+
+    if (t->nfiles > 0 && (f = t->files[t->nfiles - 1])->fs) {
+        t_drain(t);
+        if (! t->npend || ! t_handoff(t, f)) {
+            (void) t_write_block(t, f, t->pend, t->npend, t->lpend);
+            (void) fclose(f->fs);
+            f->fs = NULL;
+        }
+    }
+    t->npend = 0;
+    t->lpend = 0;
+    if (t->nfiles == t->sfiles) {
+        int size = (t->sfiles) ? 2 * t->sfiles : FILES_INITIAL;
+        F **tmp = (F **)realloc(t->files, size * sizeof(F *));
+        if (! tmp)
+            return NULL;
+        t->files = tmp;
+        t->sfiles = size;
+    }
+    sprintf(name, "%s/%016llx%s", t->directory, tstamp, ARC_SUFFIX);
+    if (! (f = f_init(name)))
+        return NULL;
+    if (f->size > 0 && ! f_index(f)) {
+        f_free(f);
+        return NULL;
+    }
+    if (! (f->fs = fopen(name, "a"))) {
+        errorf("unable to open archive file %s: %s\n", name, strerror(errno));
+        f_free(f);
+        return NULL;
+    }
+    if (! f->size) {
+        if (fwrite(ARC_MAGIC, sizeof(ARC_MAGIC) - 1, 1, f->fs) != 1) {
+            f_free(f);
+            return NULL;
+        }
+        f->size = sizeof(ARC_MAGIC) - 1;
+    }
+    if (! f->count)
+        f->oldest = tstamp;
+    f->base = t->position - f->count;
+    f->indexed = 1;
+    t->files[t->nfiles++] = f;
+    return f;
+}
+
+/*
+ * append the `len' byte tuple stamped `tstamp' to the archive of `t';
+ * tuples must be appended in timestamp order
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+int t_append(T *t, tstamp_t tstamp, unsigned char *tuple, int len) {
+    static const tstamp_t partition = PARTITION_SECONDS * 1000000000ULL;
+    long need = sizeof(ARow) + ARC_PADDED(len);
+    F *f = NULL;
+    ARow *r;
+    int ans = 0;
+
+    (void) pthread_mutex_lock(&(t->t_mutex));
+    if (t->nfiles > 0)
+        f = t->files[t->nfiles - 1];
+    if (! f || ! f->fs || tstamp >= f->oldest + partition)
+        f = t_newfile(t, tstamp);
+    if (f && t->lpend + need > t->spend) {
+        long size = (t->spend) ? 2 * t->spend : PEND_INITIAL;
+        unsigned char *tmp;
+        while (size < t->lpend + need)
+            size *= 2;
+        if ((tmp = (unsigned char *)realloc(t->pend, size))) {
+            t->pend = tmp;
+            t->spend = size;
+        }
+    }
+    if (f && t->lpend + need <= t->spend) {
+        r = (ARow *)(t->pend + t->lpend);
+        r->tstamp = tstamp;
+        r->len = len;
+        memcpy(t->pend + t->lpend + sizeof(ARow), tuple, len);
+        t->lpend += need;
+        t->position++;
+        ans = 1;
+        if (++(t->npend) >= ARC_BLOCK_ROWS) {
+            if (! t->nfull) {
+                if (! t_handoff(t, f) &&
+                    (ans = t_write_block(t, f, t->pend, t->npend, t->lpend))) {
+                    t->npend = 0;
+                    t->lpend = 0;
+                }
+            } else if (t->wfailed) {	/* have the writer try again */
+                t->wfailed = 0;
+                (void) pthread_cond_signal(&(t->wcond));
+            }
+        }
+    }
+    (void) pthread_mutex_unlock(&(t->t_mutex));
+    if (! ans) {
+        errorf("unable to archive tuple in %s\n", t->directory);
+    }
+    return ans;
+}
+
+/*
+ * write the blocks buffered by stdio to the current file of `t'; called
+ * with t->t_mutex held, before the files are read
+ */
+void t_flush(T *t) {
+    if (t->nfiles > 0 && t->files[t->nfiles - 1]->fs)
+        (void) fflush(t->files[t->nfiles - 1]->fs);
+}
+
+/*
+ * return the number of tuples archived in `t' so far in this run; a
+ * reader that only reads this many sees exactly the tuples that had been
+ * evicted when it asked
+ */
+long long t_position(T *t) {
+    long long position;
+
+    (void) pthread_mutex_lock(&(t->t_mutex));
+    position = t->position;
+    (void) pthread_mutex_unlock(&(t->t_mutex));
+    return position;
+}
+
+/*
+ * write out the pending tuples, and close the current file
+ */
+void t_closefiles(T *t) {
+    int i;
+
+    (void) pthread_mutex_lock(&(t->t_mutex));
+    t_drain(t);
+    for (i = 0; i < t->nfiles; i++)
+        if (t->files[i]->fs) {
+            if (i == t->nfiles - 1)
+                (void) t_write_block(t, t->files[i], t->pend, t->npend,
+                                     t->lpend);
+            (void) fclose(t->files[i]->fs);
+            t->files[i]->fs = NULL;
+        }
+    t->npend = 0;
+    t->lpend = 0;
+    (void) pthread_mutex_unlock(&(t->t_mutex));
+}
+
+int t_lookup_colindex(T *t, char *name) {
+    int i;
+
+    for (i = 0; i < t->n; i++)
+        if (strcmp(t->name[i], name) == 0)
+            return i;
+    return -1;
+}
+
+static void t_free(void *p) {
+    T *t = (T *)p;
+    int i;
+
+    if (t->writing) {
+        (void) pthread_mutex_lock(&(t->t_mutex));
+        t->stop = 1;
+        (void) pthread_cond_signal(&(t->wcond));
+        (void) pthread_mutex_unlock(&(t->t_mutex));
+        (void) pthread_join(t->writer, NULL);
+    }
+
+    for (i = 0; i < t->nfiles; i++)
+        f_free(t->files[i]);
+    for (i = 0; i < t->n; i++)
+        free(t->name[i]);
+    free(t->files);
+    free(t->name);
+    free(t->type);
+    free(t->directory);
+    free(t->pend);
+    free(t->full);
+    (void) pthread_cond_destroy(&(t->wcond));
+    (void) pthread_cond_destroy(&(t->wdone));
+    (void) pthread_mutex_destroy(&(t->t_mutex));
+    free(t);
+}
+static int is_archive_file(const struct dirent *d) {
+    size_t n = strlen(d->d_name), m = strlen(ARC_SUFFIX);
+    return (n > m && strcmp(d->d_name + n - m, ARC_SUFFIX) == 0);
+}
+
+/*
+ * add the files left in the directory of `t' by an earlier run, oldest
+ * first; they are indexed when first read
+ */
+static int t_discover(T *t) {
+    struct dirent **names;
+    char path[1024];
+    int i, n;
+
+    if ((n = scandir(t->directory, &names, is_archive_file, alphasort)) < 0)
+        return 0;
+    if (n > 0 && ! (t->files = (F **)malloc(n * sizeof(F *))))
+        n = 0;
+    t->sfiles = n;
+    for (i = 0; i < n; i++) {
+        F *f;
+        sprintf(path, "%s/%s", t->directory, names[i]->d_name);
+        if (t->files && (f = f_init(path)))
+            t->files[t->nfiles++] = f;
+        free(names[i]);
+    }
+    free(names);
+    debugf("archive %s: %d files from an earlier run\n", t->directory,
+           t->nfiles);
+    return 1;
+}
+
+void map_configure(char *directory) {
+    map_directory = directory;
+}
+
+/*
+ * create the map over the configured archive directory
+ *
+ * returns NULL if no archive directory has been configured, or if it
+ * cannot be created
+ */
+Map *map_init(void) {
+    if (! map_directory)
+        return NULL;
+    if (! make_directory(map_directory))
+        return NULL;
+    return map_new(map_directory);
+}
+
+Map *map_new(char *directory) {
+    Map *map;
+
+    if (! (map = (Map *)malloc(sizeof(Map))))
+        return NULL;
+    map->ht = hm_create(25L, 10.0);
+    map->m_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+    map->directory = strdup(directory);
+    if (! map->ht || ! map->m_mutex || ! map->directory) {
+        if (map->ht)
+            hm_destroy(map->ht, NULL);
+        free(map->m_mutex);
+        free(map->directory);
+        free(map);
+        return NULL;
+    }
+    (void) pthread_mutex_init(map->m_mutex, NULL);
+    return map;
+}
+
+void map_destroy(Map *map) {
+    hm_destroy(map->ht, t_free);
+    (void) pthread_mutex_destroy(map->m_mutex);
+    free(map->m_mutex);
+    free(map->directory);
+    free(map);
+}
+
+/*
+ * return the archive of table `tablename', creating its directory if
+ * necessary; files already in the directory are kept, so the archive of a
+ * table survives a restart
+ *
+ * returns NULL if unable to create the archive
+ */
+T *map_create_table(Map *map, char *tablename, int ncols,
+                    char **colnames, int **coltypes) {
+    T *t;
+    int i;
+
+    (void) pthread_mutex_lock(map->m_mutex);
+    if (hm_get(map->ht, tablename, (void **)&t)) {
+        (void) pthread_mutex_unlock(map->m_mutex);
+        return t;
+    }
+    if (! (t = (T *)calloc(1, sizeof(T))))
+        goto fail;
+    t->n = ncols;
+    t->name = (char **)calloc(ncols, sizeof(char *));
+    t->type = (int **)malloc(ncols * sizeof(int *));
+    t->directory = (char *)malloc(strlen(map->directory) +
+                                  strlen(tablename) + 2);
+    (void) pthread_mutex_init(&(t->t_mutex), NULL);
+    (void) pthread_cond_init(&(t->wcond), NULL);
+    (void) pthread_cond_init(&(t->wdone), NULL);
+    if (! t->name || ! t->type || ! t->directory)
+        goto fail;
+    for (i = 0; i < ncols; i++) {
+        if (! (t->name[i] = strdup(colnames[i])))
+            goto fail;
+        t->type[i] = coltypes[i];
+    }
+    sprintf(t->directory, "%s/%s", map->directory, tablename);
+    if (! make_directory(t->directory) || ! t_discover(t))
+        goto fail;
+    if (! hm_put(map->ht, tablename, t, NULL))
+        goto fail;
+    (void) pthread_mutex_unlock(map->m_mutex);
+    return t;
+
+fail:
+    (void) pthread_mutex_unlock(map->m_mutex);
+    errorf("unable to create archive for table %s\n", tablename);
+    if (t) {
+        t->n = (t->name) ? ncols : 0;
+        t_free(t);
+    }
+    return NULL;
+}
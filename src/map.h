@@ -29,72 +29,154 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * map.h - the archive of tuples evicted from the memory buffer
+ *
+ * a stream table created "with (archive)" has the tuples that free_node()
+ * evicts from its region appended to a directory of files under the
+ * archive directory; a new file is started every PARTITION_SECONDS, so
+ * each file covers one partition of time
+ *
+ * a file is a sequence of blocks of about ARC_BLOCK_ROWS tuples each; a
+ * block is stored column by column, as described in codec.h, and the
+ * whole is then compressed; the header of each block holds its oldest and
+ * newest timestamps, so a scan can pass over blocks outside its window
+ */
+
 #ifndef __HWDB_INDEX_MAP__
 #define __HWDB_INDEX_MAP__
 
-#include "hashtable.h"
+#include "adts/hashmap.h"
 
 #include "timestamp.h"
 
-#include "linkedlist.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define PARTITION_SECONDS 3600	/* time covered by one file */
+#define ARC_BLOCK_ROWS 1024	/* tuples per block */
 
-#include "sqlstmts.h"
-#include "rtab.h"
+#define ARC_CODEC_NONE 0	/* block is stored as encoded */
+#define ARC_CODEC_ZLIB 1	/* block is compressed with zlib */
 
 typedef struct ndx {
     tstamp_t timeStamp;
     off_t byteOffset;
+    long long row;		/* index in the file of the first tuple */
 } Ndx;
 
+/*
+ * header of each block in an archive file, followed by `len' bytes
+ */
+typedef struct ablock {
+    tstamp_t oldest;		/* timestamp of first tuple */
+    tstamp_t newest;		/* timestamp of last tuple */
+    unsigned int nrows;		/* tuples in the block */
+    unsigned int rawlen;	/* bytes once decompressed */
+    unsigned int len;		/* bytes stored */
+    unsigned int codec;		/* ARC_CODEC_* */
+} ABlock;
+
+/*
+ * a block read back from a file
+ */
+typedef struct block {
+    int nrows;
+    tstamp_t *tstamp;		/* timestamp of each tuple */
+    char **vals;		/* column values, row by row */
+    unsigned char *raw;		/* decompressed block */
+    char *text;			/* text of numeric values */
+} Block;
+
 typedef struct _f {
-    char *name;
-    FILE *fs;
+    char *name;			/* path of the file */
+    FILE *fs;			/* open for appending if current, else NULL */
     tstamp_t oldest;
     tstamp_t newest;
-    unsigned char indexed;
+    unsigned char indexed;	/* set once ndx, oldest and newest are valid */
+    Ndx *ndx;			/* oldest timestamp and offset of each block */
+    long nndx;			/* entries in ndx */
+    long sndx;			/* slots in ndx */
+    long long count;		/* tuples in the file */
+    long long base;		/* archive position of its first tuple */
+    off_t size;			/* bytes in the file */
 } F;
 
+#define ARC_EARLIER (-(1LL << 62))	/* base of files from an earlier run */
+
 F *f_init(char *filename);
 
-int f_index(F *f, char *in, char *out);
+int f_index(F *f);
+
+int f_read_block(FILE *fs, int ncols, ABlock *hdr, Block *b);
+
+void block_free(Block *b);
 
 typedef struct _t {
-    int n;
-    char **name;
-    int  **type;
-    List *files;
+    int n;			/* number of columns */
+    char **name;		/* names of the columns */
+    int  **type;		/* types of the columns */
+    char *directory;		/* directory holding the files */
+    F **files;			/* files, oldest first */
+    int nfiles;
+    int sfiles;
+    unsigned char *pend;	/* tuples not yet written, as ARow's */
+    long npend;			/* tuples in pend */
+    long lpend;			/* bytes used in pend */
+    long spend;			/* bytes allocated to pend */
+    unsigned char *full;	/* block being written, older than pend */
+    long nfull;			/* tuples in full, 0 if none */
+    long lfull;			/* bytes used in full */
+    long sfull;			/* bytes allocated to full */
+    F *ffile;			/* file that full belongs to */
+    long long position;		/* tuples archived in this run */
     pthread_mutex_t t_mutex;
+    pthread_cond_t wcond;	/* signalled when full is to be written */
+    pthread_cond_t wdone;	/* signalled when the writer is done */
+    pthread_t writer;
+    int writing;		/* set once the writer is started */
+    int wfailed;		/* set if the writer could not write full */
+    int stop;			/* set to stop the writer */
 } T;
 
-FILE *t_file(T *t, tstamp_t tstamp);
+/*
+ * a pending tuple: its header is followed by `len' bytes, padded to a
+ * multiple of ARC_ALIGN
+ */
+typedef struct arow {
+    tstamp_t tstamp;
+    unsigned int len;
+} ARow;
 
-void t_closefiles(T *t);
+#define ARC_ALIGN 8
+#define ARC_PADDED(len) ((((len) - 1) / ARC_ALIGN + 1) * ARC_ALIGN)
 
-void t_extract_relevant_columns(T *t, sqlselect *select,
-                                Rtab *results);
+int t_append(T *t, tstamp_t tstamp, unsigned char *tuple, int len);
 
-void t_extract_relevant_types(T *t, Rtab *results);
+void t_flush(T *t);
+
+long long t_position(T *t);
+
+void t_closefiles(T *t);
 
 int t_lookup_colindex(T *t, char *name);
 
 typedef struct _map {
-    Hashtable *ht;
+    HashMap *ht;
     pthread_mutex_t *m_mutex;
     char *directory;
 } Map;
 
-Map *map_new(char *directory);
-
-void map_destroy(Map *map);
+void map_configure(char *directory);
 
-int map_create_table(Map *map, char *tablename, int ncols,
-                     char **colnames, int **coltypes);
+Map *map_init(void);
 
-int map_update_table(Map *map, char *filename);
+Map *map_new(char *directory);
 
-Rtab *map_build_results(Map *map, char *tablename, sqlselect *select);
+void map_destroy(Map *map);
 
-int map_load(Map *map, char *cmd);
+T *map_create_table(Map *map, char *tablename, int ncols,
+                    char **colnames, int **coltypes);
 
 #endif /* __HWDB_INDEX_MAP__ */
-
@@ -32,15 +32,43 @@
 /*
  * mb.c - source file for circular buffer that underlies the Homework DB
  *
- * the buffer is allocated statically with size MB_SIZE
+ * the shared buffer is mapped at startup, with size MB_SIZE unless
+ * mb_configure() has been called; a stream table created with a quota gets
+ * a region of its own, managed in exactly the same way, so that its
+ * history is not evicted by other tables
  *
- * tuples are allocated starting at the beginning of the buffer
+ * in each region, a node is allocated together with its tuple, which
+ * follows it, starting at the beginning of the buffer; after the buffer is
+ * exhausted, it is treated as a circular buffer, and the oldest nodes are
+ * evicted to make room, so the space given to nodes always follows the
+ * tuples being stored.  the next younger node is the one after the tuple,
+ * or the one at the beginning of the buffer if the tuple ends where the
+ * last pass through the buffer ended.  a node refers to its table by an
+ * index into the tables of its region
  *
- * nodes are allocated from the end of the buffer
+ * an inserter reserves its node with the region locked, copies the tuple
+ * into it without the lock, and then links it into its table; nodes are
+ * linked in the order in which they were reserved, and a node that is
+ * still being filled in is not evicted
  *
- * after the buffer is exhausted, treat tuple space as a circular buffer
- * and the system is constrained to the number of nodes that exhausted the
- * buffer
+ * readers of a stream table register a snapshot and then scan without
+ * locks; a writer that needs to recycle a node that a snapshot may still
+ * visit waits for the snapshot to move on.  a snapshot pins the nodes of
+ * every table in the region from its oldest node onwards, so readers move
+ * it forward every MB_SNAPSHOT_STEP nodes, and a writer that catches up
+ * with a long select, on this table or any other in the region, waits for
+ * one step of the reader rather than for the whole select
+ *
+ * nodes and tuples of persistent tables live outside the regions, in
+ * per-table slabs (see slab.c)
+ *
+ * the rows of a compressed table are collected in its open chunk, and
+ * each node holds a chunk of them (see chunk.c)
+ *
+ * the rows of a table with a time-to-live are expired by a background
+ * thread: they are unlinked from the table, oldest first, and their space
+ * is reclaimed when the ring reaches it, at once if they are the oldest in
+ * the region
  */
 
 #ifndef ALIGNMENT	/* override if you know better! */
@@ -48,7 +76,7 @@
 #endif /* ALIGNMENT */
 
 /*
- * max value for MB_SIZE_IN_ALIGHMENT_UNITS is 240000000
+ * default size of the shared buffer; override at runtime with mb_configure()
  */
 #ifndef MB_SIZE_IN_ALIGNMENT_UNITS
 #define MB_SIZE_IN_ALIGNMENT_UNITS 24000000
@@ -58,218 +86,436 @@
 #define MB_SIZE (MB_SIZE_IN_ALIGNMENT_UNITS * ALIGNMENT)
 
 /*
- * we stop allocating Node structures when this much space is all that is left
- * above the last allocated tuple on the first pass through the buffer
+ * compute aligned size of Node
  */
-#define BUFFER_ZONE 512 * ALIGNMENT
+#define ALIGNED_NODE_SIZE (((sizeof(Node) - 1) / ALIGNMENT + 1) * ALIGNMENT)
 
 /*
- * compute aligned size of Node
+ * a node refers to its table by an unsigned short; an expired node, which
+ * no longer belongs to its table, has an owner of EXPIRED
  */
-#define ALIGNED_NODE_SIZE (((sizeof(Node) - 1) / ALIGNMENT + 1) * ALIGNMENT)
+#define MAX_OWNERS 65535
+#define EXPIRED 65535
 
 /*
- * minimum number of Nodes to allocate at a time
+ * seconds between passes of the expiry thread
  */
-#define MINIMUM_NODES 25
+#define EXPIRY_INTERVAL 1
 
 /*
- * macro for appending a structure to a singly linked list
- * elem - pointer to the structure to append
- * head - pointer to the head of the list
- * tail - pointer to the tail of the list
- * link - expression for the link to the next element in tail
- * count - a variable that maintains the number of elements in the list
- *
- * assumes elem->next has already been set to NULL
+ * smallest private region that will be created, and the number of bytes
+ * of column text assumed per column when sizing a region from a row quota
  */
+#define MINIMUM_REGION (128 * 1024)
+#define COLUMN_ESTIMATE 24
 
-#define append2LL(elem, head, tail, link, count) {\
-	if ((count)++) (link) = (elem); else (head) = (elem); \
-	(tail) = (elem); }
+/*
+ * MAP_HUGETLB mappings are made in multiples of this size
+ */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 #include "mb.h"
 #include "node.h"
 #include "table.h"
 #include "tuple.h"
 #include "timestamp.h"
+#include "wal.h"
+#include "map.h"
+#include "slab.h"
+#include "chunk.h"
+#include "util.h"
 #include <string.h>
 #include <stdio.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <stdlib.h>
 
-static unsigned char mb[MB_SIZE];	/* the memory buffer */
-static unsigned char *oldestT = mb;	/* address of oldest tuple */
-static unsigned char *nextT = mb + ALIGNMENT;	/* byte for next tuple */
-static long nbytes = ALIGNMENT;		/* number of bytes used */
-static long lastIndex = MB_SIZE - ALIGNED_NODE_SIZE;	/* last index used for node alloc */
-static unsigned char *lastPtr = mb + MB_SIZE - ALIGNED_NODE_SIZE;	/* address of mb[lastIndex] */
-static int partitionFixed = 0;		/* set to 1 when buffer exhausted */
-static Node *freeN = NULL;		/* free list of nodes */
-static Node *firstN;			/* least recently allocated node */
-static Node *lastN;			/* most recently allocated node */
-static long nnodes = 1L;		/* number of nodes in use */
-static Table dTbl;			/* dummy table to hold dummy tuple */
-static long passes = 0L;		/* counter of passes through buffer */
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-/*
- * allocate another block of Nodes, working down from high memory
- *
- * computes the number of (Tuple+Node)'s that would fit in 25% of the space
- * remaining; when that number drops to zero, makes partitionFixed TRUE
- *
- * if ifFirst is true, assumes average tuple size is 24 bytes
- * if false, computes the average tuple size of stored tuples
- *
- * Still have a check to see if the allocation makes its way into the buffer
- * zone, and if so, sets partitionFixed and stops
+/*
+ * state of a circular buffer region; the shared region holds every stream
+ * table that was created without a quota
+ */
+struct region {
+    unsigned char *mb;		/* the memory buffer */
+    long size;			/* size of the memory buffer */
+    unsigned char *nextT;	/* byte for next node */
+    unsigned char *wrap;	/* where the last pass ended, while nodes of
+                                   that pass remain, else NULL */
+    long nbytes;		/* number of bytes used for tuples */
+    Node *firstN;		/* least recently allocated node, or NULL */
+    Node *lastN;		/* most recently allocated node */
+    Node *unlinked;		/* oldest node not yet linked into its
+                                   table, or NULL */
+    unsigned long reserved;	/* nodes reserved so far */
+    unsigned long linked;	/* nodes linked into their tables so far */
+    long nnodes;		/* number of nodes in use */
+    long maxrows;		/* row quota, 0 if none */
+    Table **owners;		/* tables with nodes in the region */
+    int nowners;		/* number of tables in owners */
+    int sowners;		/* number of slots in owners */
+    long passes;		/* counter of passes through buffer */
+    long expired;		/* nodes expired by their table's ttl */
+    long lingering;		/* bytes of expired nodes not yet reclaimed */
+    char *name;			/* table owning the region, NULL if shared */
+    Region *next;		/* next region in list of all regions */
+    Snapshot *snaps;		/* snapshots registered by readers */
+    pthread_cond_t released;	/* signalled when a snapshot is released */
+    pthread_mutex_t mutex;
+};
+
+static long mb_size = MB_SIZE;		/* size of the shared buffer */
+static int mb_policy = MB_PAGES_THP;	/* how buffers are mapped */
+static Region shared;			/* the shared region */
+static Region *regions = &shared;	/* all regions, for mb_dump */
+static pthread_mutex_t rlist_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int expiring = 0;		/* expiry thread has been started */
+
+#define region_of(tb) (((tb)->region) ? (tb)->region : &shared)
+
+/*
+ * give `tb' an index among the tables of `r', by which its nodes refer to
+ * it; tables are never dropped, so the index is never reused
  *
- * this should not happen
+ * return 1 if successful, 0 if not
  */
-static void alloc_block(int ifFirst) {
-    long nNodes;
-    long i, ind;
-    long zoneIndex;
-    Node *t;
-    long tupleAverage;
-    if (partitionFixed)			/* no more nodes can be alloced */
-        return;
-    /* have to account for tuple space + Node space */
-    if (ifFirst)	/* assume tuple average is 24 + ALIGNED_NODE_SIZE) */
-        tupleAverage = 24 + ALIGNED_NODE_SIZE;
-    else		/* compute tuple average from nbytes and nnodes */
-        tupleAverage = nbytes / nnodes + ALIGNED_NODE_SIZE;
-    nNodes = (long)(lastPtr - nextT) / 4 / tupleAverage;
-    if (nNodes <= 0) {
-        partitionFixed++;
-        return;
-    } else if (nNodes < MINIMUM_NODES)
-        nNodes = MINIMUM_NODES;
-    zoneIndex = (long)(nextT - mb) + BUFFER_ZONE;
-    for (i = 0L; i < nNodes; i++) {
-        ind = lastIndex - ALIGNED_NODE_SIZE;
-        if (ind < zoneIndex) {		/* node in buffer zone, stop */
-            partitionFixed++;
-            break;
+static int add_owner(Region *r, Table *tb) {
+    Table **p;
+    int n;
+
+    if (r->nowners == r->sowners) {
+        n = (r->sowners) ? 2 * r->sowners : 16;
+        if (n > MAX_OWNERS)
+            n = MAX_OWNERS;
+        if (n == r->sowners ||
+            ! (p = (Table **)realloc(r->owners, n * sizeof(Table *)))) {
+            errorf("no room for another table in the region\n");
+            return 0;
         }
-        lastIndex = ind;		/* add node to free list */
-        lastPtr = &(mb[lastIndex]);
-        t = (Node *)lastPtr;
-        t->next = freeN;
-        freeN = t;
+        r->owners = p;
+        r->sowners = n;
     }
+    tb->owner = r->nowners;
+    r->owners[r->nowners++] = tb;
+    return 1;
 }
 
 /*
- * allocate a node from the free list
- *
- * if free list is empty, attempt to allocate another block of Nodes
- * and try again
- *
- * return NULL if no more free nodes
+ * return true if a registered snapshot may visit node `t'; nodes in a region
+ * are stamped in the order in which they are appended, so this is true for
+ * every node from the oldest one that a snapshot has captured onwards
  */
-static Node *alloc_node() {
-    Node *p;
-    if (!freeN && !partitionFixed)
-        alloc_block(0);
-    if ((p = freeN))
-        freeN = p->next;
-    return p;
+static int pinned(Region *r, Node *t) {
+    Snapshot *s;
+    for (s = r->snaps; s; s = s->next)
+        if (t->tstamp >= s->since)
+            return 1;
+    return 0;
 }
 
 /*
- * free oldest node, cleaning up the data structures
+ * append the tuple of `t' to the archive of table `tb'; the archive keeps
+ * the text of dictionary-encoded columns in the tuple
  */
-static void free_node() {
-    Node *t = firstN;		/* least-recently allocated tuple */
-    firstN = t->younger;	/* unlink it from active list */
-    oldestT = firstN->tuple;	/* oldestT now points to new oldest tuple */
-    nbytes -= t->alloc_len;	/* update bytes allocated */
-    Table *tb = t->parent;	/* locate the table holding tuple */
+static void archive_node(Table *tb, Node *t) {
+    union Tuple buf;
+    unsigned char *p = buf.bytes;
+    int len;
+
+    if (! tb->dict) {
+        (void) t_append(tb->archive, t->tstamp, t->tuple, t->real_len);
+        return;
+    }
+    len = tuple_inline(tb, t->tuple, p, sizeof(buf));
+    if (len >= 0 && (size_t)len > sizeof(buf) &&
+            (p = (unsigned char *)malloc(len)))
+        (void) tuple_inline(tb, t->tuple, p, len);
+    if (p)
+        (void) t_append(tb->archive, t->tstamp, p, len);
+    else {
+        errorf("unable to archive tuple of %s\n", tb->name);
+    }
+    if (p != buf.bytes)
+        free(p);
+}
+
+/*
+ * remove `t', the oldest node of `tb', from the table, spilling its tuple
+ * to the archive; called with the mutex of its region held
+ */
+static void evict(Table *tb, Node *t) {
     Node *u = t->next;
+
+    if (tb->archive)		/* spill it to the archive */
+        archive_node(tb, t);
+    (void) pthread_mutex_lock(&(tb->tb_mutex));
+    table_tindex_evict(tb, t);
     tb->oldest = u;		/* remove from table */
     if (!(--(tb->count)))	/* list now empty */
         tb->newest = NULL;
     else
         u->prev = NULL;
-    t->next = freeN;		/* return Node to free list */
-    freeN = t;
-    nnodes--;			/* update nodes in use */
+    (void) pthread_mutex_unlock(&(tb->tb_mutex));
+}
 
+/*
+ * the node allocated after `t' in region `r', which follows its tuple, or
+ * is at the beginning of the buffer if the tuple ends where the last pass
+ * ended; `t' must not be r->lastN
+ */
+static Node *younger(Region *r, Node *t) {
+    if (t->tuple + t->alloc_len == r->wrap)
+        return (Node *)r->mb;
+    return (Node *)(t->tuple + t->alloc_len);
 }
 
 /*
- * mb_init() - initialize the circular buffer and node free pool
+ * free oldest node, cleaning up the data structures
  *
- * initializes the dummy tuple, then generates the first block of Nodes
- * in the free pool
- */
-void mb_init() {
-    (void) pthread_mutex_lock(&mutex);
-    firstN = (Node *)lastPtr;	/* least recently allocated node */
-    lastN = (Node *)lastPtr;	/* most recently allocated node */
-    firstN->parent = &dTbl;	/* fill in dummy tuple and table */
-    firstN->next = NULL;
-    firstN->younger = NULL;
-    firstN->alloc_len = ALIGNMENT;
-    firstN->real_len = ALIGNMENT;
-    firstN->tuple = oldestT;
-    (void) pthread_mutex_init(&(dTbl.tb_mutex), NULL);
-    (void) pthread_mutex_lock(&(dTbl.tb_mutex));
-    append2LL(firstN, dTbl.oldest, dTbl.newest, (dTbl.newest)->next, dTbl.count);
-    (void) pthread_mutex_unlock(&(dTbl.tb_mutex));
-    alloc_block(1);	/* allocate initial tranche of Nodes */
-    (void) pthread_mutex_unlock(&mutex);
+ * if a snapshot may still visit the oldest node, or its tuple is still
+ * being copied, waits until a snapshot is advanced or released or a node
+ * is linked and returns 0 without freeing anything, since other writers
+ * may have changed the region in the meantime; returns 1 if the node was
+ * freed
+ */
+static int free_node(Region *r) {
+    Node *t = r->firstN;	/* least-recently allocated tuple */
+    if (t == r->unlinked || pinned(r, t)) {
+        (void) pthread_cond_wait(&(r->released), &(r->mutex));
+        return 0;
+    }
+    /* unlink it from active list; the next one follows its tuple */
+    if (t == r->lastN) {
+        r->firstN = NULL;
+        r->wrap = NULL;
+    } else {
+        r->firstN = younger(r, t);
+        if (r->firstN == (Node *)r->mb)
+            r->wrap = NULL;		/* last pass is over */
+    }
+    r->nbytes -= t->alloc_len;	/* update bytes allocated */
+    if (t->owner != EXPIRED)	/* remove from the table holding it */
+        evict(r->owners[t->owner], t);
+    else
+        r->lingering -= ALIGNED_NODE_SIZE + t->alloc_len;
+    r->nnodes--;		/* update nodes in use */
+    return 1;
 }
 
 /*
- * mb_insert - insert buffer into the circular buffer
+ * initialize region `r' over `size' bytes at `buf'
+ */
+static void region_init(Region *r, unsigned char *buf, long size) {
+    r->mb = buf;
+    r->size = size;
+    r->nextT = buf;
+    r->wrap = NULL;
+    r->nbytes = 0L;
+    r->firstN = NULL;
+    r->lastN = NULL;
+    r->unlinked = NULL;
+    r->reserved = 0UL;
+    r->linked = 0UL;
+    r->nnodes = 0L;
+    r->owners = NULL;
+    r->nowners = 0;
+    r->sowners = 0;
+    r->passes = 0L;
+    r->expired = 0L;
+    r->lingering = 0L;
+    r->snaps = NULL;
+    (void) pthread_cond_init(&(r->released), NULL);
+    (void) pthread_mutex_init(&(r->mutex), NULL);
+}
+
+/*
+ * map `size' bytes for a region according to mb_policy
+ *
+ * MAP_HUGETLB needs huge pages reserved by the administrator, so fall back
+ * to normal pages, advised to be transparent huge pages, if that fails;
+ * populating such a mapping is done after the advice, by touching a byte
+ * in each page, so that the pages are faulted in as huge pages
+ *
+ * returns NULL if the mapping fails
+ */
+static unsigned char *buffer_map(long size) {
+    void *p = MAP_FAILED;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+    if (mb_policy & MB_PAGES_HUGETLB) {
+        long hsize = ((size - 1) / HUGE_PAGE_SIZE + 1) * HUGE_PAGE_SIZE;
+        int hflags = flags | MAP_HUGETLB;
+        if (mb_policy & MB_PAGES_POPULATE)
+            hflags |= MAP_POPULATE;
+        p = mmap(NULL, hsize, PROT_READ | PROT_WRITE, hflags, -1, 0);
+        if (p != MAP_FAILED)
+            return (unsigned char *)p;
+        errorf("no huge pages for %ld bytes, using normal pages\n", size);
+    }
+#endif /* MAP_HUGETLB */
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (mb_policy & (MB_PAGES_THP | MB_PAGES_HUGETLB))
+        (void) madvise(p, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+    if (mb_policy & MB_PAGES_POPULATE) {
+        long i, pagesize = sysconf(_SC_PAGESIZE);
+        for (i = 0; i < size; i += pagesize)
+            ((volatile unsigned char *)p)[i] = 0;
+    }
+    return (unsigned char *)p;
+}
+
+/*
+ * mb_configure() - set the size of the shared buffer, and how buffers are
+ * mapped; must be called before mb_init()
+ */
+void mb_configure(long size, int policy) {
+    if (size > 0)
+        mb_size = size;
+    mb_policy = policy;
+}
+
+/*
+ * mb_init() - map and initialize the shared circular buffer and node
+ * free pool
  *
  * return 1 if successful, 0 if not
  */
-int mb_insert(unsigned char *buf, long len, Table *tb) {
+int mb_init() {
+    long size = (mb_size / ALIGNMENT) * ALIGNMENT;
+    unsigned char *buf;
+
+    if (size < MINIMUM_REGION) {
+        errorf("buffer size of %ld bytes is too small\n", mb_size);
+        return 0;
+    }
+    if (! (buf = buffer_map(size))) {
+        errorf("unable to map %ld bytes for the buffer\n", size);
+        return 0;
+    }
+    region_init(&shared, buf, size);
+    return 1;
+}
+
+/*
+ * mb_region_create - give stream table `tb' a circular buffer of its own
+ *
+ * the region holds `quota' bytes; if `rows' is non-zero, the oldest tuple
+ * is also evicted when the table holds `rows' tuples.  if no byte quota is
+ * given, the region is sized from `rows' and the schema of the table
+ *
+ * return 1 if successful, 0 if not
+ */
+int mb_region_create(Table *tb, char *name, long long quota, long long rows) {
+    Region *r;
+    unsigned char *buf;
+    long long size = quota;
+
+    if (size <= 0) {
+        long long tsize = TUPLE_VALUES_OFFSET(tb->ncols) +
+                          tb->ncols * (sizeof(union Value) + COLUMN_ESTIMATE);
+        size = (rows + 1) * (((tsize - 1) / ALIGNMENT + 1) * ALIGNMENT +
+                             ALIGNED_NODE_SIZE);
+    }
+    if (size < MINIMUM_REGION)
+        size = MINIMUM_REGION;
+    size = (size / ALIGNMENT) * ALIGNMENT;
+    if (size != (long)size) {
+        errorf("quota of %lld bytes is too large\n", size);
+        return 0;
+    }
+    if (! (r = (Region *)calloc(1, sizeof(Region))))
+        return 0;
+    if (! (buf = buffer_map((long)size))) {
+        errorf("unable to map %lld bytes for table %s\n", size, name);
+        free(r);
+        return 0;
+    }
+    region_init(r, buf, (long)size);
+    r->maxrows = (long)rows;
+    r->name = strdup(name);
+    debugf("table %s has a region of %lld bytes, %lld rows\n", name, size,
+           rows);
+    (void) pthread_mutex_lock(&rlist_mutex);
+    r->next = regions->next;	/* shared region stays at the head */
+    regions->next = r;
+    (void) pthread_mutex_unlock(&rlist_mutex);
+    tb->region = r;
+    return 1;
+}
+
+/*
+ * reserve space in region `r' for a node of `tb' and a tuple of `alloc_len'
+ * bytes, evicting the oldest tuples in the region as needed; must be
+ * called with r->mutex held, which is given up while waiting for a
+ * snapshot to be released
+ *
+ * the node takes its place in the region at once, but is only linked into
+ * its table by publish(), so the tuple may be copied into it after the
+ * mutex has been given up; `*seq' is set to the number of the reservation
+ *
+ * returns the node, with its tuple pointing at the reserved space, or NULL
+ * if `tb' cannot be given a place in the region
+ */
+static Node *reserve(Region *r, Table *tb, unsigned short alloc_len,
+                     unsigned long *seq) {
+    long need = ALIGNED_NODE_SIZE + alloc_len;
+    unsigned char *oldest;
     Node *n;
-    unsigned short alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
-    unsigned char *t;
-    struct timeval tv;
-    (void) pthread_mutex_lock(&mutex);
-    while (!(n = alloc_node()))
-        free_node();			/* free up oldest node */
+
+    if (tb->owner < 0 && ! add_owner(r, tb))
+        return NULL;
+    while (r->maxrows && tb->count >= r->maxrows)
+        (void) free_node(r);		/* enforce the row quota */
     for (;;) {
-        if (oldestT < nextT) {		/* oldestT behind nextT */
-            if ((nextT + alloc_len) >= lastPtr) {
-                free_node();	/* oldest node must be at mb or later */
-                nextT = mb;	/* reset pointer */
-                passes++;
-            } else
+        oldest = (unsigned char *)r->firstN;
+        if (! oldest) {			/* region is empty */
+            if (r->nextT + need > r->mb + r->size)
+                r->nextT = r->mb;
+            break;
+        } else if (oldest < r->nextT) {	/* oldest node behind nextT */
+            if (r->nextT + need <= r->mb + r->size)
                 break; /* OK */
-        } else {		/* oldestT behind nextT */
-            if ((nextT + alloc_len >= oldestT)) {
-                free_node();
-            } else
-                break;	/* OK */
-        }
+            r->wrap = r->nextT;		/* start another pass */
+            r->nextT = r->mb;
+            r->passes++;
+        } else if (r->nextT + need <= oldest)
+            break; /* OK */
+        else
+            (void) free_node(r);	/* free up oldest node */
     }
     /*
-     * at this point, we have a node (n) and nextT points at location in
-     * buffer big enough to hold the tuple
+     * at this point, nextT points at location in buffer big enough to
+     * hold the node and its tuple
      */
-    t = nextT;
-    nextT += alloc_len;		/* now point at next free location */
-    nbytes += alloc_len;	/* update the bytes in use counter */
-    n->parent = tb;		/* fill in node member data */
+    n = (Node *)r->nextT;
+    n->tuple = r->nextT + ALIGNED_NODE_SIZE;
+    r->nextT += need;		/* now point at next free location */
+    r->nbytes += alloc_len;	/* update the bytes in use counter */
+    n->owner = (unsigned short)tb->owner;	/* fill in node member data */
     n->next = NULL;
     n->prev = NULL;
-    n->younger = NULL;
     n->alloc_len = alloc_len;
-    n->real_len = (unsigned short)len;
-    n->tuple = t;
-    (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
-    n->tstamp = timeval_to_timestamp(&tv);
-    memcpy(t, buf, len);	/* copy buf to t */
-    append2LL(n, firstN, lastN, lastN->younger, nnodes);
+    n->real_len = 0;			/* not filled in yet */
+    if (! (r->nnodes)++)
+        r->firstN = n;
+    r->lastN = n;
+    if (! r->unlinked)
+        r->unlinked = n;
+    *seq = ++(r->reserved);
+    return n;
+}
+
+/*
+ * append `n' to its table; must be called with r->mutex held
+ */
+static void append(Region *r, Node *n) {
+    Table *tb = r->owners[n->owner];
+
     (void) pthread_mutex_lock(&(tb->tb_mutex));
     if ((tb->count)++) {	/* list was not empty */
         tb->newest->next = n;
@@ -279,158 +525,445 @@ int mb_insert(unsigned char *buf, long len, Table *tb) {
         tb->newest = n;
         tb->oldest = n;
     }
+    table_tindex_add(tb, n);
     (void) pthread_mutex_unlock(&(tb->tb_mutex));
-    (void) pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * record that the `len' bytes of the tuple of `n', reservation `seq', have
+ * been filled in, and append the nodes of region `r' that are, in the order
+ * in which they were reserved, to their tables; must be called with
+ * r->mutex held, which is given up while waiting for the tuples reserved
+ * before `n' to be filled in, so that `n' is linked on return
+ */
+static void publish(Region *r, Node *n, int len, unsigned long seq) {
+    Node *t;
+
+    n->real_len = (unsigned short)len;
+    while ((t = r->unlinked) && t->real_len) {
+        append(r, t);
+        r->linked++;
+        r->unlinked = (t == r->lastN) ? NULL : younger(r, t);
+    }
+    (void) pthread_cond_broadcast(&(r->released));
+    while (r->linked < seq)
+        (void) pthread_cond_wait(&(r->released), &(r->mutex));
+}
+
+/*
+ * mb_insert - insert buffer into the circular buffer
+ *
+ * return 1 if successful, 0 if not
+ */
+int mb_insert(unsigned char *buf, long len, Table *tb) {
+    Region *r = region_of(tb);
+    Node *n;
+    unsigned short alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
+    unsigned long seq;
+    struct timeval tv;
+    (void) pthread_mutex_lock(&(r->mutex));
+    if (! (n = reserve(r, tb, alloc_len, &seq))) {
+        (void) pthread_mutex_unlock(&(r->mutex));
+        return 0;
+    }
+    (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
+    n->tstamp = timeval_to_timestamp(&tv);
+    memcpy(n->tuple, buf, len);	/* copy buf to tuple */
+    publish(r, n, len, seq);
+    (void) pthread_mutex_unlock(&(r->mutex));
 
     return 1;
 }
 
+/*
+ * store the oldest open rows of compressed table `tb' as chunks, while
+ * there are enough of them; must be called with r->mutex held
+ *
+ * reserve() may give up the mutex, so the rows stay open until their
+ * chunk has been appended, and other inserters leave sealing to this one
+ */
+static void seal_chunks(Region *r, Table *tb) {
+    Chunks *c = tb->chunks;
+    unsigned char *chunk;
+    struct timeval tv;
+    unsigned long seq;
+    long nrows;
+    int len;
+    Node *n;
+
+    if (c->sealing)
+        return;
+    c->sealing = 1;
+    while (chunk_full(c)) {
+        if (! (len = chunk_encode(tb, c, &chunk, &nrows))) {
+            errorf("unable to compress %ld rows of %s\n", nrows, tb->name);
+            chunk_drop(c, nrows);
+            continue;
+        }
+        if ((n = reserve(r, tb, ((len - 1) / ALIGNMENT + 1) * ALIGNMENT,
+                         &seq))) {
+            (void) gettimeofday(&tv, NULL);
+            n->tstamp = timeval_to_timestamp(&tv);
+            memcpy(n->tuple, chunk, len);
+            publish(r, n, len, seq);
+        }
+        chunk_drop(c, nrows);
+        free(chunk);
+    }
+    c->sealing = 0;
+}
+
 /*
  * mb_insert_tuple - insert tuple into the circular buffer
  *
+ * the tuple is encoded before the region is locked and copied into its
+ * node after the lock has been given up, so that concurrent inserters only
+ * serialize for the reservation and the append
+ *
  * return timestamp if successful, (tstamp_t)0 if not
  */
 tstamp_t mb_insert_tuple(int ncols, char *vals[], Table *tb) {
+    Region *r = region_of(tb);
     Node *n;
-    int len = ncols * sizeof(char *);
-    int i;
+    int len = tuple_length(tb, ncols, vals);
     unsigned short alloc_len;
-    unsigned char *t, *s;
-    union Tuple *p;
+    unsigned char tmp[MAX_TUPLE_SIZE], *enc = tmp;
+    unsigned long seq;
     struct timeval tv;
     tstamp_t ts;
 
-    for (i = 0; i < ncols; i++)
-        len += strlen(vals[i]) + 1;
+    if (len > MAX_TUPLE_SIZE && ! (enc = (unsigned char *)malloc(len))) {
+        errorf("unable to allocate %d bytes for tuple\n", len);
+        return (tstamp_t)0;
+    }
+    if (! tuple_encode(tb, ncols, vals, enc)) {
+        errorf("unable to add row to %s\n", tb->name);
+        if (enc != tmp)
+            free(enc);
+        return (tstamp_t)0;
+    }
     alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
-    (void) pthread_mutex_lock(&mutex);
-    while (!(n = alloc_node()))
-        free_node();			/* free up oldest node */
-    for (;;) {
-        if (oldestT < nextT) {		/* oldestT behind nextT */
-            if ((nextT + alloc_len) >= lastPtr) {
-                free_node();	/* oldest node must be at mb or later */
-                nextT = mb;	/* reset pointer */
-                passes++;
-            } else
-                break; /* OK */
-        } else {		/* oldestT behind nextT */
-            if ((nextT + alloc_len >= oldestT)) {
-                free_node();
-            } else
-                break;	/* OK */
+    (void) pthread_mutex_lock(&(r->mutex));
+    if (tb->chunks) {
+        (void) gettimeofday(&tv, NULL);		/* timestamp the row */
+        ts = timeval_to_timestamp(&tv);
+        if (chunk_append(tb->chunks, ts, enc, len))
+            seal_chunks(r, tb);
+        else {
+            errorf("unable to add row to %s\n", tb->name);
+            ts = (tstamp_t)0;
         }
+    } else if ((n = reserve(r, tb, alloc_len, &seq))) {
+        (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
+        ts = timeval_to_timestamp(&tv);
+        n->tstamp = ts;
+        (void) pthread_mutex_unlock(&(r->mutex));
+        memcpy(n->tuple, enc, len);	/* copy outside the lock */
+        (void) pthread_mutex_lock(&(r->mutex));
+        publish(r, n, len, seq);
+    } else
+        ts = (tstamp_t)0;
+    (void) pthread_mutex_unlock(&(r->mutex));
+    if (enc != tmp)
+        free(enc);
+
+    return ts;
+}
+
+/*
+ * return the pools for the nodes and tuples of persistent table `tb',
+ * creating them on first use; called with tb->tb_mutex held
+ */
+static Slab *slab_of(Table *tb) {
+    if (! tb->slab)
+        tb->slab = slab_new(tb->name, &(tb->tb_mutex));
+    return tb->slab;
+}
+
+/*
+ * allocate a node and room for a `len' byte tuple for persistent table
+ * `tb'; called with tb->tb_mutex held
+ *
+ * returns NULL if out of memory
+ */
+static Node *heap_node(Table *tb, int len) {
+    Slab *s = slab_of(tb);
+    Node *n;
+
+    if (! s || ! (n = (Node *)slab_alloc(s, sizeof(Node))))
+        return NULL;
+    n->alloc_len = (unsigned short)slab_size(len);
+    if (! (n->tuple = (unsigned char *)slab_alloc(s, len))) {
+        slab_free(s, n, sizeof(Node));
+        return NULL;
     }
-    /*
-     * at this point, we have a node (n) and nextT points at location in
-     * buffer big enough to hold the tuple
-     */
-    t = nextT;
-    nextT += alloc_len;		/* now point at next free location */
-    nbytes += alloc_len;	/* update the bytes in use counter */
-    n->parent = tb;		/* fill in node member data */
+    return n;
+}
+
+/*
+ * return node `n' of persistent table `tb', and its tuple, to the pools
+ */
+static void heap_free(Table *tb, Node *n) {
+    slab_free(tb->slab, n->tuple, n->alloc_len);
+    slab_free(tb->slab, n, sizeof(Node));
+}
+
+/*
+ * mb_restore_tuple - add the encoded tuple `tuple' of `len' bytes to `tb',
+ * stamped `ts', e.g. when loading a checkpoint; stream tables keep it in
+ * their region, persistent tables on the heap
+ *
+ * `tuple' holds the text of every column; the text of dictionary-encoded
+ * columns is interned
+ *
+ * return 1 if successful, 0 if not
+ */
+int mb_restore_tuple(Table *tb, unsigned char *tuple, int len, tstamp_t ts) {
+    union Tuple buf;
+    unsigned short alloc_len;
+    Node *n;
+
+    if (tb->dict) {
+        if ((len = tuple_intern(tb, tuple, buf.bytes, sizeof(buf))) < 0 ||
+                (size_t)len > sizeof(buf))
+            return 0;
+        tuple = buf.bytes;
+    }
+    alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
+
+    if (! table_persistent(tb)) {
+        Region *r = region_of(tb);
+        unsigned long seq;
+        (void) pthread_mutex_lock(&(r->mutex));
+        if (! (n = reserve(r, tb, alloc_len, &seq))) {
+            (void) pthread_mutex_unlock(&(r->mutex));
+            return 0;
+        }
+        n->tstamp = ts;
+        memcpy(n->tuple, tuple, len);
+        publish(r, n, len, seq);
+        (void) pthread_mutex_unlock(&(r->mutex));
+        return 1;
+    }
+    (void) pthread_mutex_lock(&(tb->tb_mutex));
+    if (! (n = heap_node(tb, len))) {
+        (void) pthread_mutex_unlock(&(tb->tb_mutex));
+        return 0;
+    }
+    memcpy(n->tuple, tuple, len);
     n->next = NULL;
-    n->prev = NULL;
-    n->younger = NULL;
-    n->alloc_len = alloc_len;
     n->real_len = (unsigned short)len;
-    n->tuple = t;
-    (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
-    ts = timeval_to_timestamp(&tv);
     n->tstamp = ts;
-    p = (union Tuple *)t;
-    t += ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++) {
-        p->ptrs[i] = (char *)t;
-        s = (unsigned char *)vals[i];
-        while ((*t++ = *s++))
-            ;
-    }
-    append2LL(n, firstN, lastN, lastN->younger, nnodes);
-    (void) pthread_mutex_lock(&(tb->tb_mutex));
-    if ((tb->count)++) {	/* list was not empty */
+    if ((tb->count)++) { /* list was not empty */
         tb->newest->next = n;
         n->prev = tb->newest;
         tb->newest = n;
     } else {
+        n->prev = NULL;
         tb->newest = n;
         tb->oldest = n;
     }
+    table_index_add(tb, n);
     (void) pthread_mutex_unlock(&(tb->tb_mutex));
-    (void) pthread_mutex_unlock(&mutex);
+    return 1;
+}
 
-    return ts;
+/*
+ * mb_restore_chunk - add the `len' byte chunk `chunk', stamped `ts', to
+ * compressed table `tb', e.g. when loading a checkpoint
+ *
+ * return 1 if successful, 0 if not
+ */
+int mb_restore_chunk(Table *tb, unsigned char *chunk, int len, tstamp_t ts) {
+    Region *r = region_of(tb);
+    unsigned long seq;
+    Node *n;
+
+    if (len > CHUNK_MAX)
+        return 0;
+    (void) pthread_mutex_lock(&(r->mutex));
+    if (! (n = reserve(r, tb, ((len - 1) / ALIGNMENT + 1) * ALIGNMENT,
+                       &seq))) {
+        (void) pthread_mutex_unlock(&(r->mutex));
+        return 0;
+    }
+    n->tstamp = ts;
+    memcpy(n->tuple, chunk, len);
+    publish(r, n, len, seq);
+    (void) pthread_mutex_unlock(&(r->mutex));
+    return 1;
 }
 
-tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
+/*
+ * mb_region_limits - return the quota and row limit with which the region
+ * of `tb' was created; both are 0 if `tb' uses the shared region
+ */
+void mb_region_limits(Table *tb, long long *quota, long long *rows) {
+    *quota = (tb->region) ? tb->region->size : 0;
+    *rows = (tb->region) ? tb->region->maxrows : 0;
+}
 
-    Node *n;
-    struct timeval tv;
-    tstamp_t ts;
+/*
+ * return the timestamp of the newest row held by node `t' of `tb'
+ */
+static tstamp_t newest_row(Table *tb, Node *t) {
+    return (tb->chunks) ? ((CHeader *)(t->tuple))->newest : t->tstamp;
+}
 
+/*
+ * expire the rows of the tables in `r' that are older than their ttl at
+ * `now', stopping at any that a snapshot may visit, then reclaim the space
+ * of the expired nodes that are now the oldest in the region
+ */
+static void expire_region(Region *r, tstamp_t now) {
+    Table *tb;
+    Node *t;
     int i;
 
-    unsigned char *t, *s, *buf;
-    union Tuple *p;
+    (void) pthread_mutex_lock(&(r->mutex));
+    for (i = 0; i < r->nowners; i++) {
+        tb = r->owners[i];
+        while (tb->ttl && (t = tb->oldest) && newest_row(tb, t) < now &&
+               now - newest_row(tb, t) > tb->ttl && ! pinned(r, t)) {
+            evict(tb, t);
+            t->owner = EXPIRED;
+            r->expired++;
+            r->lingering += ALIGNED_NODE_SIZE + t->alloc_len;
+        }
+    }
+    while ((t = r->firstN) && t->owner == EXPIRED && ! pinned(r, t))
+        (void) free_node(r);
+    (void) pthread_mutex_unlock(&(r->mutex));
+}
 
-    unsigned short alloc_len;
-    int len = ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++)
-        len += strlen(vals[i]) + 1;
-    alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
+/*
+ * body of the expiry thread
+ */
+static void *do_expire(__attribute__ ((unused)) void *arg) {
+    struct timeval tv;
+    tstamp_t now;
+    Region *r;
 
-    buf = malloc(alloc_len);
-    if (!buf) {
-        printf("Out of memory\n");
-        return (tstamp_t)0;
-    };
-    if (! (n = node)) {
-        n = malloc(sizeof(Node));
-        if (!n) {
-            printf("Out of memory\n");
-            free(buf);
-            return (tstamp_t)0;
-        }
+    for (;;) {
+        (void) sleep(EXPIRY_INTERVAL);
+        (void) gettimeofday(&tv, NULL);
+        now = timeval_to_timestamp(&tv);
+        (void) pthread_mutex_lock(&rlist_mutex);
+        for (r = regions; r; r = r->next)
+            expire_region(r, now);
+        (void) pthread_mutex_unlock(&rlist_mutex);
     }
+    return NULL;
+}
 
-    p = (union Tuple *) buf;
-    t = buf + ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++) {
-        p->ptrs[i] = (char *) t;
-        s = (unsigned char *) vals[i];
-        while ((*t++ = *s++))
-            ;
+/*
+ * mb_ttl - expire the rows of stream table `tb' once they are older than
+ * `ttl', starting the expiry thread if this is the first table to have one
+ *
+ * return 1 if successful, 0 if not
+ */
+int mb_ttl(Table *tb, tstamp_t ttl) {
+    pthread_t thr;
+
+    if (table_persistent(tb)) {
+        errorf("only stream tables can have a ttl\n");
+        return 0;
     }
+    (void) pthread_mutex_lock(&rlist_mutex);
+    if (ttl && ! expiring) {
+        if (pthread_create(&thr, NULL, do_expire, NULL) != 0) {
+            (void) pthread_mutex_unlock(&rlist_mutex);
+            errorf("unable to start the expiry thread\n");
+            return 0;
+        }
+        (void) pthread_detach(thr);
+        expiring = 1;
+    }
+    (void) pthread_mutex_unlock(&rlist_mutex);
+    mb_lock(tb);
+    tb->ttl = ttl;
+    mb_unlock(tb);
+    return 1;
+}
 
-    (void) pthread_mutex_lock(&mutex);
+/*
+ * insert a row into persistent table `tb'; if `node' is not NULL, it is
+ * the row with the same primary key, which is replaced - its tuple is
+ * rewritten in place if the new one needs the same size of allocation
+ *
+ * the key is looked up again once the table is locked, since another
+ * thread may have inserted or removed its row after `node' was found; if
+ * a row has appeared where `node' was NULL, the insert fails
+ *
+ * the tuple is encoded before the table is locked, so that a value which
+ * cannot be interned fails the insert without touching the old row
+ */
+tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
+
+    Node *n;
+    struct timeval tv;
+    tstamp_t ts;
+    unsigned char *t = NULL;
+    int len = tuple_length(tb, ncols, vals);
+    unsigned char tmp[MAX_TUPLE_SIZE], *enc = tmp;
+
+    if (len > MAX_TUPLE_SIZE && ! (enc = (unsigned char *)malloc(len))) {
+        errorf("unable to allocate %d bytes for tuple\n", len);
+        return (tstamp_t)0;
+    }
+    if (! tuple_encode(tb, ncols, vals, enc)) {
+        errorf("unable to add row to %s\n", tb->name);
+        ts = (tstamp_t)0;
+        goto out;
+    }
     (void) pthread_mutex_lock(&(tb->tb_mutex));
-    if (node) {	/* must remove node from list & return previous tuple */
+    n = table_lookup_key(tb, vals[table_key(tb)]);
+    if (n && ! node) {
+        (void) pthread_mutex_unlock(&(tb->tb_mutex));
+        ts = (tstamp_t)0;
+        goto out;
+    }
+    if (n) {	/* must remove node from list & replace its tuple */
+        if (slab_size(len) != n->alloc_len &&
+                ! (t = (unsigned char *)slab_alloc(tb->slab, len))) {
+            (void) pthread_mutex_unlock(&(tb->tb_mutex));
+            printf("Out of memory\n");
+            ts = (tstamp_t)0;
+            goto out;
+        }
         /* remove node from list */
-        if (tb->oldest == tb->newest) { /* == node */
+        if (tb->oldest == tb->newest) { /* == n */
             tb->oldest = NULL;
             tb->newest = NULL;
-        } else if (tb->oldest == node) {
-            tb->oldest = node->next;
-            node->next->prev = NULL;
-        } else if (tb->newest == node) {
-            tb->newest = node->prev;
-            node->prev->next = NULL;
+        } else if (tb->oldest == n) {
+            tb->oldest = n->next;
+            n->next->prev = NULL;
+        } else if (tb->newest == n) {
+            tb->newest = n->prev;
+            n->prev->next = NULL;
         } else {
-            node->prev->next = node->next;
-            node->next->prev = node->prev;
+            n->prev->next = n->next;
+            n->next->prev = n->prev;
         }
         --tb->count;
 
-        free(node->tuple);
+        table_index_remove(tb, n);
+        if (t) {	/* a different size, so not rewritten in place */
+            slab_free(tb->slab, n->tuple, n->alloc_len);
+            n->tuple = t;
+            n->alloc_len = (unsigned short)slab_size(len);
+        }
+    } else if (! (n = heap_node(tb, len))) {
+        (void) pthread_mutex_unlock(&(tb->tb_mutex));
+        printf("Out of memory\n");
+        ts = (tstamp_t)0;
+        goto out;
     }
+    memcpy(n->tuple, enc, len);
     /* fill in node member data */
-    n->parent = tb;
     n->next = NULL;
     n->prev = NULL;
-    n->younger = NULL;
-    n->alloc_len = alloc_len;
     n->real_len = (unsigned short) len;
-    n->tuple = buf;
     (void) gettimeofday(&tv, NULL); /* timestamp the tuple */
     ts = timeval_to_timestamp(&tv);
     n->tstamp = ts;
@@ -442,66 +975,47 @@ tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
         tb->newest = n;
         tb->oldest = n;
     }
+    table_index_add(tb, n);
+    wal_put(tb, ts, ncols, vals);
     (void) pthread_mutex_unlock(&(tb->tb_mutex));
-    (void) pthread_mutex_unlock(&mutex);
+out:
+    if (enc != tmp)
+        free(enc);
     return ts;
 }
 
+/*
+ * allocate and fill in a node for a row of persistent table `tb'; must be
+ * called with the table locked
+ */
 Node *heap_alloc_node(int ncols, char *vals[], Table *tb) {
 
     Node *n;
     struct timeval tv;
 
-    int i;
-
-    unsigned char *t, *s;
-    union Tuple *p;
-
-    unsigned short alloc_len;
-    int len = ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++)
-        len += strlen(vals[i]) + 1;
-    alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
+    int len = tuple_length(tb, ncols, vals);
 
-    n = malloc(sizeof(Node));
-    if (!n) {
+    if (! (n = heap_node(tb, len))) {
         printf("Out of memory\n");
         return NULL;
     }
-    t = malloc(alloc_len);
-    if (!t) {
-        printf("Out of memory\n");
-        free(n);
-        return NULL;
-    };
 
     /* fill in node member data */
-    n->parent = tb;
     n->next = NULL;
     n->prev = NULL;
-    n->younger = NULL;
-    n->alloc_len = alloc_len;
     n->real_len = (unsigned short) len;
-    n->tuple = t;
     (void) gettimeofday(&tv, NULL); /* timestamp the tuple */
     n->tstamp = timeval_to_timestamp(&tv);
 
-    p = (union Tuple *) t;
-    t += ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++) {
-        p->ptrs[i] = (char *) t;
-        s = (unsigned char *) vals[i];
-        while ((*t++ = *s++))
-            ;
+    if (! tuple_encode(tb, ncols, vals, n->tuple)) {
+        heap_free(tb, n);
+        return NULL;
     }
     return n;
 }
 
 void heap_remove_node(Node *n, Table *tn) {
 
-    union Tuple *p;
-
-    p = (union Tuple *)(n->tuple);
     /* remove n from list */
     if (tn->oldest == tn->newest) { /* == n */
         tn->oldest = NULL;
@@ -518,20 +1032,99 @@ void heap_remove_node(Node *n, Table *tn) {
     }
     --tn->count;
 
-    free(p);
-    free(n);
+    table_index_remove(tn, n);
+    wal_delete(tn, tuple_column(tn, n->tuple, tn->primary_column));
+    heap_free(tn, n);
+}
+
+/*
+ * lock `tb' against inserts and evictions; a stream table is changed under
+ * the lock of its region, so that is taken before the table lock
+ */
+void mb_lock(Table *tb) {
+    if (! table_persistent(tb))
+        (void) pthread_mutex_lock(&(region_of(tb)->mutex));
+    (void) pthread_mutex_lock(&(tb->tb_mutex));
+}
+
+void mb_unlock(Table *tb) {
+    (void) pthread_mutex_unlock(&(tb->tb_mutex));
+    if (! table_persistent(tb))
+        (void) pthread_mutex_unlock(&(region_of(tb)->mutex));
+}
+
+/*
+ * register snapshot `s' of stream table `tb', keeping every node stamped at
+ * or after `since' from being recycled; must be called with mb_lock() held
+ */
+void mb_snapshot_take(Table *tb, Snapshot *s, tstamp_t since) {
+    Region *r = region_of(tb);
+    s->since = since;
+    s->next = r->snaps;
+    r->snaps = s;
+}
+
+/*
+ * move snapshot `s' of `tb' on to the node stamped `since', which must not
+ * be older than the one it was taken at, waking any writers waiting to
+ * recycle the nodes it no longer needs
+ */
+void mb_snapshot_advance(Table *tb, Snapshot *s, tstamp_t since) {
+    Region *r = region_of(tb);
+    (void) pthread_mutex_lock(&(r->mutex));
+    s->since = since;
+    (void) pthread_cond_broadcast(&(r->released));
+    (void) pthread_mutex_unlock(&(r->mutex));
+}
+
+/*
+ * release snapshot `s' of `tb', waking any writers waiting to recycle nodes
+ */
+void mb_snapshot_release(Table *tb, Snapshot *s) {
+    Region *r = region_of(tb);
+    Snapshot **p;
+    (void) pthread_mutex_lock(&(r->mutex));
+    for (p = &(r->snaps); *p; p = &((*p)->next))
+        if (*p == s) {
+            *p = s->next;
+            break;
+        }
+    (void) pthread_cond_broadcast(&(r->released));
+    (void) pthread_mutex_unlock(&(r->mutex));
+}
+
+static void dump_region(Region *r) {
+    long bnodes, total, unused, gap;
+    (void) pthread_mutex_lock(&(r->mutex));
+    bnodes = r->nnodes * ALIGNED_NODE_SIZE;
+    total = r->nbytes + bnodes;
+    unused = r->size - total;
+    if (r->name)
+        printf("region for table %s, %ld bytes", r->name, r->size);
+    else
+        printf("shared region, %ld bytes", r->size);
+    if (r->maxrows)
+        printf(", %ld rows", r->maxrows);
+    printf("\n");
+    printf("bytes used for tuples = %ld\n", r->nbytes);
+    printf("bytes used for %ld nodes = %ld\n", r->nnodes, bnodes);
+    printf("average bytes per tuple = %.2f\n",
+           (r->nnodes) ? (double)total / (double)r->nnodes : 0.0);
+    printf("unused bytes in table %ld (%.1f%% used)\n", unused,
+           100.0 * (double)total / (double)r->size);
+    gap = (r->wrap) ? (long)(r->mb + r->size - r->wrap) : 0L;
+    printf("wasted bytes = %ld (%ld at the end of the last pass, %ld in expired rows)\n",
+           gap + r->lingering, gap, r->lingering);
+    printf("completed passes through the circular buffer %ld\n", r->passes);
+    printf("rows expired by ttl %ld\n", r->expired);
+    (void) pthread_mutex_unlock(&(r->mutex));
 }
 
 void mb_dump() {
-    long bnodes, total, unused;
-    (void) pthread_mutex_lock(&mutex);
-    bnodes = nnodes * ALIGNED_NODE_SIZE;
-    total = nbytes + bnodes;
-    unused = MB_SIZE - total;
-    printf("bytes used for tuples = %ld\n", nbytes);
-    printf("bytes used for %ld nodes = %ld\n", nnodes, bnodes);
-    printf("average bytes per tuple = %.2f\n", (double)total / (double)nnodes);
-    printf("unused bytes in table %ld\n", unused);
-    printf("completed passes through the circular buffer %ld\n", passes);
-    (void) pthread_mutex_unlock(&mutex);
+    Region *r;
+    (void) pthread_mutex_lock(&rlist_mutex);
+    for (r = regions; r; r = r->next)
+        dump_region(r);
+    (void) pthread_mutex_unlock(&rlist_mutex);
+    slab_dump();
 }
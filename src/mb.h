@@ -39,15 +39,53 @@
 #include "table.h"
 #include "timestamp.h"
 
-void mb_init();
+typedef struct region Region;	/* a circular buffer region */
+
+/*
+ * a reader's snapshot of a stream table; while it is registered, no node
+ * stamped at or after `since' is recycled, so the reader can walk the nodes
+ * it captured without holding any lock
+ *
+ * this holds for the nodes of every table in the region, so a reader moves
+ * `since' on with mb_snapshot_advance() at least every MB_SNAPSHOT_STEP
+ * nodes, to let writers that have caught up with it carry on
+ */
+typedef struct snapshot {
+    tstamp_t since;		/* timestamp of oldest node to be visited */
+    struct snapshot *next;	/* next snapshot registered in the region */
+} Snapshot;
+
+#define MB_SNAPSHOT_STEP 4096	/* most nodes visited before advancing */
+
+/*
+ * flags for how buffers are mapped
+ */
+#define MB_PAGES_THP 1		/* advise transparent huge pages */
+#define MB_PAGES_HUGETLB 2	/* use MAP_HUGETLB if possible */
+#define MB_PAGES_POPULATE 4	/* fault all pages in at startup */
+
+void mb_configure(long size, int policy);
+int mb_init();
+
+int mb_region_create(Table *tb, char *name, long long quota, long long rows);
 
 int mb_insert(unsigned char *buf, long len, Table *table);
 
 tstamp_t mb_insert_tuple(int ncols, char *vals[], Table *table);
 
+int mb_restore_tuple(Table *tb, unsigned char *tuple, int len, tstamp_t ts);
+int mb_restore_chunk(Table *tb, unsigned char *chunk, int len, tstamp_t ts);
+void mb_region_limits(Table *tb, long long *quota, long long *rows);
+int mb_ttl(Table *tb, tstamp_t ttl);
+
 tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *table, Node *n);
 Node *heap_alloc_node(int ncols, char *vals[], Table *table);
 void heap_remove_node(Node *n, Table *tn);
+void mb_lock(Table *tb);
+void mb_unlock(Table *tb);
+void mb_snapshot_take(Table *tb, Snapshot *s, tstamp_t since);
+void mb_snapshot_advance(Table *tb, Snapshot *s, tstamp_t since);
+void mb_snapshot_release(Table *tb, Snapshot *s);
 void mb_dump();
 
 #endif /* _MB_H_ */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mbbench - measures how insertion into the memory buffer scales as
+ * threads are added
+ *
+ * usage: ./mbbench [-t max-threads] [-n inserts-per-thread] [-r shared|private]
+ *
+ * for 1, 2, 4, ... max-threads threads, each thread inserts tuples shaped
+ * like those of the Flows table into a table of its own; with -r shared
+ * (the default) all of the tables live in the shared region, with
+ * -r private each table is given a region of its own
+ *
+ * inserts into the shared region take its one mutex only to reserve space
+ * and to link the node, while the tuple is encoded and copied outside it;
+ * those into private regions do not contend at all.  on a machine with a
+ * single core neither can be expected to scale
+ */
+#include "mb.h"
+#include "table.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define USAGE "./mbbench [-t max-threads] [-n inserts-per-thread] [-r shared|private]"
+#define NCOLS 7
+#define PRIVATE_QUOTA (64LL * 1024LL * 1024LL)
+
+static char *colnames[NCOLS] = {"proto", "saddr", "sport", "daddr", "dport",
+                                "npkts", "nbytes"};
+static long ninserts = 1000000L;
+
+static void *inserter(void *arg) {
+    Table *tb = (Table *)arg;
+    char proto[8], sport[8], dport[8], npkts[16], nbytes[16];
+    char *vals[NCOLS];
+    long i;
+
+    vals[0] = proto;
+    vals[1] = "192.168.1.64";
+    vals[2] = sport;
+    vals[3] = "10.20.30.40";
+    vals[4] = dport;
+    vals[5] = npkts;
+    vals[6] = nbytes;
+    for (i = 0; i < ninserts; i++) {
+        sprintf(proto, "%ld", (i & 1) ? 6L : 17L);
+        sprintf(sport, "%ld", 1024 + i % 60000);
+        sprintf(dport, "%ld", 80 + i % 8);
+        sprintf(npkts, "%ld", i % 1000);
+        sprintf(nbytes, "%ld", 1500 * (i % 1000));
+        (void) mb_insert_tuple(NCOLS, vals, tb);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int *coltypes[NCOLS];
+    int maxthreads = 8, isprivate = 0;
+    int i, j, nthreads;
+    pthread_t *thr;
+    Table **tbl;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-t") == 0)
+            maxthreads = atoi(argv[j]);
+        else if (strcmp(argv[i], "-n") == 0)
+            ninserts = atol(argv[j]);
+        else if (strcmp(argv[i], "-r") == 0)
+            isprivate = (strcmp(argv[j], "private") == 0);
+        else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+            exit(1);
+        }
+        i = j + 1;
+    }
+    if (maxthreads < 1 || ninserts < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    for (i = 0; i < NCOLS; i++)
+        coltypes[i] = (i == 1 || i == 3) ? PRIMTYPE_VARCHAR : PRIMTYPE_INTEGER;
+    if (! mb_init()) {
+        fprintf(stderr, "unable to initialize the memory buffer\n");
+        exit(1);
+    }
+    thr = (pthread_t *)malloc(maxthreads * sizeof(pthread_t));
+    tbl = (Table **)malloc(maxthreads * sizeof(Table *));
+    for (i = 0; i < maxthreads; i++) {
+        char name[32];
+        tbl[i] = table_new(NCOLS, colnames, coltypes);
+        table_tabletype(tbl[i], 0, -1);
+        sprintf(name, "Flows%d", i);
+        if (isprivate && ! mb_region_create(tbl[i], name, PRIVATE_QUOTA, 0)) {
+            fprintf(stderr, "unable to create region for %s\n", name);
+            exit(1);
+        }
+    }
+    printf("%ld inserts per thread, %s regions\n", ninserts,
+           (isprivate) ? "private" : "shared");
+    for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+        tstamp_t start, finish;
+        double secs;
+
+        start = timestamp_now();
+        for (i = 0; i < nthreads; i++)
+            pthread_create(&thr[i], NULL, inserter, tbl[i]);
+        for (i = 0; i < nthreads; i++)
+            pthread_join(thr[i], NULL);
+        finish = timestamp_now();
+        secs = (double)(finish - start) / 1.0e9;
+        printf("%2d threads: %10.0f inserts/s, %10.0f inserts/s/thread\n",
+               nthreads, (double)(nthreads * ninserts) / secs,
+               (double)ninserts / secs);
+    }
+    return 0;
+}
@@ -41,13 +41,13 @@
 typedef struct node {
     struct node *next;		/* link to next node in the table */
     struct node *prev;		/* link to previous node in the table */
-    struct node *younger;	/* link to next younger node */
-    unsigned char *tuple;	/* pointer to Tuple in circ buffer */
-    unsigned short alloc_len;	/* bytes allocated for tuple in circ buffer */
-    unsigned short real_len;	/* actual lengthof the tuple in bytes */
-    struct table *parent;	/* table to which node belongs */
+    unsigned char *tuple;	/* pointer to Tuple, which follows the node
+                                   in a circ buffer */
     tstamp_t tstamp;		/* timestamp when entered into database
                                    nanoseconds since epoch */
+    unsigned short alloc_len;	/* bytes allocated for tuple */
+    unsigned short real_len;	/* actual lengthof the tuple in bytes */
+    unsigned short owner;	/* index of table in its region (see mb.c) */
 } Node;
 
 #endif /* _NODE_H_ */
@@ -48,16 +48,16 @@
 #include "gram.h"
 
 #include "mb.h"
+#include "wal.h"
 
 #include <string.h>
 #include <sys/time.h>
 #include <stdlib.h>
 
-#define set_dropped(node) {\
-	(node)->tstamp |= DROPPED; }
-#define clr_dropped(node) {\
-	(node)->tstamp &= ~DROPPED; }
-#define is_dropped(node) ((node)->tstamp & DROPPED)
+/*
+ * initial size of a selection vector
+ */
+#define SEL_INITIAL 1024
 
 Nodecrawler *nodecrawler_new(Node *first, Node *last) {
     Nodecrawler *nc;
@@ -67,6 +67,10 @@ Nodecrawler *nodecrawler_new(Node *first, Node *last) {
     nc->last = last;
     nc->current = first;
     nc->empty = 0; /*false*/
+    nc->table = NULL;
+    nc->sel = NULL;
+    nc->nsel = 0;
+    nc->pos = 0;
 
     if (!first && !last) {
         debugvf("Nodecrawler: empty list!\n");
@@ -76,23 +80,11 @@ Nodecrawler *nodecrawler_new(Node *first, Node *last) {
     return nc;
 }
 
-static void nodecrawler_reset(Nodecrawler *nc, Table *tbl) {
-    nc->first = tbl->oldest;
-    nc->last = tbl->newest;
-    nc->current = tbl->oldest;
-    nc->empty = 0; /* false */
-
-    if (!nc->first && !nc->last) {
-        debugvf("Nodecrawler: empty list!\n");
-        nc->empty = 1; /*true*/
-    }
-    return;
-}
-
 Nodecrawler *nodecrawler_new_from_window(Table *tbl, sqlwindow *win) {
     Nodecrawler *nc;
 
     nc = nodecrawler_new(tbl->oldest, tbl->newest);
+    nc->table = tbl;
 
     nodecrawler_apply_window(nc, win);
 
@@ -100,6 +92,7 @@ Nodecrawler *nodecrawler_new_from_window(Table *tbl, sqlwindow *win) {
 }
 
 void nodecrawler_free(Nodecrawler *nc) {
+    free(nc->sel);
     free(nc);
 }
 
@@ -203,6 +196,65 @@ static Node *first_forward(int op, Nodecrawler *nc, tstamp_t then) {
     return ans;
 }
 
+/*
+ * binary search the time index of the table for the node at which to
+ * start looking for the window boundary; for GREATER and GREATEREQ this is
+ * the youngest indexed node that does not satisfy "tstamp op then", for
+ * LESS and LESSEQ the oldest indexed node that does not satisfy it
+ *
+ * returns NULL if no indexed node fails the test
+ */
+static Node *indexed_start(int op, Table *tn, tstamp_t then) {
+    int lo = 0, hi = tn->tcount, mid;
+
+    if (op == GREATER || op == GREATEREQ) {
+        while (lo < hi) {	/* index fails the test, then satisfies it */
+            mid = (lo + hi) / 2;
+            if (compts(op, table_tentry(tn, mid)->tstamp, then))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return (lo > 0) ? table_tentry(tn, lo - 1)->node : NULL;
+    } else {
+        while (lo < hi) {	/* index satisfies the test, then fails it */
+            mid = (lo + hi) / 2;
+            if (compts(op, table_tentry(tn, mid)->tstamp, then))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return (lo < tn->tcount) ? table_tentry(tn, lo)->node : NULL;
+    }
+}
+
+/*
+ * as first_backward/first_forward, but starts from the node found in the
+ * time index, so at most TT_TIME_STRIDE nodes are visited
+ */
+static Node *first_indexed(int op, Nodecrawler *nc, tstamp_t then) {
+    Node *tmp;
+
+    if (op == GREATER || op == GREATEREQ) {
+        if (! compts(op, nc->last->tstamp, then))
+            return NULL;
+        tmp = indexed_start(op, nc->table, then);
+        if (! tmp || tmp->tstamp < nc->first->tstamp)
+            tmp = nc->first;
+        while (! compts(op, tmp->tstamp, then))
+            tmp = tmp->next;
+    } else {
+        if (! compts(op, nc->first->tstamp, then))
+            return NULL;
+        tmp = indexed_start(op, nc->table, then);
+        if (! tmp || tmp->tstamp > nc->last->tstamp)
+            tmp = nc->last;
+        while (! compts(op, tmp->tstamp, then))
+            tmp = tmp->prev;
+    }
+    return tmp;
+}
+
 /*
  * locates first tuple in the table that satisfies "Node->tstamp op then"
  *
@@ -212,6 +264,8 @@ static Node *first_tuple(int op, Nodecrawler *nc, tstamp_t then) {
 
     if (nc->empty)
         return NULL;
+    if (nc->table && nc->table->tcount > 0)
+        return first_indexed(op, nc, then);
     if (op == GREATER || op == GREATEREQ)
         return first_backward(op, nc, then);
     else
@@ -264,17 +318,21 @@ void nodecrawler_apply_intervalwindow(Nodecrawler *nc, sqlwindow *win) {
     nodecrawler_set_to_start(nc);
 }
 
-void nodecrawler_apply_timewindow(Nodecrawler *nc, sqlwindow *win) {
+/*
+ * compute in `*then' the oldest timestamp that fits into time window `win'
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+int nodecrawler_time_bound(sqlwindow *win, tstamp_t *then) {
     struct timeval now;
-    Node *tmp;
     int units;
     int ifmillis = 0;
-    tstamp_t nowts, thents;
+    tstamp_t nowts;
 
     /* Get current time */
     if (gettimeofday(&now, NULL) != 0) {
         errorf("gettimeofday() failed. Unable to apply time window\n");
-        return;
+        return 0;
     }
     nowts = timeval_to_timestamp(&now);
 
@@ -305,12 +363,21 @@ void nodecrawler_apply_timewindow(Nodecrawler *nc, sqlwindow *win) {
 
     default:
         errorf("Unknown unit format in nodecrawler_apply_timewindow");
-        return;
+        return 0;
         break;
 
     }
 
-    thents = timestamp_sub_incr(nowts, units, ifmillis);
+    *then = timestamp_sub_incr(nowts, units, ifmillis);
+    return 1;
+}
+
+void nodecrawler_apply_timewindow(Nodecrawler *nc, sqlwindow *win) {
+    Node *tmp;
+    tstamp_t thents;
+
+    if (! nodecrawler_time_bound(win, &thents))
+        return;
 
     /* find first tuple in the list that fits in the window */
     tmp = first_tuple(GREATEREQ, nc, thents);
@@ -368,88 +435,12 @@ void nodecrawler_apply_window(Nodecrawler *nc, sqlwindow *win) {
 
 }
 
-static int compare(int op, void *cVal, int *cType, union filterval *filVal) {
-    if (cType == PRIMTYPE_INTEGER) {
-        long long val = strtoll((char *)cVal, NULL, 10);
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (val == filVal->intv);
-            break;
-        case SQL_FILTER_GREATER:
-            return (val > filVal->intv);
-            break;
-        case SQL_FILTER_LESS:
-            return (val < filVal->intv);
-            break;
-        case SQL_FILTER_LESSEQ:
-            return (val <= filVal->intv);
-            break;
-        case SQL_FILTER_GREATEREQ:
-            return (val >= filVal->intv);
-            break;
-        }
-    } else if (cType == PRIMTYPE_REAL) {
-        double val = strtod((char *)cVal, NULL);
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (val == filVal->realv);
-            break;
-        case SQL_FILTER_GREATER:
-            return (val > filVal->realv);
-            break;
-        case SQL_FILTER_LESS:
-            return (val < filVal->realv);
-            break;
-        case SQL_FILTER_LESSEQ:
-            return (val <= filVal->realv);
-            break;
-        case SQL_FILTER_GREATEREQ:
-            return (val >= filVal->realv);
-            break;
-        }
-    } else if (cType == PRIMTYPE_VARCHAR) {
-        char *val = (char *)cVal;
-        debugvf("compare %s with %s\n", val, filVal->stringv);
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (strcmp(val, filVal->stringv) == 0);
-            break;
-        case SQL_FILTER_CONTAINS:
-            return (strstr(val, filVal->stringv) != NULL);
-            break;
-        case SQL_FILTER_NOTCONTAINS:
-            return (strstr(val, filVal->stringv) == NULL);
-            break;
-            /* implement >, < on lexicographical order */
-        }
-    } else if (cType == PRIMTYPE_TIMESTAMP) {
-        unsigned long long val = *(tstamp_t *)cVal;
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (val == filVal->tstampv);
-            break;
-        case SQL_FILTER_GREATER:
-            return (val > filVal->tstampv);
-            break;
-        case SQL_FILTER_LESS:
-            return (val < filVal->tstampv);
-            break;
-        case SQL_FILTER_LESSEQ:
-            return (val <= filVal->tstampv);
-            break;
-        case SQL_FILTER_GREATEREQ:
-            return (val >= filVal->tstampv);
-            break;
-        }
-    }
-    return 0;			/* false if we get here */
-}
-
-static char *updatevalue(int op, void *cVal, int *cType, union filterval *filVal) {
+static char *updatevalue(int op, union Value *cVal, int *cType,
+                         union filterval *filVal) {
     char r[256];
     memset(r, 0, sizeof(r));
     if (cType == PRIMTYPE_INTEGER) {
-        long long val = strtoll((char *)cVal, NULL, 10);
+        long long val = cVal->intv;
         long long new = filVal->intv;
         debugvf("update: type integer value %lld\n", val);
         switch(op) {
@@ -467,7 +458,7 @@ static char *updatevalue(int op, void *cVal, int *cType, union filterval *filVal
             break;
         }
     } else if (cType == PRIMTYPE_REAL) {
-        double val = strtod((char *)cVal, NULL);
+        double val = cVal->realv;
         double new = filVal->realv;
         debugvf("update: type real value %5.2f\n", val);
         switch(op) {
@@ -488,77 +479,70 @@ static char *updatevalue(int op, void *cVal, int *cType, union filterval *filVal
     return NULL;
 }
 
-int passed_filter(Node *n, Table *tn, int nfilters, sqlfilter **filters, int filtertype) {
-    int i;
-    char *filName;
-    union filterval filVal;
-    int filSign;
-    int colIdx;
-    void *colVal;
-    int *colType;
-    union Tuple *p = (union Tuple *)(n->tuple);
-
-    for (i = 0; i < nfilters; i++) {
-
-        filName = filters[i]->varname;
-        memcpy(&filVal, &filters[i]->value, sizeof(union filterval));
-        filSign = filters[i]->sign;
-
-        colIdx = table_lookup_colindex(tn, filName);
-        if (colIdx == -1)  { /* i.e. invalid variable name */
-            if (strcmp(filName, "timestamp") == 0) {
-                colVal = (void *)&(n->tstamp);
-                colType = PRIMTYPE_TIMESTAMP;
-            } else {
-                errorf("Invalid column name in filter: %s\n", filName);
-                return 1; /* automatically pass this filter */
-            }
-        } else {
-            colType = tn->coltype[colIdx];
-            colVal = (void *)(p->ptrs[colIdx]);
-        }
-
-        if (filtertype == SQL_FILTER_TYPE_OR) {
-
-            debugf("Filtertype in nodecrawler is OR\n");
-
-            if (compare(filSign, colVal, colType, &filVal)) {
-                return 1;
-            }
-
-        } else { /* default to AND filter */
-
-            debugf("Filtertype in nodecrawler is AND\n");
-
-            if (! compare(filSign, colVal, colType, &filVal)) {
-                return 0;
-            }
-        }
-    }
-    /* If we get here, all filters passed; or not */
-    if (filtertype == SQL_FILTER_TYPE_OR)
-        return 0;
-    return 1;
-}
-
-void nodecrawler_apply_filter(Nodecrawler *nc, Table *tn, int nfilters,
-                              sqlfilter **filters, int filtertype) {
+/*
+ * record in the selection vector of `nc' those nodes in the window (or in
+ * the current selection, if there is one) that pass the predicate; nodes
+ * are tested PREDICATE_BATCH at a time
+ */
+void nodecrawler_apply_filter(Nodecrawler *nc, Predicate *p) {
+    Node **sel;
+    long size, n, i;
+    Node *x;
+    int m;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
         return ;
     }
 
+    if (nc->sel) {	/* narrow the existing selection in place */
+        for (i = 0, n = 0; i < nc->nsel; i += PREDICATE_BATCH) {
+            m = (nc->nsel - i < PREDICATE_BATCH) ? nc->nsel - i : PREDICATE_BATCH;
+            m = predicate_batch(p, nc->sel + i, m);
+            memmove(nc->sel + n, nc->sel + i, m * sizeof(Node *));
+            n += m;
+        }
+        nc->nsel = n;
+        nodecrawler_set_to_start(nc);
+        return;
+    }
+
+    size = SEL_INITIAL;
+    if (! (sel = (Node **)malloc(size * sizeof(Node *)))) {
+        errorf("Nodecrawler: unable to allocate selection vector\n");
+        nc->empty = 1;
+        return;
+    }
+    n = 0;
     nodecrawler_set_to_start(nc);
     while(nodecrawler_has_more(nc)) {
 
-        if (!passed_filter(nc->current, tn, nfilters, filters, filtertype)) {
-            set_dropped(nc->current);
+        /* the next batch is gathered after the nodes already selected */
+        if (n + PREDICATE_BATCH > size) {
+            Node **tmp = (Node **)realloc(sel, 2 * size * sizeof(Node *));
+            if (! tmp) {
+                errorf("Nodecrawler: selection truncated at %ld nodes\n", n);
+                break;
+            }
+            sel = tmp;
+            size *= 2;
         }
-
-        nodecrawler_move_to_next(nc);
+        for (m = 0, x = nc->current; m < PREDICATE_BATCH && x; m++) {
+            sel[n + m] = x;
+            /*
+             * the values near the head of the tuple are tested once the
+             * batch is full, so start fetching them now
+             */
+            __builtin_prefetch(x->tuple);
+            __builtin_prefetch(x->tuple + 64);
+            x = (x == nc->last) ? NULL : x->next;
+        }
+        nc->current = x;
+        n += predicate_batch(p, sel + n, m);
     }
-
+    nc->sel = sel;
+    nc->nsel = n;
+    nodecrawler_set_to_start(nc);
 }
 
 void nodecrawler_set_to_start(Nodecrawler *nc) {
@@ -568,15 +552,18 @@ void nodecrawler_set_to_start(Nodecrawler *nc) {
         return ;
     }
 
-    nc->current = nc->first;
-
-    if (is_dropped(nc->current))
-        nodecrawler_move_to_next(nc);
+    if (nc->sel) {
+        nc->pos = 0;
+        nc->current = (nc->nsel > 0) ? nc->sel[0] : NULL;
+    } else
+        nc->current = nc->first;
 }
 
 int nodecrawler_has_more(Nodecrawler *nc) {
 
-    return (!nc->empty && nc->current != nc->last->next);
+    if (nc->sel)
+        return (!nc->empty && nc->pos < nc->nsel);
+    return (!nc->empty && nc->current != NULL);
 }
 
 void nodecrawler_move_to_next(Nodecrawler *nc) {
@@ -589,62 +576,50 @@ void nodecrawler_move_to_next(Nodecrawler *nc) {
     if (!nodecrawler_has_more(nc))
         return;
 
-    nc->current = nc->current->next;
-
-    while (nodecrawler_has_more(nc) && is_dropped(nc->current)) {
+    if (nc->sel) {
+        nc->pos++;
+        nc->current = (nc->pos < nc->nsel) ? nc->sel[nc->pos] : NULL;
+    } else if (nc->current == nc->last)
+        nc->current = NULL;	/* last->next may be changed by an insert */
+    else
         nc->current = nc->current->next;
-    }
 }
 
 /* NB: dangerous method if last does not follow first in chain */
-int nodecrawler_count_nondropped(Nodecrawler *nc) {
+long nodecrawler_count_selected(Nodecrawler *nc) {
     Node *tmp;
-    int count;
+    long count;
 
     if (nc->empty) {
         return 0;
     }
 
-    tmp = nc->first;
-    count = 0;
+    if (nc->sel)
+        return nc->nsel;
 
-    while (tmp != nc->last->next) {
-
-        if (! is_dropped(tmp)) {
-            count++;
-        }
+    tmp = nc->first;
+    count = 1;
 
+    while (tmp != nc->last) {
+        count++;
         tmp = tmp->next;
     }
 
     return count;
 }
 
-void nodecrawler_reset_all_dropped(Nodecrawler *nc) {
-    Node *tmp;
-
-    if (nc->empty) {
-        debugvf("Nodecrawler: empty list! (Doing nothing)\n");
-        return ;
-    }
-
-    tmp = nc->first;
-
-    while (tmp != nc->last->next) {
-        clr_dropped(tmp);
-        tmp = tmp->next;
-    }
-}
-
+/*
+ * project the columns of `results' from the selected nodes, appending the
+ * rows to those already in `results'
+ */
 void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results) {
-    LinkedList *rowlist;
-    Rrow *r;
+    Rrow *r, **rows;
     int i;
     char *colname;
     int colIdx;
     int len;
-    union Tuple *p;
-    long dummyLen;
+    char *p;
+    long n;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
@@ -653,7 +628,16 @@ void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results) {
 
     debugvf("Nodecrawler: Projecting columns\n");
 
-    rowlist = ll_create();
+    n = nodecrawler_count_selected(nc);
+    if (! n)
+        return;
+    rows = (Rrow **)realloc(results->rows,
+                            (results->nrows + n) * sizeof(Rrow *));
+    if (! rows) {
+        errorf("Nodecrawler: unable to allocate %ld rows\n", n);
+        return;
+    }
+    results->rows = rows;
     nodecrawler_set_to_start(nc);
     while (nodecrawler_has_more(nc)) {
         /* Extract data from tuple */
@@ -668,28 +652,22 @@ void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results) {
             if (colIdx == -1)	/* was timestamp */
                 r->cols[i] = timestamp_to_string(nc->current->tstamp);
             else {
-                p = (union Tuple *)(nc->current->tuple);
-                debugvf("Sanity check: values[%d]=%s\n", colIdx,
-                        p->ptrs[colIdx]);
-                len = strlen(p->ptrs[colIdx]) + 1;
+                p = tuple_column(tn, nc->current->tuple, colIdx);
+                debugvf("Sanity check: values[%d]=%s\n", colIdx, p);
+                len = strlen(p) + 1;
                 r->cols[i] = malloc(len);
-                strcpy(r->cols[i], p->ptrs[colIdx]);
+                strcpy(r->cols[i], p);
             }
             debugvf("r->cols[%d]: %s\n", i, r->cols[i]);
         }
 
-        (void)ll_add(rowlist, r);
+        results->rows[results->nrows++] = r;
 
         nodecrawler_move_to_next(nc);
     }
-
-    /* Build array from rowlist */
-    results->nrows = (int)ll_size(rowlist);
-    results->rows = (Rrow**) ll_toArray(rowlist, &dummyLen);
-    ll_destroy(rowlist, NULL);
 }
 
-char *updatetable(sqlupdate *update, void *colVal, int *colType, int idx,
+char *updatetable(sqlupdate *update, union Value *colVal, int *colType, int idx,
                   Table *tn) {
 
     int i, j;
@@ -724,69 +702,64 @@ void nodecrawler_delete_rows(Nodecrawler *nc, Table *tn, sqldelete *delete) {
         return;
     }
     debugvf("Nodecrawler: deleting rows\n");
+    if (! nc->sel)	/* no filter, so select every node in the window */
+        nodecrawler_apply_filter(nc, NULL);
+    /* nodes are freed as we go, so only the selection may be followed */
     nodecrawler_set_to_start(nc);
     while (nodecrawler_has_more(nc)) {
-        Node *n;
-        n = nc->current;
-
-        /* remove n from list */
-        if (tn->oldest == tn->newest) {  /* singleton list, == n */
-            tn->oldest = NULL;
-            tn->newest = NULL;
-        } else if (tn->oldest == n) {
-            tn->oldest = n->next;
-            n->next->prev = NULL;
-        } else if (tn->newest == n) {
-            tn->newest = n->prev;
-            n->prev->next = NULL;
-        } else {
-            n->prev->next = n->next;
-            n->next->prev = n->prev;
-        }
-        free(n->tuple);
-        free(n);
-        --tn->count;
-
+        heap_remove_node(nc->current, tn);
         nodecrawler_move_to_next(nc);
     }
     return;
 }
 
-void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
+/*
+ * apply `update' to the selected rows of persistent table `tn'; a row
+ * that would be given the primary key of another row, or whose new tuple
+ * cannot be built, is left as it was
+ *
+ * returns 1 if every selected row was updated, 0 otherwise
+ */
+int nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
     Node *n, *u;
-    union Tuple *p;
 
     char *value;
 
     int i;
 
-    void *colVal;
+    union Value *vals;
     int *colType;
 
     LinkedList *lcols;
     int ncols;
     char **colvals;
+    int ans = 1;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
-        return;
+        return 1;
     }
     debugvf("Nodecrawler: updating columns\n");
+    if (! nc->sel)	/* no filter, so select every node in the window */
+        nodecrawler_apply_filter(nc, NULL);
+    /*
+     * each selected node is replaced by a new node at the end of the
+     * table; the new nodes are not in the selection, so are not revisited
+     */
     nodecrawler_set_to_start(nc);
     while (nodecrawler_has_more(nc)) {
         long dummyLen;
         n = nc->current;
-        p = (union Tuple *)(n->tuple);
-        debugvf("node @%p tuple @%p\n", n, p);
+        debugvf("node @%p tuple @%p\n", n, n->tuple);
         lcols = ll_create();
         if (!lcols)
-            return;
+            return 0;
+        vals = tuple_values(n->tuple, tn->ncols);
         for (i = 0; i < tn->ncols; i++) {
-            colVal = (void *)(p->ptrs[i]);
             colType = tn->coltype[i];
-            value = updatetable(update, colVal, colType, i, tn);
+            value = updatetable(update, &vals[i], colType, i, tn);
             if (!value)
-                (void)ll_add(lcols, (void *)strdup(colVal));
+                (void)ll_add(lcols, (void *)strdup(tuple_column(tn, n->tuple, i)));
             else
                 (void)ll_add(lcols, (void *)(value));
         }
@@ -797,42 +770,35 @@ void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
             ll_destroy(lcols, NULL);
             if (value)
                 free(value);
-            return;
+            return 0;
         }
         colvals = (char **) ll_toArray(lcols, &dummyLen);
         ll_destroy(lcols, NULL);
         debugvf("table count %ld\n", tn->count);
 
-        /* remove n from list */
-        if (tn->oldest == tn->newest) { /* == n */
-            tn->oldest = NULL;
-            tn->newest = NULL;
-        } else if (tn->oldest == n) {
-            tn->oldest = n->next;
-            n->next->prev = NULL;
-        } else if (tn->newest == n) {
-            tn->newest = n->prev;
-            n->prev->next = NULL;
-        } else {
-            n->prev->next = n->next;
-            n->next->prev = n->prev;
-        }
-        --tn->count;
-
-        free(p);
-        free(n);
-
-        /* insert */
-        u = heap_alloc_node(ncols, colvals, tn);
-        if ((tn->count)++) { /* list was not empty */
-            tn->newest->next = u;
-            u->prev = tn->newest;
-            tn->newest = u;
-        } else {
-            tn->newest = u;
-            tn->oldest = u;
+        /* the new key may not belong to another row */
+        u = table_lookup_key(tn, colvals[table_key(tn)]);
+        if (u && u != n) {
+            errorf("duplicate key %s in %s; row not updated\n",
+                   colvals[table_key(tn)], tn->name);
+            u = NULL;
+        } else
+            u = heap_alloc_node(ncols, colvals, tn);
+        if (! u)
+            ans = 0;
+        else {
+            heap_remove_node(n, tn);
+            if ((tn->count)++) { /* list was not empty */
+                tn->newest->next = u;
+                u->prev = tn->newest;
+                tn->newest = u;
+            } else {
+                tn->newest = u;
+                tn->oldest = u;
+            }
+            table_index_add(tn, u);
+            wal_put(tn, u->tstamp, ncols, colvals);
         }
-        set_dropped(u); /* avoid infinite loop */
 
         /* if (value)
         	free(value); `value' is free'd below */
@@ -841,19 +807,15 @@ void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
             free(colvals[i]);
         free(colvals);
 
-        /* nc->current = tn->oldest; */
-        nodecrawler_reset(nc, tn);
-
         nodecrawler_move_to_next(nc);
     }
 
-    return;
+    return ans;
 }
 
 Node *nodecrawler_find_value(Nodecrawler *nc, int key, char *value) {
 
     Node *n;
-    union Tuple *p;
     char *cv; /* Value at index 'key'. */
 
     if (nc->empty) {
@@ -865,8 +827,8 @@ Node *nodecrawler_find_value(Nodecrawler *nc, int key, char *value) {
     while(nodecrawler_has_more(nc)) {
 
         n = nc->current;
-        p = (union Tuple *)(n->tuple);
-        cv = (char *)(p->ptrs[key]);
+        cv = (nc->table) ? tuple_column(nc->table, n->tuple, key) :
+                           tuple_text(n->tuple, key);
         debugvf("In nodecrawler: value at index %d is %s\n", key, cv);
         if (strcmp(cv, value) == 0) return n;
         nodecrawler_move_to_next(nc);
@@ -34,18 +34,14 @@
  *
  * Node Crawler
  *
- * The basic idea here is to manipulate a dlist
- * of tuples, running over it and dropping tuples (Nodes) that
- * don't pass the window or filter rules.
+ * The basic idea here is to run over a dlist of tuples, narrowing it
+ * to the nodes between first and last that fit the window, and then
+ * selecting the nodes that pass the filter rules.
  *
- * The tuples that remain in the list are all ok and then
- * the columns are projected from these tuples.
- *
- * To avoid expensive duplicating of list nodes, a field "dropped"
- * was added to typedef node. When set to true, the node is considered
- * dropped. Cleanup must be done on the list resetting all of these fields.
- *
- * Note that this implies that only one crawler can work on a list at any time.
+ * The selected nodes are recorded in a selection vector owned by the
+ * crawler, and the columns are then projected from these tuples.
+ * The nodes themselves are never written, so any number of crawlers can
+ * work on a list at the same time.
  *
  * Created by Oliver Sharma on 2009-05-06
  */
@@ -56,6 +52,7 @@
 #include "sqlstmts.h"
 #include "rtab.h"
 #include "table.h"
+#include "predicate.h"
 
 
 typedef struct nodecrawler {
@@ -65,6 +62,12 @@ typedef struct nodecrawler {
     Node *last; /* last is last added (i.e newest) */
     Node *current;
     int empty;
+    Table *table; /* table being crawled, if known; gives the time index */
+
+    /* Set once a filter has been applied */
+    Node **sel; /* selected nodes, oldest first */
+    long nsel; /* number of selected nodes */
+    long pos; /* index of current in sel */
 } Nodecrawler;
 
 Nodecrawler *nodecrawler_new(Node *first, Node *last);
@@ -73,8 +76,8 @@ Nodecrawler *nodecrawler_new_from_window(Table *tbl, sqlwindow *win);
 void nodecrawler_free(Nodecrawler *nc);
 
 void nodecrawler_apply_window(Nodecrawler *nc, sqlwindow *win);
-void nodecrawler_apply_filter(Nodecrawler *nc, Table *tn, int nfilters,
-                              sqlfilter **filters, int filtertype);
+int nodecrawler_time_bound(sqlwindow *win, tstamp_t *then);
+void nodecrawler_apply_filter(Nodecrawler *nc, Predicate *p);
 
 void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results);
 
@@ -83,21 +86,20 @@ void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results);
 void nodecrawler_set_to_start(Nodecrawler *nc);
 
 
-/* returns TRUE if current node is last->next
+/* returns TRUE until current has moved past last
  */
 int nodecrawler_has_more(Nodecrawler *nc);
 
-/* Moves to next node in list where dropped is false
+/* Moves to next node in the window, or in the selection if a filter
+ * has been applied
  *
- * NB: always check with nodecrawler_not_at_end() first
+ * NB: always check with nodecrawler_has_more() first
  */
 void nodecrawler_move_to_next(Nodecrawler *nc);
 
-int nodecrawler_count_nondropped(Nodecrawler *nc);
-
-void nodecrawler_reset_all_dropped(Nodecrawler *nc);
+long nodecrawler_count_selected(Nodecrawler *nc);
 
-void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update);
+int nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update);
 
 void nodecrawler_delete_rows(Nodecrawler *nc, Table *tn, sqldelete *delete);
 
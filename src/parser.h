@@ -43,23 +43,66 @@
 #define HWDB_PARSER_H
 
 #include "sqlstmts.h"
-#include "gram.h"
+#include "adts/linkedlist.h"
 
-/* Places parsed output in externally declared global variable:
- *     sqlstmt stmt
+/*
+ * the state of one parse; each call of sql_parse has its own, so that
+ * statements can be parsed on several threads at once
  */
-void *sql_parse(char *query);
+struct sqlparser {
+    sqlstmt *stmt;		/* statement returned by the parse */
+    /* Temporary lists used while parsing */
+    /* Select */
+    LinkedList *clist;
+    LinkedList *cattriblist;
+    LinkedList *tlist;
+    LinkedList *flist;
+    LinkedList *wlist;
+    LinkedList *plist; /* pair list */
+    sqlwindow *tmpwin;
+    int tmpunit;
+    sqlfilter *tmpfilter;
+    sqlpair *tmppair;
+    int tmpvaltype;
+    char *tmpvalstr;
+    sqlexpr *where;
+    char *orderby;
+    int countstar;
+    LinkedList *grouplist;
+    sqlinterval tmpinterval;
+    /* Create */
+    char *tablename;
+    LinkedList *colnames;
+    LinkedList *coltypes;
+    short tabletype;
+    short primary_column;
+    short column;
+    long long tabquota;
+    long long tabrows;
+    short tabarchive;
+    short tabcompress;
+    long long tabttl;
+    LinkedList *dictcols; /* numbers of dictionary-encoded columns, from 1 */
+    /* Insert */
+    /* -- tablename definition from above */
+    /* -- coltypes definition from above */
+    LinkedList *colvals;
+    short transform;
+    /* dummy long for calls to ll_toArray */
+    long dummyLong;
+};
 
-void reset_statement(void);
+/* Places parsed output in `stmt', which is freed by reset_statement;
+ * returns 1 if successful, 0 if not
+ */
+int sql_parse(char *query, sqlstmt *stmt);
 
-void sql_reset_parser(void *bufstate);
+void reset_statement(sqlstmt *stmt);
 
-void sql_dup_stmt(sqlstmt *dup);
+void sql_dup_stmt(sqlstmt *stmt, sqlstmt *dup);
 
-/* Prints externally declared global variable
- *     sqlstmt stmt
- * to standard output
+/* Prints `stmt' to standard output
  */
-void sql_print();
+void sql_print(sqlstmt *stmt);
 
 #endif
@@ -0,0 +1,814 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * predicate.c - WHERE clauses compiled for the columns of a table
+ *
+ * each filter becomes a term holding the index of its column, its
+ * constant converted to the type of the column and a comparison
+ * specialized for that type and operator
+ *
+ * predicate_batch() evaluates a term over a batch of rows at a time: the
+ * values of the column are gathered into a vector, compared with the
+ * constant by a kernel that sets a bit for each row that passes, and the
+ * bitmaps of the terms are combined; the kernels use AVX2 when the CPU
+ * has it, and plain loops otherwise
+ *
+ * the filters may form a tree of ANDs, ORs and NOTs.  NOTs are pushed down
+ * to the terms, and nested ANDs (or ORs) are merged, leaving clauses that
+ * alternate between AND and OR.  the operands of each clause are tested on
+ * a sample of the rows of the table, and ordered so that those that are
+ * cheap and likely to decide the clause come first
+ */
+#include "predicate.h"
+#include "tuple.h"
+#include "dict.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PREDICATE_AVX2
+#include <immintrin.h>
+#endif
+
+typedef struct term Term;
+
+typedef int (*Test)(Term *t, Table *tn, Node *n, union Value *vals);
+
+/*
+ * how a term is evaluated over a batch: the values compared, or
+ * BATCH_ROW to run its test row by row
+ */
+#define BATCH_ROW 0
+#define BATCH_INTEGER 1	/* integer column */
+#define BATCH_MIXED 2	/* integer column, real constant */
+#define BATCH_REAL 3	/* real column */
+#define BATCH_TSTAMP 4	/* timestamp column */
+#define BATCH_WHEN 5	/* timestamp of the row */
+#define BATCH_CODE 6	/* code of a dictionary-encoded column */
+
+#define WORDS (PREDICATE_BATCH / 64)
+#define SIGN (1ULL << 63)	/* flipped to compare unsigned as signed */
+
+struct term {
+    Test test;
+    int kind;		/* BATCH_* */
+    int op;		/* SQL_FILTER_* */
+    int col;		/* index of the column, -1 for the timestamp */
+    union filterval v;	/* the constant, as the type of the column */
+    char *s;		/* the constant of a varchar column */
+    Dict *dict;		/* dictionary of the column, or NULL */
+    long code;		/* code of `s' in `dict', -1 if absent */
+    char text[32];	/* `s' when formatted from a number */
+    int negate;		/* TRUE if the result is inverted by a NOT */
+};
+
+#define CLAUSE_TERM 0
+#define CLAUSE_AND 1
+#define CLAUSE_OR 2
+
+typedef struct clause Clause;
+
+/*
+ * a term, or an AND or OR of clauses
+ */
+struct clause {
+    int type;		/* CLAUSE_* */
+    Term term;		/* CLAUSE_TERM */
+    int n;		/* number of operands of an AND or OR */
+    Clause **ops;	/* the operands, in the order they are tested */
+    double cost;	/* estimated cost of testing a row */
+    double pass;	/* fraction of the sample that passes */
+};
+
+struct predicate {
+    Table *tn;
+    Clause *root;
+};
+
+/*
+ * the rows sampled to order the operands of a clause, and the relative
+ * costs of the tests
+ */
+#define SAMPLE_ROWS 64
+#define COST_KERNEL 1.0		/* compared a batch at a time */
+#define COST_STRING 4.0		/* strcmp() of a row */
+#define COST_SEARCH 8.0		/* strstr() of a row */
+
+#define is_integer(t) ((t) == PRIMTYPE_INTEGER || (t) == PRIMTYPE_BOOLEAN || \
+                        (t) == PRIMTYPE_TINYINT || (t) == PRIMTYPE_SMALLINT)
+
+/*
+ * the comparisons of a value `x' of a row with the constant in `field';
+ * every test has the same signature, and the arguments that `x' does not
+ * use are cast to void
+ */
+#define COMPARISON(name, op, field, x) \
+static int name(Term *t, Table *tn, Node *n, union Value *vals) { \
+    (void) tn; \
+    (void) n; \
+    (void) vals; \
+    return ((x) op t->v.field); \
+}
+
+#define COMPARISONS(name, field, x) \
+COMPARISON(name##_eq, ==, field, x) \
+COMPARISON(name##_gt, >, field, x) \
+COMPARISON(name##_lt, <, field, x) \
+COMPARISON(name##_le, <=, field, x) \
+COMPARISON(name##_ge, >=, field, x) \
+static Test name##_tests[] = {NULL, name##_eq, name##_gt, name##_lt, \
+                              name##_le, name##_ge};
+
+COMPARISONS(integer, intv, vals[t->col].intv)
+COMPARISONS(mixed, realv, (double)vals[t->col].intv)
+COMPARISONS(real, realv, vals[t->col].realv)
+COMPARISONS(tstamp, tstampv, vals[t->col].tstampv)
+COMPARISONS(when, tstampv, n->tstamp)
+
+static int string_eq(Term *t, Table *tn, Node *n, union Value *vals) {
+    (void) vals;
+    return (strcmp(tuple_column(tn, n->tuple, t->col), t->s) == 0);
+}
+
+static int string_contains(Term *t, Table *tn, Node *n, union Value *vals) {
+    (void) vals;
+    return (strstr(tuple_column(tn, n->tuple, t->col), t->s) != NULL);
+}
+
+static int string_notcontains(Term *t, Table *tn, Node *n,
+                              union Value *vals) {
+    (void) vals;
+    return (strstr(tuple_column(tn, n->tuple, t->col), t->s) == NULL);
+}
+
+/*
+ * equality on a dictionary-encoded column compares codes; a constant that
+ * had not been interned when the query was compiled may have been since,
+ * so it is then compared as text
+ */
+static int code_eq(Term *t, Table *tn, Node *n, union Value *vals) {
+    if (t->code < 0)
+        return string_eq(t, tn, n, vals);
+    return (vals[t->col].dictv.code == (unsigned int)t->code);
+}
+
+static int always(Term *t, Table *tn, Node *n, union Value *vals) {
+    (void) t;
+    (void) tn;
+    (void) n;
+    (void) vals;
+    return 1;
+}
+
+static int never(Term *t, Table *tn, Node *n, union Value *vals) {
+    (void) t;
+    (void) tn;
+    (void) n;
+    (void) vals;
+    return 0;
+}
+
+/*
+ * kernels setting bit i of `bits' if "x[i] op c" for the `n' values of
+ * `x'; the bits must be clear on entry
+ */
+typedef void (*IntKernel)(int op, const long long *x, int n, long long c,
+                          uint64_t *bits);
+typedef void (*RealKernel)(int op, const double *x, int n, double c,
+                           uint64_t *bits);
+
+#define SET_BITS(from, cmp) \
+    for (i = (from); i < n; i++) \
+        bits[i >> 6] |= (uint64_t)(x[i] cmp c) << (i & 63)
+
+#define SCALAR_KERNEL(name, type) \
+static void name(int op, const type *x, int n, type c, uint64_t *bits) { \
+    int i; \
+    switch (op) { \
+    case SQL_FILTER_EQUAL: SET_BITS(0, ==); break; \
+    case SQL_FILTER_GREATER: SET_BITS(0, >); break; \
+    case SQL_FILTER_LESS: SET_BITS(0, <); break; \
+    case SQL_FILTER_LESSEQ: SET_BITS(0, <=); break; \
+    case SQL_FILTER_GREATEREQ: SET_BITS(0, >=); break; \
+    } \
+}
+
+SCALAR_KERNEL(integer_scalar, long long)
+SCALAR_KERNEL(real_scalar, double)
+
+#ifdef PREDICATE_AVX2
+/*
+ * four values at a time; the mask of a comparison has one bit per value,
+ * and the values left over are done as above
+ */
+__attribute__((target("avx2")))
+static void integer_avx2(int op, const long long *x, int n, long long c,
+                         uint64_t *bits) {
+    __m256i k = _mm256_set1_epi64x(c), ones = _mm256_set1_epi64x(-1LL);
+    __m256i v, r;
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v = _mm256_loadu_si256((const __m256i *)(x + i));
+        switch (op) {
+        case SQL_FILTER_EQUAL:
+            r = _mm256_cmpeq_epi64(v, k);
+            break;
+        case SQL_FILTER_GREATER:
+            r = _mm256_cmpgt_epi64(v, k);
+            break;
+        case SQL_FILTER_LESS:
+            r = _mm256_cmpgt_epi64(k, v);
+            break;
+        case SQL_FILTER_LESSEQ:
+            r = _mm256_xor_si256(_mm256_cmpgt_epi64(v, k), ones);
+            break;
+        default:
+            r = _mm256_xor_si256(_mm256_cmpgt_epi64(k, v), ones);
+        }
+        bits[i >> 6] |=
+            (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(r)) << (i & 63);
+    }
+    switch (op) {
+    case SQL_FILTER_EQUAL: SET_BITS(i, ==); break;
+    case SQL_FILTER_GREATER: SET_BITS(i, >); break;
+    case SQL_FILTER_LESS: SET_BITS(i, <); break;
+    case SQL_FILTER_LESSEQ: SET_BITS(i, <=); break;
+    case SQL_FILTER_GREATEREQ: SET_BITS(i, >=); break;
+    }
+}
+
+/* the predicate of _mm256_cmp_pd() must be a constant */
+#define REAL_AVX2(pred, cmp) \
+    for (i = 0; i + 4 <= n; i += 4) \
+        bits[i >> 6] |= (uint64_t)_mm256_movemask_pd( \
+            _mm256_cmp_pd(_mm256_loadu_pd(x + i), k, pred)) << (i & 63); \
+    SET_BITS(i, cmp)
+
+__attribute__((target("avx2")))
+static void real_avx2(int op, const double *x, int n, double c,
+                      uint64_t *bits) {
+    __m256d k = _mm256_set1_pd(c);
+    int i;
+
+    switch (op) {
+    case SQL_FILTER_EQUAL: REAL_AVX2(_CMP_EQ_OQ, ==); break;
+    case SQL_FILTER_GREATER: REAL_AVX2(_CMP_GT_OQ, >); break;
+    case SQL_FILTER_LESS: REAL_AVX2(_CMP_LT_OQ, <); break;
+    case SQL_FILTER_LESSEQ: REAL_AVX2(_CMP_LE_OQ, <=); break;
+    case SQL_FILTER_GREATEREQ: REAL_AVX2(_CMP_GE_OQ, >=); break;
+    }
+}
+#endif /* PREDICATE_AVX2 */
+
+static IntKernel integer_kernel = integer_scalar;
+static RealKernel real_kernel = real_scalar;
+static int simd = 0;
+static pthread_once_t dispatched = PTHREAD_ONCE_INIT;
+
+/*
+ * choose the kernels for this CPU
+ */
+static void dispatch(void) {
+#ifdef PREDICATE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        integer_kernel = integer_avx2;
+        real_kernel = real_avx2;
+        simd = 1;
+    }
+#endif /* PREDICATE_AVX2 */
+}
+
+/*
+ * convert the text `s' to a number; returns 0 if it is not one
+ */
+static int parse_integer(char *s, long long *v) {
+    char *e;
+
+    if (strcasecmp(s, "true") == 0 || strcasecmp(s, "false") == 0) {
+        *v = (strcasecmp(s, "true") == 0);
+        return 1;
+    }
+    *v = strtoll(s, &e, 10);
+    return (e != s && *e == '\0');
+}
+
+static int parse_real(char *s, double *v) {
+    char *e;
+
+    *v = strtod(s, &e);
+    return (e != s && *e == '\0');
+}
+
+/*
+ * choose the comparison of `f' for an integer column
+ */
+static Test integer_term(Term *t, sqlfilter *f) {
+    long long i;
+
+    switch (f->vtype) {
+    case SQL_VALUE_REAL:
+        t->v.realv = f->value.realv;
+        t->kind = BATCH_MIXED;
+        return mixed_tests[f->sign];
+    case SQL_VALUE_TSTAMP:
+        t->v.intv = (long long)f->value.tstampv;
+        break;
+    case SQL_VALUE_STRING:
+        if (parse_integer(f->value.stringv, &i))
+            t->v.intv = i;
+        else if (parse_real(f->value.stringv, &t->v.realv)) {
+            t->kind = BATCH_MIXED;
+            return mixed_tests[f->sign];
+        } else
+            return never;
+        break;
+    default:
+        t->v.intv = f->value.intv;
+    }
+    t->kind = BATCH_INTEGER;
+    return integer_tests[f->sign];
+}
+
+static Test real_term(Term *t, sqlfilter *f) {
+    switch (f->vtype) {
+    case SQL_VALUE_INTEGER:
+        t->v.realv = (double)f->value.intv;
+        break;
+    case SQL_VALUE_TSTAMP:
+        t->v.realv = (double)f->value.tstampv;
+        break;
+    case SQL_VALUE_STRING:
+        if (! parse_real(f->value.stringv, &t->v.realv))
+            return never;
+        break;
+    default:
+        t->v.realv = f->value.realv;
+    }
+    t->kind = BATCH_REAL;
+    return real_tests[f->sign];
+}
+
+static Test tstamp_term(Term *t, sqlfilter *f, Test *tests) {
+    switch (f->vtype) {
+    case SQL_VALUE_INTEGER:
+        t->v.tstampv = (tstamp_t)f->value.intv;
+        break;
+    case SQL_VALUE_REAL:
+        t->v.tstampv = (tstamp_t)f->value.realv;
+        break;
+    case SQL_VALUE_STRING:
+        t->v.tstampv = string_to_timestamp(f->value.stringv);
+        break;
+    default:
+        t->v.tstampv = f->value.tstampv;
+    }
+    t->kind = (t->col == -1) ? BATCH_WHEN : BATCH_TSTAMP;
+    return tests[f->sign];
+}
+
+static Test string_term(Term *t, sqlfilter *f) {
+    switch (f->vtype) {
+    case SQL_VALUE_INTEGER:
+        sprintf(t->text, "%lld", f->value.intv);
+        break;
+    case SQL_VALUE_REAL:
+        sprintf(t->text, "%g", f->value.realv);
+        break;
+    case SQL_VALUE_TSTAMP:
+        sprintf(t->text, "@%016llx@", f->value.tstampv);
+        break;
+    default:
+        t->s = f->value.stringv;
+    }
+    if (! t->s)
+        t->s = t->text;
+    switch (f->sign) {
+    case SQL_FILTER_EQUAL:
+        if (t->dict) {
+            if ((t->code = dict_lookup(t->dict, t->s)) >= 0)
+                t->kind = BATCH_CODE;
+            return code_eq;
+        }
+        return string_eq;
+    case SQL_FILTER_CONTAINS:
+        return string_contains;
+    case SQL_FILTER_NOTCONTAINS:
+        return string_notcontains;
+    }
+    return never;	/* no order on strings */
+}
+
+static Test compile(Table *tn, Term *t, sqlfilter *f) {
+    int *type;
+
+    memset(t, 0, sizeof(Term));
+    t->op = f->sign;
+    t->col = table_lookup_colindex(tn, f->varname);
+    if (t->col == -1) {
+        if (strcmp(f->varname, "timestamp") != 0) {
+            errorf("Invalid column name in filter: %s\n", f->varname);
+            return always;	/* automatically pass this filter */
+        }
+        type = PRIMTYPE_TIMESTAMP;
+    } else {
+        type = tn->coltype[t->col];
+        t->dict = (tn->dict) ? tn->dict[t->col] : NULL;
+    }
+    if (type == PRIMTYPE_VARCHAR)
+        return string_term(t, f);
+    if (f->sign < SQL_FILTER_EQUAL || f->sign > SQL_FILTER_GREATEREQ)
+        return never;
+    if (is_integer(type))
+        return integer_term(t, f);
+    if (type == PRIMTYPE_REAL)
+        return real_term(t, f);
+    if (type == PRIMTYPE_TIMESTAMP)
+        return tstamp_term(t, f, (t->col == -1) ? when_tests : tstamp_tests);
+    return never;
+}
+
+static double term_cost(Term *t) {
+    if (t->kind != BATCH_ROW)
+        return COST_KERNEL;
+    if (t->test == always || t->test == never)
+        return 0.0;
+    if (t->test == string_contains || t->test == string_notcontains)
+        return COST_SEARCH;
+    return COST_STRING;
+}
+
+static Clause *clause_new(int type) {
+    Clause *c;
+
+    if (! (c = (Clause *)calloc(1, sizeof(Clause)))) {
+        errorf("Unable to allocate predicate\n");
+        return NULL;
+    }
+    c->type = type;
+    return c;
+}
+
+static void clause_free(Clause *c) {
+    int i;
+
+    if (! c)
+        return;
+    for (i = 0; i < c->n; i++)
+        clause_free(c->ops[i]);
+    free(c->ops);
+    free(c);
+}
+
+static Clause *term_clause(Table *tn, sqlfilter *f, int negate) {
+    Clause *c;
+
+    if (! (c = clause_new(CLAUSE_TERM)))
+        return NULL;
+    c->term.test = compile(tn, &c->term, f);
+    /* an invalid column passes, with or without a NOT */
+    c->term.negate = (c->term.test != always) ? negate : 0;
+    c->cost = term_cost(&c->term);
+    return c;
+}
+
+/*
+ * add `op' to the operands of `c'; an operand of the same type as `c'
+ * gives up its own operands instead
+ */
+static int add_operand(Clause *c, Clause *op) {
+    int n = (op->type == c->type) ? op->n : 1;
+    Clause **ops;
+
+    if (! (ops = (Clause **)realloc(c->ops, (c->n + n) * sizeof(Clause *)))) {
+        errorf("Unable to allocate predicate\n");
+        clause_free(op);
+        return 0;
+    }
+    c->ops = ops;
+    if (op->type == c->type) {
+        memcpy(c->ops + c->n, op->ops, n * sizeof(Clause *));
+        op->n = 0;
+        clause_free(op);
+    } else
+        c->ops[c->n] = op;
+    c->n += n;
+    return 1;
+}
+
+/*
+ * the clause for `e', inverted if `negate'; by De Morgan, NOT (a AND b)
+ * is NOT a OR NOT b
+ */
+static Clause *expr_clause(Table *tn, sqlexpr *e, int negate) {
+    Clause *c, *op;
+    int isor;
+
+    switch (e->type) {
+    case SQL_EXPR_FILTER:
+        return term_clause(tn, e->filter, negate);
+    case SQL_EXPR_NOT:
+        return expr_clause(tn, e->left, ! negate);
+    }
+    isor = (e->type == SQL_EXPR_OR);
+    if (! (c = clause_new((isor != negate) ? CLAUSE_OR : CLAUSE_AND)))
+        return NULL;
+    if (! (op = expr_clause(tn, e->left, negate)) || ! add_operand(c, op) ||
+        ! (op = expr_clause(tn, e->right, negate)) || ! add_operand(c, op)) {
+        clause_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static int clause_test(Clause *c, Table *tn, Node *n, union Value *vals) {
+    Clause **op, **end;
+    int isor;
+
+    if (c->type == CLAUSE_TERM)
+        return (c->term.test(&c->term, tn, n, vals) != c->term.negate);
+    isor = (c->type == CLAUSE_OR);
+    for (op = c->ops, end = op + c->n; op < end; op++)
+        if (clause_test(*op, tn, n, vals) == isor)
+            return isor;	/* decided by this operand */
+    return ! isor;
+}
+
+/*
+ * up to SAMPLE_ROWS nodes spread over `tn', from its time index if it has
+ * one, or else the newest; none from a compressed table, whose nodes hold
+ * chunks
+ */
+static int sample(Table *tn, Node **rows) {
+    int i, n = 0;
+    Node *x;
+
+    if (tn->chunks)
+        return 0;
+    if (tn->tcount > 0) {
+        n = (tn->tcount < SAMPLE_ROWS) ? tn->tcount : SAMPLE_ROWS;
+        for (i = 0; i < n; i++)
+            rows[i] = table_tentry(tn, (int)((long)i * tn->tcount / n))->node;
+        return n;
+    }
+    for (x = tn->newest; x && n < SAMPLE_ROWS; x = x->prev)
+        rows[n++] = x;
+    return n;
+}
+
+/*
+ * the cost of testing an operand of an AND for each row it fails, or of
+ * an OR for each row it passes; the operands are tested in this order
+ */
+static double rank(Clause *op, int isor) {
+    double decided = (isor) ? op->pass : 1.0 - op->pass;
+
+    return op->cost / decided;
+}
+
+/*
+ * estimate how often `c' passes, from the `nrows' sampled rows, and what
+ * testing a row costs, ordering the operands of each clause by rank
+ */
+static void order(Clause *c, Table *tn, Node **rows, int nrows) {
+    double reach = 1.0;
+    int isor = (c->type == CLAUSE_OR), i, j, passed = 0;
+    Clause *op;
+
+    for (i = 0; i < c->n; i++)
+        order(c->ops[i], tn, rows, nrows);
+    for (i = 1; i < c->n; i++) {	/* insertion sort keeps ties in order */
+        op = c->ops[i];
+        for (j = i; j > 0 && rank(c->ops[j - 1], isor) > rank(op, isor); j--)
+            c->ops[j] = c->ops[j - 1];
+        c->ops[j] = op;
+    }
+    if (c->type != CLAUSE_TERM) {
+        c->cost = 0.0;
+        for (i = 0; i < c->n; i++) {
+            c->cost += reach * c->ops[i]->cost;
+            reach *= (isor) ? 1.0 - c->ops[i]->pass : c->ops[i]->pass;
+        }
+    }
+    for (i = 0; i < nrows; i++)
+        passed += clause_test(c, tn, rows[i],
+                              tuple_values(rows[i]->tuple, tn->ncols));
+    /* neither 0 nor 1, so that every rank is finite */
+    c->pass = (passed + 0.5) / (nrows + 1.0);
+}
+
+static Predicate *predicate_of(Table *tn, Clause *root) {
+    Node *rows[SAMPLE_ROWS];
+    Predicate *p;
+
+    if (! root)
+        return NULL;
+    if (! (p = (Predicate *)malloc(sizeof(Predicate)))) {
+        errorf("Unable to allocate predicate\n");
+        clause_free(root);
+        return NULL;
+    }
+    p->tn = tn;
+    p->root = root;
+    order(root, tn, rows, sample(tn, rows));
+    return p;
+}
+
+Predicate *predicate_new(Table *tn, int nfilters, sqlfilter **filters,
+                         int filtertype) {
+    Clause *c, *op;
+    int i;
+
+    if (nfilters <= 0)
+        return NULL;
+    (void) pthread_once(&dispatched, dispatch);
+    if (nfilters == 1)
+        return predicate_of(tn, term_clause(tn, filters[0], 0));
+    c = clause_new((filtertype == SQL_FILTER_TYPE_OR) ? CLAUSE_OR : CLAUSE_AND);
+    for (i = 0; c && i < nfilters; i++)
+        if (! (op = term_clause(tn, filters[i], 0)) || ! add_operand(c, op)) {
+            clause_free(c);
+            c = NULL;
+        }
+    return predicate_of(tn, c);
+}
+
+Predicate *predicate_new_expr(Table *tn, sqlexpr *where) {
+    if (! where)
+        return NULL;
+    (void) pthread_once(&dispatched, dispatch);
+    return predicate_of(tn, expr_clause(tn, where, 0));
+}
+
+void predicate_free(Predicate *p) {
+    if (p) {
+        clause_free(p->root);
+        free(p);
+    }
+}
+
+int predicate_test(Predicate *p, Node *n) {
+    if (! p)
+        return 1;
+    return clause_test(p->root, p->tn, n, tuple_values(n->tuple, p->tn->ncols));
+}
+
+int predicate_simd(int enable) {
+    (void) pthread_once(&dispatched, dispatch);
+    if (! enable)
+        simd = 0;
+    else
+        dispatch();
+#ifdef PREDICATE_AVX2
+    integer_kernel = (simd) ? integer_avx2 : integer_scalar;
+    real_kernel = (simd) ? real_avx2 : real_scalar;
+#endif /* PREDICATE_AVX2 */
+    return simd;
+}
+
+/*
+ * set in `bits' the rows of the batch that pass term `t'; rows not in
+ * `live' need not be tested
+ */
+static void evaluate(Term *t, Table *tn, Node **nodes, union Value **vals,
+                     int n, const uint64_t *live, uint64_t *bits) {
+    union {
+        long long i[PREDICATE_BATCH];
+        double r[PREDICATE_BATCH];
+    } x;
+    uint64_t w;
+    int i, k;
+
+    switch (t->kind) {
+    case BATCH_INTEGER:
+        for (i = 0; i < n; i++)
+            x.i[i] = vals[i][t->col].intv;
+        integer_kernel(t->op, x.i, n, t->v.intv, bits);
+        break;
+    case BATCH_MIXED:
+        for (i = 0; i < n; i++)
+            x.r[i] = (double)vals[i][t->col].intv;
+        real_kernel(t->op, x.r, n, t->v.realv, bits);
+        break;
+    case BATCH_REAL:
+        for (i = 0; i < n; i++)
+            x.r[i] = vals[i][t->col].realv;
+        real_kernel(t->op, x.r, n, t->v.realv, bits);
+        break;
+    case BATCH_TSTAMP:
+        for (i = 0; i < n; i++)
+            x.i[i] = (long long)(vals[i][t->col].tstampv ^ SIGN);
+        integer_kernel(t->op, x.i, n, (long long)(t->v.tstampv ^ SIGN), bits);
+        break;
+    case BATCH_WHEN:
+        for (i = 0; i < n; i++)
+            x.i[i] = (long long)(nodes[i]->tstamp ^ SIGN);
+        integer_kernel(t->op, x.i, n, (long long)(t->v.tstampv ^ SIGN), bits);
+        break;
+    case BATCH_CODE:
+        for (i = 0; i < n; i++)
+            x.i[i] = vals[i][t->col].dictv.code;
+        integer_kernel(SQL_FILTER_EQUAL, x.i, n, t->code, bits);
+        break;
+    default:	/* tested a row at a time, so only the live rows */
+        for (i = 0; i < (n + 63) / 64; i++)
+            for (w = live[i]; w; w &= w - 1) {
+                k = i * 64 + __builtin_ctzll(w);
+                bits[i] |= (uint64_t)t->test(t, tn, nodes[k], vals[k]) << (k & 63);
+            }
+    }
+}
+
+/*
+ * set in `bits' the rows of the batch that pass `c'; only the bits of the
+ * rows in `live' are meaningful, and only those rows need be tested
+ */
+static void clause_batch(Clause *c, Table *tn, Node **nodes,
+                         union Value **vals, int n, const uint64_t *live,
+                         uint64_t *bits) {
+    uint64_t undecided[WORDS], sub[WORDS], any;
+    int nwords = (n + 63) / 64, isor = (c->type == CLAUSE_OR), i, k;
+
+    if (c->type == CLAUSE_TERM) {
+        memset(bits, 0, nwords * sizeof(uint64_t));
+        evaluate(&c->term, tn, nodes, vals, n, live, bits);
+        if (c->term.negate)
+            for (i = 0; i < nwords; i++)
+                bits[i] = ~bits[i];
+        return;
+    }
+    for (k = 0; k < c->n; k++) {
+        clause_batch(c->ops[k], tn, nodes, vals, n, (k) ? undecided : live,
+                     (k) ? sub : bits);
+        any = 0;
+        for (i = 0; i < nwords; i++) {
+            if (k)
+                bits[i] = (isor) ? bits[i] | sub[i] : bits[i] & sub[i];
+            undecided[i] = live[i] & ((isor) ? ~bits[i] : bits[i]);
+            any |= undecided[i];
+        }
+        if (! any)
+            break;	/* the remaining operands cannot change the result */
+    }
+}
+
+int predicate_batch(Predicate *p, Node **nodes, int n) {
+    union Value *vals[PREDICATE_BATCH];
+    uint64_t live[WORDS], pass[WORDS], w;
+    int nwords = (n + 63) / 64, i, k;
+
+    if (n <= 0)
+        return 0;
+    if (! p)
+        return n;
+    for (i = 0; i < n; i++)
+        vals[i] = tuple_values(nodes[i]->tuple, p->tn->ncols);
+    for (i = 0; i < nwords; i++)
+        live[i] = ~0ULL;
+    if (n & 63)
+        live[nwords - 1] = (1ULL << (n & 63)) - 1;
+    clause_batch(p->root, p->tn, nodes, vals, n, live, pass);
+
+    /* move the nodes that passed to the front, in order */
+    for (i = 0, k = 0; i < nwords; i++)
+        for (w = pass[i] & live[i]; w; w &= w - 1)
+            nodes[k++] = nodes[i * 64 + __builtin_ctzll(w)];
+    return k;
+}
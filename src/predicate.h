@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * predicate.h - WHERE clauses compiled for the columns of a table
+ *
+ * the column of each filter is looked up, its constant converted to the
+ * type of the column and the comparison chosen once per query, so that
+ * testing a row only runs the comparisons
+ */
+#ifndef _PREDICATE_H_
+#define _PREDICATE_H_
+
+#include "node.h"
+#include "table.h"
+#include "sqlstmts.h"
+
+/* the most nodes tested by one call of predicate_batch() */
+#define PREDICATE_BATCH 1024
+
+typedef struct predicate Predicate;
+
+/*
+ * compile the `nfilters' filters, joined by `filtertype', for `tn';
+ * returns NULL if there are no filters, and a NULL predicate passes
+ * every node.  a sample of the rows of `tn' is tested to decide the order
+ * of the filters, so it must be locked
+ */
+Predicate *predicate_new(Table *tn, int nfilters, sqlfilter **filters,
+                         int filtertype);
+
+/*
+ * compile the expression tree `where' for `tn', likewise; NULL if `where'
+ * is NULL
+ */
+Predicate *predicate_new_expr(Table *tn, sqlexpr *where);
+
+void predicate_free(Predicate *p);
+
+/*
+ * returns TRUE if the tuple of `n' passes the filters
+ */
+int predicate_test(Predicate *p, Node *n);
+
+/*
+ * test the `n' nodes, at most PREDICATE_BATCH, of `nodes', moving those
+ * that pass to the front of the array in their order; returns how many
+ * passed
+ */
+int predicate_batch(Predicate *p, Node **nodes, int n);
+
+/*
+ * use the SIMD kernels of predicate_batch() if `enable' and the CPU has
+ * them, or the scalar ones; returns TRUE if the SIMD kernels are in use
+ */
+int predicate_simd(int enable);
+
+#endif /* _PREDICATE_H_ */
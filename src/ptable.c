@@ -38,6 +38,8 @@
 #include "hwdb.h"
 #include "table.h"
 #include "nodecrawler.h"
+#include "mb.h"
+#include "wal.h"
 #include "topic.h"
 #include "tuple.h"
 #include "typetable.h"
@@ -71,105 +73,72 @@ int ptab_create(char *name) {
 
 int ptab_hasEntry(char *name, char *ident) {
     Table *tn = hwdb_table_lookup(name);
-    Nodecrawler *nc;
     int result;
 
     if (! tn || (! tn->tabletype))
         return 0;
     table_lock(tn);
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    result = (nodecrawler_find_value(nc, tn->primary_column, ident) != NULL);
+    result = (table_lookup_key(tn, ident) != NULL);
     table_unlock(tn);
-    nodecrawler_free(nc);
     return result;
 }
 
 void ptab_delete(char *name, char *ident) {
     Table *tn = hwdb_table_lookup(name);
-    Nodecrawler *nc;
     Node *n;
     table_lock(tn);
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    if ((n = nodecrawler_find_value(nc, tn->primary_column, ident))) {
-        /* remove n from list */
-        if (tn->oldest == tn->newest) {	/* one item, == n */
-            tn->oldest = NULL;
-            tn->newest = NULL;
-        } else if (tn->oldest == n) {
-            tn->oldest = n->next;
-            n->next->prev = NULL;
-        } else if (tn->newest == n) {
-            tn->newest = n->prev;
-            n->prev->next = NULL;
-        } else {
-            n->prev->next = n->next;
-            n->next->prev = n->prev;
-        }
-        free(n->tuple);
-        free(n);
-        --tn->count;
-    }
-    nodecrawler_free(nc);
+    if ((n = table_lookup_key(tn, ident)))
+        heap_remove_node(n, tn);
     table_unlock(tn);
+    (void) wal_commit();
 }
 
 GAPLSequence *ptab_lookup(char *name, char *ident) {
     GAPLSequence *ans = NULL;
     Table *tn = hwdb_table_lookup(name);
-    Nodecrawler *nc;
-    char bf[4096], *b = NULL;
-    int i;
+    int ncols;
+    SchemaCell *schema;
     Node *n;
-    union Tuple *p;
 
     if (! tn || (! tn->tabletype))
         return ans;
+    (void) top_schema(name, &ncols, &schema);	/* obtain the table schema */
     table_lock(tn);
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    if ((n = nodecrawler_find_value(nc, tn->primary_column, ident))) {
-        p = (union Tuple *)(n->tuple);	/* convert it to a tuple */
-        b = bf;
-        for (i = tn->primary_column; i < tn->ncols; i++) {
-            b += sprintf(b, "%s", (char *)(p->ptrs[i]));
-            *b++ = '\0';
-        }
-    }
-    nodecrawler_free(nc);
-    table_unlock(tn);
-    if (b != NULL) {	/* non-primary key values in bf, generate GAPLSequence */
-        int ncols;
-        SchemaCell *schema;
-        (void) top_schema(name, &ncols, &schema);	/* obtain the table schema */
+    if ((n = table_lookup_key(tn, ident))) {
+        /*
+         * generate GAPLSequence from the native values of the primary key
+         * and the columns after it; cell i of the schema describes column
+         * i-1 of the table, since cell 0 is the timestamp
+         */
+        union Value *v = tuple_values(n->tuple, tn->ncols);
         ans = (GAPLSequence *)malloc(sizeof(GAPLSequence));
         if (ans) {
             int nelems = ncols - tn->primary_column - 1;
             ans->entries = (DataStackEntry *)malloc(nelems * sizeof(DataStackEntry));
             if (ans->entries) {
-                char *q = bf;
                 DataStackEntry *d = ans->entries;
-                int j;
+                int i, j, c;
                 ans->used = nelems;
                 ans->size = nelems;
                 for (i = tn->primary_column+1, j = 0; i < ncols; i++, j++) {
-                    b = q;
-                    while (*q++) ;	/* skip to beginning of next value */
+                    c = i - 1;
                     d[j].type = schema[i].type;
                     d[j].flags = 0;
                     switch(d[j].type) {
                     case dBOOLEAN:
-                        d[j].value.bool_v = atoi(b);
+                        d[j].value.bool_v = (int)v[c].intv;
                         break;
                     case dINTEGER:
-                        d[j].value.int_v = atoll(b);
+                        d[j].value.int_v = v[c].intv;
                         break;
                     case dDOUBLE:
-                        d[j].value.dbl_v = atof(b);
+                        d[j].value.dbl_v = v[c].realv;
                         break;
                     case dTSTAMP:
-                        d[j].value.tstamp_v = string_to_timestamp(b);
+                        d[j].value.tstamp_v = v[c].tstampv;
                         break;
                     case dSTRING:
-                        d[j].value.str_v = strdup(b);
+                        d[j].value.str_v = strdup(tuple_column(tn, n->tuple, c));
                         d[j].flags |= MUST_FREE;
                         break;
                     }
@@ -180,6 +149,7 @@ GAPLSequence *ptab_lookup(char *name, char *ident) {
             }
         }
     }
+    table_unlock(tn);
     return ans;
 }
 
@@ -275,13 +245,12 @@ int ptab_keys(char *name, char ***theKeys) {
             Nodecrawler *nc;
             int i;
             Node *n;
-            union Tuple *p;
             nc = nodecrawler_new(tn->oldest, tn->newest);
             nodecrawler_set_to_start(nc);
             for (i =0; nodecrawler_has_more(nc); i++) {
                 n = nc->current;
-                p = (union Tuple *)(n->tuple);
-                keys[i] = strdup((char *)(p->ptrs[tn->primary_column]));
+                keys[i] = strdup(tuple_column(tn, n->tuple,
+                                              tn->primary_column));
                 nodecrawler_move_to_next(nc);
             }
             nodecrawler_free(nc);
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * scanbench - measures how fast the rows of a stream table are filtered,
+ * a row at a time and a batch at a time
+ *
+ * usage: ./scanbench [-n rows] [-q quota]
+ *
+ * inserts `rows' tuples (10 million by default) shaped like those of the
+ * Flows table, with random ports and sizes, into a table with a region of
+ * `quota' bytes (2g by default), then reports the rate at which its rows
+ * pass through each of several WHERE clauses when each row is tested in
+ * turn, and when the rows are tested in batches by the scalar and by the
+ * SIMD kernels; each is timed both for a scan of the table, as a query
+ * does it, and for the tests alone, over an array of the nodes
+ */
+#include "mb.h"
+#include "node.h"
+#include "nodecrawler.h"
+#include "predicate.h"
+#include "table.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include "sqlstmts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USAGE "./scanbench [-n rows] [-q quota]"
+#define NCOLS 7
+#define MAXFILTERS 2
+#define REPEAT 3
+
+static char *colnames[NCOLS] = {"proto", "saddr", "sport", "daddr", "dport",
+                                "npkts", "nbytes"};
+static int dports[8] = {22, 25, 53, 80, 123, 443, 993, 8080};
+
+/*
+ * ways of filtering the rows: following the list of nodes with the
+ * crawler, or over an array of every node, so that only the tests are
+ * timed; a row at a time, or a batch at a time
+ */
+#define SCAN_ROWS 0
+#define SCAN_BATCHES 1
+#define EVAL_ROWS 2
+#define EVAL_BATCHES 3
+
+static Node **nodes;	/* every node of the table, oldest first */
+
+static double rate(long long nrows, tstamp_t start, tstamp_t finish) {
+    return (double)nrows / ((double)(finish - start) / 1.0e9);
+}
+
+/*
+ * filter the rows of `tb' with `p' in the manner of `how', returning the
+ * time taken and setting `*nsel' to the number of rows that pass
+ */
+static tstamp_t run(int how, Table *tb, Predicate *p, long long *nsel) {
+    Nodecrawler *nc;
+    Node *batch[PREDICATE_BATCH];
+    tstamp_t start;
+    long long i, n = 0;
+    int m;
+    Node *x;
+
+    start = timestamp_now();
+    switch (how) {
+    case SCAN_ROWS:	/* as the crawler did before batches */
+        for (x = tb->oldest; x; x = x->next)
+            n += predicate_test(p, x);
+        break;
+    case SCAN_BATCHES:
+        nc = nodecrawler_new(tb->oldest, tb->newest);
+        nodecrawler_apply_filter(nc, p);
+        n = nc->nsel;
+        nodecrawler_free(nc);
+        break;
+    case EVAL_ROWS:
+        for (i = 0; i < tb->count; i++)
+            n += predicate_test(p, nodes[i]);
+        break;
+    case EVAL_BATCHES:
+        for (i = 0; i < tb->count; i += m) {
+            m = (tb->count - i < PREDICATE_BATCH) ? tb->count - i : PREDICATE_BATCH;
+            memcpy(batch, nodes + i, m * sizeof(Node *));
+            n += predicate_batch(p, batch, m);
+        }
+        break;
+    }
+    *nsel = n;
+    return timestamp_now() - start;
+}
+
+/*
+ * filter every row of `tb' with `nfilters' filters joined by `filtertype'
+ * in each way, and report the best rate of REPEAT runs
+ */
+static void scan(char *label, Table *tb, int nfilters, sqlfilter **filters,
+                 int filtertype) {
+    static char *names[] = {"scan, rows", "scan, batches", "scan, simd",
+                            "eval, rows", "eval, batches", "eval, simd"};
+    static int hows[] = {SCAN_ROWS, SCAN_BATCHES, SCAN_BATCHES,
+                         EVAL_ROWS, EVAL_BATCHES, EVAL_BATCHES};
+    Predicate *p;
+    tstamp_t t, best;
+    long long n;
+    int i, r, simd;
+
+    printf("%s\n", label);
+    p = predicate_new(tb, nfilters, filters, filtertype);
+    for (i = 0; i < 6; i++) {
+        simd = (i == 2 || i == 5);
+        if (predicate_simd(simd) != simd) {
+            printf("    %-16s not supported by this CPU\n", names[i]);
+            continue;
+        }
+        for (r = 0, best = 0; r < REPEAT; r++)
+            if ((t = run(hows[i], tb, p, &n)) < best || r == 0)
+                best = t;
+        printf("    %-16s %12.0f rows/s, %lld rows selected\n", names[i],
+               rate(tb->count, 0, best), n);
+    }
+    predicate_free(p);
+}
+
+static sqlfilter *integer_filter(sqlfilter *f, char *col, int sign,
+                                 long long v) {
+    memset(f, 0, sizeof(sqlfilter));
+    f->varname = col;
+    f->sign = sign;
+    f->vtype = SQL_VALUE_INTEGER;
+    f->value.intv = v;
+    return f;
+}
+
+int main(int argc, char *argv[]) {
+    int *coltypes[NCOLS];
+    char proto[8], sport[8], dport[8], npkts[16], nbytes[16];
+    char *vals[NCOLS];
+    long long nrows = 10000000LL, quota = 2048LL * 1024LL * 1024LL, k;
+    sqlfilter filter[MAXFILTERS], *filters[MAXFILTERS];
+    tstamp_t start, finish, mid = 0;
+    Table *tb;
+    Node *x;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-n") == 0)
+            nrows = atoll(argv[j]);
+        else if (strcmp(argv[i], "-q") == 0)
+            quota = atoll(argv[j]);
+        else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+            exit(1);
+        }
+        i = j + 1;
+    }
+    if (nrows < 1 || quota < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    for (i = 0; i < NCOLS; i++)
+        coltypes[i] = (i == 1 || i == 3) ? PRIMTYPE_VARCHAR : PRIMTYPE_INTEGER;
+    if (! mb_init()) {
+        fprintf(stderr, "unable to initialize the memory buffer\n");
+        exit(1);
+    }
+    tb = table_new(NCOLS, colnames, coltypes);
+    table_tabletype(tb, 0, -1);
+    tb->name = "Flows";
+    if (! mb_region_create(tb, tb->name, quota, 0)) {
+        fprintf(stderr, "unable to create table %s\n", tb->name);
+        exit(1);
+    }
+    vals[0] = proto;
+    vals[1] = "192.168.1.64";
+    vals[2] = sport;
+    vals[3] = "10.20.30.40";
+    vals[4] = dport;
+    vals[5] = npkts;
+    vals[6] = nbytes;
+    srandom(42);
+    start = timestamp_now();
+    for (k = 0; k < nrows; k++) {
+        long r = random();
+        sprintf(proto, "%d", (r & 1) ? 6 : 17);
+        sprintf(sport, "%ld", 1024 + (r >> 1) % 60000);
+        sprintf(dport, "%d", dports[(r >> 17) & 7]);
+        sprintf(npkts, "%ld", random() % 1000);
+        sprintf(nbytes, "%ld", random() % 1500000);
+        if (! mb_insert_tuple(NCOLS, vals, tb))
+            exit(1);
+        if (k == nrows / 2)
+            mid = tb->newest->tstamp;
+    }
+    finish = timestamp_now();
+    printf("%lld rows inserted at %.0f rows/s, %ld rows held\n", nrows,
+           rate(nrows, start, finish), tb->count);
+    if (! (nodes = (Node **)malloc(tb->count * sizeof(Node *)))) {
+        fprintf(stderr, "unable to allocate the array of nodes\n");
+        exit(1);
+    }
+    for (k = 0, x = tb->oldest; x; x = x->next)
+        nodes[k++] = x;
+    for (i = 0; i < MAXFILTERS; i++)
+        filters[i] = &filter[i];
+    (void) integer_filter(&filter[0], "nbytes", SQL_FILTER_GREATER, 750000);
+    scan("nbytes > 750000", tb, 1, filters, SQL_FILTER_TYPE_AND);
+    (void) integer_filter(&filter[0], "npkts", SQL_FILTER_LESS, 500);
+    (void) integer_filter(&filter[1], "dport", SQL_FILTER_EQUAL, 443);
+    scan("npkts < 500 and dport = 443", tb, 2, filters, SQL_FILTER_TYPE_AND);
+    (void) integer_filter(&filter[0], "dport", SQL_FILTER_EQUAL, 22);
+    (void) integer_filter(&filter[1], "npkts", SQL_FILTER_GREATEREQ, 990);
+    scan("dport = 22 or npkts >= 990", tb, 2, filters, SQL_FILTER_TYPE_OR);
+    memset(&filter[0], 0, sizeof(sqlfilter));
+    filter[0].varname = "timestamp";
+    filter[0].sign = SQL_FILTER_GREATER;
+    filter[0].vtype = SQL_VALUE_TSTAMP;
+    filter[0].value.tstampv = mid;
+    scan("timestamp > middle", tb, 1, filters, SQL_FILTER_TYPE_AND);
+    memset(&filter[0], 0, sizeof(sqlfilter));
+    filter[0].varname = "saddr";
+    filter[0].sign = SQL_FILTER_CONTAINS;
+    filter[0].vtype = SQL_VALUE_STRING;
+    filter[0].value.stringv = "168";
+    (void) integer_filter(&filter[1], "dport", SQL_FILTER_EQUAL, 22);
+    scan("saddr contains \"168\" and dport = 22", tb, 2, filters,
+         SQL_FILTER_TYPE_AND);
+    return 0;
+}
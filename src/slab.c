@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * slab.c - size-class pools for the nodes and tuples of persistent tables
+ *
+ * the size classes start at SLAB_MIN bytes and are spaced about 1/8 apart
+ * up to SLAB_MAX, so an object wastes at most about 12% of its space, and
+ * a row whose length changes a little usually stays in the same class
+ */
+#include "slab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_ALIGN 8		/* alignment of every object */
+#define SLAB_MIN 16		/* smallest size class */
+#define SLAB_MAX 4096		/* largest size class */
+#define SLAB_CLASSES 64		/* room for the size classes */
+
+typedef struct pool {
+    void *free;			/* freed objects, linked through first word */
+    char *next;			/* next object to carve from current slab */
+    char *end;			/* end of current slab */
+    long inuse;			/* objects allocated */
+    long carved;		/* objects carved from slabs */
+    long nslabs;		/* slabs allocated */
+} Pool;
+
+struct slab {
+    char *name;			/* table owning the pools */
+    pthread_mutex_t *lock;	/* serializes calls */
+    Pool pools[SLAB_CLASSES];
+    long large;			/* objects malloc'ed as too large */
+    Slab *next;			/* next in list of all Slabs */
+};
+
+static int sizes[SLAB_CLASSES];		/* bytes in objects of each class */
+static int nclasses;
+static unsigned char classof[SLAB_MAX / SLAB_ALIGN + 1];
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static Slab *slabs = NULL;		/* all Slabs, for slab_dump */
+static pthread_mutex_t slabs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_classes(void) {
+    int size, step, i, c;
+
+    for (size = SLAB_MIN; size < SLAB_MAX && nclasses < SLAB_CLASSES - 1; ) {
+        sizes[nclasses++] = size;
+        step = ((size / 8 - 1) / SLAB_ALIGN + 1) * SLAB_ALIGN;
+        size += step;
+    }
+    sizes[nclasses++] = SLAB_MAX;
+    for (i = 0, c = 0; i <= SLAB_MAX / SLAB_ALIGN; i++) {
+        while (sizes[c] < i * SLAB_ALIGN)
+            c++;
+        classof[i] = (unsigned char)c;
+    }
+}
+
+#define class_of(size) (classof[((size) + SLAB_ALIGN - 1) / SLAB_ALIGN])
+
+Slab *slab_new(char *name, pthread_mutex_t *lock) {
+    Slab *s;
+
+    (void) pthread_once(&once, init_classes);
+    if (! (s = (Slab *)calloc(1, sizeof(Slab))))
+        return NULL;
+    s->name = strdup((name) ? name : "(anonymous)");
+    s->lock = lock;
+    (void) pthread_mutex_lock(&slabs_mutex);
+    s->next = slabs;
+    slabs = s;
+    (void) pthread_mutex_unlock(&slabs_mutex);
+    return s;
+}
+
+int slab_size(int size) {
+    (void) pthread_once(&once, init_classes);
+    if (size > SLAB_MAX)
+        return size;
+    return sizes[class_of(size)];
+}
+
+void *slab_alloc(Slab *s, int size) {
+    Pool *p;
+    void *obj;
+    int c;
+
+    if (size > SLAB_MAX) {
+        if ((obj = malloc(size)))
+            s->large++;
+        return obj;
+    }
+    c = class_of(size);
+    p = &(s->pools[c]);
+    if ((obj = p->free)) {
+        p->free = *(void **)obj;
+    } else {
+        if (p->next + sizes[c] > p->end) {	/* start another slab */
+            char *b = (char *)malloc(SLAB_BYTES);
+            if (! b)
+                return NULL;
+            p->next = b;
+            p->end = b + (SLAB_BYTES / sizes[c]) * sizes[c];
+            p->nslabs++;
+        }
+        obj = p->next;
+        p->next += sizes[c];
+        p->carved++;
+    }
+    p->inuse++;
+    return obj;
+}
+
+void slab_free(Slab *s, void *obj, int size) {
+    Pool *p;
+
+    if (! obj)
+        return;
+    if (size > SLAB_MAX) {
+        free(obj);
+        s->large--;
+        return;
+    }
+    p = &(s->pools[class_of(size)]);
+    *(void **)obj = p->free;
+    p->free = obj;
+    p->inuse--;
+}
+
+static void dump_slab(Slab *s) {
+    long used = 0, total = 0;
+    int c;
+
+    (void) pthread_mutex_lock(s->lock);
+    printf("slabs for table %s\n", s->name);
+    for (c = 0; c < nclasses; c++) {
+        Pool *p = &(s->pools[c]);
+        if (! p->nslabs)
+            continue;
+        printf("%5d byte objects: %ld in use, %ld free, %ld slabs\n",
+               sizes[c], p->inuse, p->carved - p->inuse, p->nslabs);
+        used += p->inuse * sizes[c];
+        total += p->nslabs * SLAB_BYTES;
+    }
+    if (s->large)
+        printf("%ld objects too large for a slab\n", s->large);
+    if (total)
+        printf("bytes in slabs = %ld (%.1f%% used)\n", total,
+               100.0 * (double)used / (double)total);
+    (void) pthread_mutex_unlock(s->lock);
+}
+
+void slab_dump(void) {
+    Slab *s;
+
+    (void) pthread_mutex_lock(&slabs_mutex);
+    for (s = slabs; s; s = s->next)
+        dump_slab(s);
+    (void) pthread_mutex_unlock(&slabs_mutex);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * slab.h - size-class pools for the nodes and tuples of persistent tables
+ *
+ * objects are carved from slabs of SLAB_BYTES, each slab holding objects
+ * of a single size class; a freed object goes onto the free list of its
+ * class and is reused by the next allocation of that class, so rows that
+ * are replaced over and over do not fragment the heap.  objects larger
+ * than the largest class are malloc'ed
+ *
+ * a Slab is not thread-safe; its owner serializes calls with the mutex
+ * given to slab_new(), which slab_dump() also takes
+ */
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <pthread.h>
+
+#define SLAB_BYTES (64 * 1024)	/* bytes in each slab */
+
+typedef struct slab Slab;	/* the pools of one table */
+
+Slab *slab_new(char *name, pthread_mutex_t *lock);
+
+/*
+ * return the number of bytes actually allocated for a `size' byte object
+ */
+int slab_size(int size);
+
+void *slab_alloc(Slab *s, int size);
+void slab_free(Slab *s, void *p, int size);
+
+/*
+ * print the occupancy of every Slab
+ */
+void slab_dump(void);
+
+#endif /* _SLAB_H_ */
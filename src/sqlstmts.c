@@ -122,6 +122,7 @@ sqlfilter *sqlstmt_new_filter(int ctype, char *name, int dtype, char *value) {
 
     filter = malloc(sizeof(sqlfilter));
     filter->IS_STR = 0;
+    filter->vtype = 0;
     filter->varname = name;
     switch(ctype) {
     case EQUALS:
@@ -149,9 +150,11 @@ sqlfilter *sqlstmt_new_filter(int ctype, char *name, int dtype, char *value) {
     switch(dtype) {
     case INTEGER:
         filter->value.intv = strtoll(value, NULL, 10);
+        filter->vtype = SQL_VALUE_INTEGER;
         break;
     case REAL:
         filter->value.realv = strtod(value, NULL);
+        filter->vtype = SQL_VALUE_REAL;
         break;
     case CHARACTER:
         filter->value.charv = value[0];
@@ -164,15 +167,37 @@ sqlfilter *sqlstmt_new_filter(int ctype, char *name, int dtype, char *value) {
         break;
     case TSTAMP:
         filter->value.tstampv = string_to_timestamp(value);
+        filter->vtype = SQL_VALUE_TSTAMP;
         break;
     case VARCHAR:
         filter->value.stringv = strdup(value);
         filter->IS_STR = 1;
+        filter->vtype = SQL_VALUE_STRING;
         debugvf("VALUE IS :%s\n",filter->value.stringv);
     }
     return filter;
 }
 
+sqlexpr *sqlstmt_new_expr(int type, sqlfilter *filter, sqlexpr *left,
+                          sqlexpr *right) {
+    sqlexpr *expr;
+
+    expr = malloc(sizeof(sqlexpr));
+    expr->type = type;
+    expr->filter = filter;
+    expr->left = left;
+    expr->right = right;
+    return expr;
+}
+
+void sqlstmt_free_expr(sqlexpr *expr) {
+    if (! expr)
+        return;
+    sqlstmt_free_expr(expr->left);
+    sqlstmt_free_expr(expr->right);
+    free(expr);
+}
+
 sqlpair *sqlstmt_new_pair(int ctype, char *name, int dtype, char *value) {
     sqlpair *pair;
 
@@ -69,6 +69,12 @@
 #define SQL_FILTER_CONTAINS 6
 #define SQL_FILTER_NOTCONTAINS 7
 
+/* type of the constant in a filter; 0 if it has the type of the column */
+#define SQL_VALUE_INTEGER 1
+#define SQL_VALUE_REAL 2
+#define SQL_VALUE_TSTAMP 3
+#define SQL_VALUE_STRING 4
+
 #define SQL_PAIR_EQUAL 1
 #define SQL_PAIR_ADDEQ 2
 #define SQL_PAIR_SUBEQ 3
@@ -76,6 +82,11 @@
 #define SQL_FILTER_TYPE_AND 0
 #define SQL_FILTER_TYPE_OR 1
 
+#define SQL_EXPR_FILTER 0
+#define SQL_EXPR_AND 1
+#define SQL_EXPR_OR 2
+#define SQL_EXPR_NOT 3
+
 extern const int sql_colattrib_types[];
 
 #define SQL_COLATTRIB_NONE 	&sql_colattrib_types[0]
@@ -117,8 +128,20 @@ typedef struct sqlfilter {
     int sign; /* =, >, <, <=, >= */
     union filterval value;
     unsigned char IS_STR;
+    unsigned char vtype; /* SQL_VALUE_* */
 } sqlfilter;
 
+/*
+ * node of the expression tree of a WHERE clause; its filters are also
+ * those of the statement's array of filters, which owns them
+ */
+typedef struct sqlexpr {
+    int type;			/* SQL_EXPR_* */
+    sqlfilter *filter;		/* SQL_EXPR_FILTER */
+    struct sqlexpr *left;	/* operands; a NOT has only the left */
+    struct sqlexpr *right;
+} sqlexpr;
+
 typedef struct sqlselect {
     int ncols;
     char **cols;
@@ -128,7 +151,8 @@ typedef struct sqlselect {
     sqlwindow **windows;  /* Array of windows (one per table) */
     int nfilters;
     sqlfilter **filters; /* Array of where filters */
-    int filtertype; 	/* Temp only. Remove when brackets implemented */
+    int filtertype; 	/* how the filters are joined if there is no tree */
+    sqlexpr *where;	/* expression tree of the filters, or NULL */
     char *orderby;
     int isCountStar;
     int groupby_ncols;
@@ -150,6 +174,7 @@ typedef struct sqlupdate {
     int nfilters;
     sqlfilter **filters; /* Array of where filters */
     int filtertype;
+    sqlexpr *where;
 } sqlupdate;
 
 typedef struct sqlcreate {
@@ -157,15 +182,21 @@ typedef struct sqlcreate {
     int ncols;
     char **colname;
     int **coltype;
+    char *coldict;	/* 1 for each dictionary-encoded column, or NULL */
     short tabletype;
     short primary_column;
+    long long quota;	/* bytes for a private region, 0 if shared */
+    long long rows;	/* row quota, 0 if none */
+    short archive;	/* evicted tuples are kept in the archive */
+    short compress;	/* rows are kept in compressed chunks */
+    long long ttl;	/* milliseconds after which rows expire, 0 if never */
 } sqlcreate;
 
 typedef struct sqlinsert {
     char *tablename;
     int ncols;
     char **colval;
-    int **coltype;
+    int **coltype;	/* NULL for a `?' parameter of a prepared insert */
     short transform;
 } sqlinsert;
 
@@ -174,6 +205,7 @@ typedef struct sqldelete {
     int nfilters;
     sqlfilter **filters;
     int filtertype;
+    sqlexpr *where;
 } sqldelete;
 
 typedef struct sqlregister {
@@ -224,6 +256,11 @@ sqlfilter *sqlstmt_new_filter_lesseq(char *name, int value);
 
 sqlpair *sqlstmt_new_pair(int ctype, char *name, int dtype, char *value);
 
+sqlexpr *sqlstmt_new_expr(int type, sqlfilter *filter, sqlexpr *left,
+                          sqlexpr *right);
+/* frees the nodes of `expr' but not its filters */
+void sqlstmt_free_expr(sqlexpr *expr);
+
 int sqlstmt_calc_len(sqlinsert *insert);
 int sqlstmt_valid_groupby(sqlselect *select);
 
@@ -41,6 +41,9 @@
 #include "typetable.h"
 #include "sqlstmts.h"
 #include "pubsub.h"
+#include "tuple.h"
+#include "dict.h"
+#include "adts/hashmap.h"
 #include "srpc/srpc.h"
 
 #include <string.h>
@@ -52,6 +55,7 @@ Table *table_new(int ncols, char **colname, int **coltype) {
     int i;
 
     tn = malloc(sizeof(Table));
+    tn->name = NULL;
     tn->ncols = ncols;
     tn->colname = (char **)malloc(ncols * sizeof(char *));
     tn->coltype = (int **)malloc(ncols * sizeof(int *));
@@ -62,6 +66,19 @@ Table *table_new(int ncols, char **colname, int **coltype) {
     tn->oldest = NULL;
     tn->newest = NULL;
     tn->count = 0;
+    tn->keyindex = NULL;
+    tn->tindex = NULL;
+    tn->tsize = 0;
+    tn->thead = 0;
+    tn->tcount = 0;
+    tn->tstride = 0;
+    tn->region = NULL;
+    tn->owner = -1;
+    tn->archive = NULL;
+    tn->slab = NULL;
+    tn->dict = NULL;
+    tn->chunks = NULL;
+    tn->ttl = 0;
     pthread_mutex_init(&tn->tb_mutex, NULL);
 
     return tn;
@@ -184,6 +201,35 @@ int table_lookup_colindex(Table *tn, char *colname) {
 void table_tabletype(Table *tn, short tabletype, short primary_column) {
     tn->tabletype = tabletype;
     tn->primary_column = primary_column;
+    if (tabletype && ! tn->keyindex)
+        tn->keyindex = hm_create(TT_INDEX_BUCKETS, 0.75);
+}
+
+int table_dictionaries(Table *tn, char *coldict) {
+    size_t ncols;
+    int i;
+
+    if (! coldict || tn->ncols <= 0)
+        return 1;
+    for (i = 0; i < tn->ncols; i++)
+        if (coldict[i] && tn->coltype[i] != PRIMTYPE_VARCHAR) {
+            errorf("only varchar columns can be dictionary-encoded.\n");
+            return 0;
+        }
+    ncols = (size_t)tn->ncols;
+    if (! (tn->dict = (struct dict **)calloc(ncols, sizeof(struct dict *))))
+        return 0;
+    for (i = 0; i < tn->ncols; i++)
+        if (coldict[i] && ! (tn->dict[i] = dict_new())) {
+            errorf("unable to create dictionary for %s\n", tn->colname[i]);
+            while (--i >= 0)
+                if (tn->dict[i])
+                    dict_free(tn->dict[i]);
+            free(tn->dict);
+            tn->dict = NULL;
+            return 0;
+        }
+    return 1;
 }
 
 int table_persistent(Table *tn) {
@@ -192,3 +238,80 @@ int table_persistent(Table *tn) {
 int table_key(Table *tn) {
     return (tn->primary_column);
 }
+
+/*
+ * primary key index for persistent tables
+ *
+ * maps the value of the primary column onto the Node holding that row;
+ * the caller must hold the table lock, and must remove a node from the
+ * index before freeing its tuple
+ */
+
+/* Returns NULL if no row has that key */
+Node *table_lookup_key(Table *tn, char *key) {
+    Node *n;
+
+    if (! tn->keyindex || ! hm_get(tn->keyindex, key, (void **)&n))
+        return NULL;
+    debugvf("Key %s found in index\n", key);
+    return n;
+}
+
+void table_index_add(Table *tn, Node *n) {
+    void *dummy;
+
+    if (! tn->keyindex)
+        return;
+    (void)hm_put(tn->keyindex, tuple_column(tn, n->tuple, tn->primary_column),
+                 n, &dummy);
+}
+
+void table_index_remove(Table *tn, Node *n) {
+    char *key;
+    Node *m;
+
+    if (! tn->keyindex)
+        return;
+    key = tuple_column(tn, n->tuple, tn->primary_column);
+    if (hm_get(tn->keyindex, key, (void **)&m) && m == n)
+        (void)hm_remove(tn->keyindex, key, (void **)&m);
+}
+
+/*
+ * sparse time index for stream tables
+ *
+ * table_tindex_add is called for every node appended to the table, and
+ * records one in every TT_TIME_STRIDE of them; table_tindex_evict is called
+ * as the oldest node of the table is evicted.  the caller must hold the
+ * lock that protects the table's list of nodes
+ */
+void table_tindex_add(Table *tn, Node *n) {
+    TEntry *e;
+
+    if (--tn->tstride > 0)
+        return;
+    tn->tstride = TT_TIME_STRIDE;
+    if (tn->tcount == tn->tsize) {	/* ring full, unroll into a larger one */
+        int i, size = (tn->tsize) ? 2 * tn->tsize : TT_TIME_ENTRIES;
+        TEntry *t = (TEntry *)malloc(size * sizeof(TEntry));
+        if (! t)
+            return;		/* index is sparser, but still correct */
+        for (i = 0; i < tn->tcount; i++)
+            t[i] = *table_tentry(tn, i);
+        free(tn->tindex);
+        tn->tindex = t;
+        tn->tsize = size;
+        tn->thead = 0;
+    }
+    e = &(tn->tindex[(tn->thead + tn->tcount) % tn->tsize]);
+    e->tstamp = n->tstamp;
+    e->node = n;
+    tn->tcount++;
+}
+
+void table_tindex_evict(Table *tn, Node *n) {
+    if (tn->tcount && tn->tindex[tn->thead].node == n) {
+        tn->thead = (tn->thead + 1) % tn->tsize;
+        tn->tcount--;
+    }
+}
@@ -38,12 +38,25 @@
 
 #include "node.h"
 #include "adts/linkedlist.h"
+#include "adts/hashmap.h"
 #include "sqlstmts.h"
 #include "rtab.h"
+#include "timestamp.h"
 #include "srpc/srpc.h"
 #include <pthread.h>
 
+/*
+ * entry in the sparse time index of a stream table; one node in every
+ * TT_TIME_STRIDE is indexed, and entries are kept in a ring in insertion
+ * (and therefore timestamp) order
+ */
+typedef struct tentry {
+    tstamp_t tstamp;		/* timestamp of the indexed node */
+    struct node *node;		/* the indexed node */
+} TEntry;
+
 typedef struct table {
+    char *name;			/* name of the table, NULL if anonymous */
     short tabletype;		/* type of table (persistent or not) */
     short primary_column;	/* primary column # for persistent table */
     int ncols;			/* number of columns */
@@ -52,6 +65,19 @@ typedef struct table {
     struct node *oldest;	/* oldest node in the table */
     struct node *newest;	/* newest node in the table */
     long count;			/* number of nodes in the table */
+    HashMap *keyindex;		/* primary key -> node, persistent only */
+    TEntry *tindex;		/* time index ring, stream only */
+    int tsize;			/* number of slots in tindex */
+    int thead;			/* slot holding oldest entry */
+    int tcount;			/* number of entries in tindex */
+    int tstride;		/* inserts until next entry is made */
+    struct region *region;	/* private circular buffer, or NULL */
+    int owner;			/* index of the table in its region, or -1 */
+    struct _t *archive;		/* archive of evicted tuples, or NULL */
+    struct slab *slab;		/* pools for a persistent table, or NULL */
+    struct dict **dict;		/* dictionary of each column, or NULL */
+    struct chunks *chunks;	/* open chunk of a compressed table, or NULL */
+    tstamp_t ttl;		/* age at which rows expire, 0 if never */
     pthread_mutex_t tb_mutex;	/* mutex for protecting the table */
 } Table;
 
@@ -63,7 +89,15 @@ void table_store_select_cols(Table *tn, sqlselect *select, Rtab *results);
 void table_extract_relevant_types(Table *tn, Rtab *results);
 int table_lookup_colindex(Table *tn, char *colname);
 void table_tabletype(Table *tn, short tabletype, short primary_column);
+int table_dictionaries(Table *tn, char *coldict);
 int table_persistent(Table *tn);
 int table_key(Table *tn);
+struct node *table_lookup_key(Table *tn, char *key);
+void table_index_add(Table *tn, struct node *n);
+void table_index_remove(Table *tn, struct node *n);
+void table_tindex_add(Table *tn, struct node *n);
+void table_tindex_evict(Table *tn, struct node *n);
+
+#define table_tentry(tn,i) (&((tn)->tindex[((tn)->thead + (i)) % (tn)->tsize]))
 
 #endif /* _TABLE_H_ */
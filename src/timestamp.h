@@ -37,9 +37,6 @@
 
 #include <sys/time.h>
 
-#define DROPPED 0x8000000000000000LL	/* bit that is manipulated in tstamp
-                                           when packet is to be dropped */
-
 typedef unsigned long long tstamp_t;
 
 extern tstamp_t current_time;
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * tuple.c - encoding of column values into tuples
+ */
+#include "tuple.h"
+#include "table.h"
+#include "typetable.h"
+#include "dict.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define dict_of(tb,i) ((tb)->dict ? (tb)->dict[i] : NULL)
+
+int tuple_length(Table *tb, int ncols, char *vals[]) {
+    int i, len;
+
+    len = TUPLE_VALUES_OFFSET(ncols) + ncols * sizeof(union Value);
+    for (i = 0; i < ncols; i++)
+        if (! dict_of(tb, i))
+            len += strlen(vals[i]) + 1;
+    return len;
+}
+
+/*
+ * booleans arrive as TRUE/FALSE from automata and as integers from SQL
+ */
+static long long boolean_value(char *s) {
+    if (toupper((int)*s) == 'T')
+        return 1LL;
+    if (toupper((int)*s) == 'F')
+        return 0LL;
+    return strtoll(s, NULL, 10);
+}
+
+/*
+ * encode `vals' into `buf', using the dictionaries of `tb' if `dicts';
+ * returns 0 if a value could not be interned
+ */
+static int encode(Table *tb, int ncols, char *vals[], unsigned char *buf,
+                  int dicts) {
+    union Tuple *p = (union Tuple *)buf;
+    union Value *v = tuple_values(buf, ncols);
+    unsigned char *t = (unsigned char *)(v + ncols);
+    long code;
+    int i, len;
+
+    for (i = 0; i < ncols; i++, v++) {
+        int *type = tb->coltype[i];
+        Dict *d = (dicts) ? dict_of(tb, i) : NULL;
+
+        len = strlen(vals[i]);
+        if (type == PRIMTYPE_INTEGER || type == PRIMTYPE_TINYINT ||
+                type == PRIMTYPE_SMALLINT)
+            v->intv = strtoll(vals[i], NULL, 10);
+        else if (type == PRIMTYPE_BOOLEAN)
+            v->intv = boolean_value(vals[i]);
+        else if (type == PRIMTYPE_REAL)
+            v->realv = strtod(vals[i], NULL);
+        else if (type == PRIMTYPE_TIMESTAMP)
+            v->tstampv = string_to_timestamp(vals[i]);
+        else if (d) {
+            if ((code = dict_intern(d, vals[i])) < 0)
+                return 0;
+            v->dictv.code = (unsigned int)code;
+            v->dictv.len = (unsigned int)len;
+            p->offs[i] = 0;
+            continue;
+        } else {
+            v->strv.off = (unsigned int)(t - buf);
+            v->strv.len = (unsigned int)len;
+        }
+        p->offs[i] = (unsigned short)(t - buf);
+        memcpy(t, vals[i], len + 1);
+        t += len + 1;
+    }
+    return 1;
+}
+
+int tuple_encode(Table *tb, int ncols, char *vals[], unsigned char *buf) {
+    return encode(tb, ncols, vals, buf, 1);
+}
+
+char *tuple_column(Table *tb, unsigned char *t, int i) {
+    Dict *d = dict_of(tb, i);
+
+    if (d)
+        return dict_string(d, tuple_values(t, tb->ncols)[i].dictv.code);
+    return tuple_text(t, i);
+}
+
+int tuple_inline(Table *tb, unsigned char *t, unsigned char *buf,
+                 int size) {
+    char *vals[MAX_TUPLE_SIZE / sizeof(char *)];
+    int i, len;
+
+    len = TUPLE_VALUES_OFFSET(tb->ncols) + tb->ncols * sizeof(union Value);
+    for (i = 0; i < tb->ncols; i++) {
+        vals[i] = tuple_column(tb, t, i);
+        len += strlen(vals[i]) + 1;
+    }
+    if (len <= size)
+        (void) encode(tb, tb->ncols, vals, buf, 0);
+    return len;
+}
+
+int tuple_intern(Table *tb, unsigned char *t, unsigned char *buf,
+                 int size) {
+    char *vals[MAX_TUPLE_SIZE / sizeof(char *)];
+    int i, len;
+
+    for (i = 0; i < tb->ncols; i++)
+        vals[i] = tuple_text(t, i);
+    if ((len = tuple_length(tb, tb->ncols, vals)) <= size &&
+            ! tuple_encode(tb, tb->ncols, vals, buf))
+        return -1;
+    return len;
+}
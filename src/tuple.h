@@ -35,11 +35,98 @@
 #ifndef _TUPLE_H_
 #define _TUPLE_H_
 
+#include "timestamp.h"
+
 #define MAX_TUPLE_SIZE 4096
 
+/*
+ * a tuple of `ncols' columns is laid out as follows:
+ *
+ *	unsigned short offs[ncols]	offset of the NUL-terminated text of
+ *					each column from the start of the tuple
+ *	union Value vals[ncols]	one fixed-width native value per column
+ *	text of column 0 .. ncols-1, each NUL-terminated
+ *
+ * integer, boolean, tinyint and smallint columns are held as 64-bit
+ * integers, real columns as doubles and timestamp columns as tstamp_t's;
+ * the slot of a character, varchar or blob column holds the offset of its
+ * text from the start of the tuple and its length.  nothing in the tuple
+ * depends upon where it lives, so it may be copied with memcpy()
+ *
+ * a dictionary-encoded varchar column has no text in the tuple: its slot
+ * holds the code of the text in the column's dictionary, and its offs[]
+ * entry is 0 (see tuple_column)
+ *
+ * numeric and timestamp columns keep their text beside their value, since
+ * tuple_column() returns a pointer into the tuple, which the key index of
+ * a table holds on to, and a column is projected as it was inserted, not
+ * as its value would be formatted; the archive and the chunk codec also
+ * read the text of every column
+ */
+union Value {
+    long long intv;
+    double realv;
+    tstamp_t tstampv;
+    struct {
+        unsigned int off;	/* offset of text from start of tuple */
+        unsigned int len;	/* strlen() of the text */
+    } strv;
+    struct {
+        unsigned int code;	/* code of text in the column's dictionary */
+        unsigned int len;	/* strlen() of the text */
+    } dictv;
+};
+
 union Tuple {
     unsigned char bytes[MAX_TUPLE_SIZE];
-    char *ptrs[MAX_TUPLE_SIZE/sizeof(char *)];
+    unsigned short offs[MAX_TUPLE_SIZE/sizeof(unsigned short)];
+    union Value align;		/* so that a buffer may hold values */
 };
 
+#define TUPLE_VALUES_OFFSET(ncols) \
+    ((((ncols) * sizeof(unsigned short) - 1) / sizeof(union Value) + 1) * \
+     sizeof(union Value))
+#define tuple_values(t,ncols) \
+    ((union Value *)((unsigned char *)(t) + TUPLE_VALUES_OFFSET(ncols)))
+#define tuple_string(t,v) ((char *)(t) + (v)->strv.off)
+#define tuple_text(t,i) ((char *)(t) + ((union Tuple *)(t))->offs[i])
+
+struct table;
+
+/*
+ * return the number of bytes needed to encode `vals' as a tuple of `tb'
+ */
+int tuple_length(struct table *tb, int ncols, char *vals[]);
+
+/*
+ * encode `vals' into `buf' according to the column types of `tb',
+ * interning the values of dictionary-encoded columns; `buf' must have room
+ * for tuple_length(tb, ncols, vals) bytes
+ *
+ * returns 1, or 0 if a value could not be interned
+ */
+int tuple_encode(struct table *tb, int ncols, char *vals[],
+                 unsigned char *buf);
+
+/*
+ * return the text of column `i' of the tuple `t' of `tb'; tuple_text()
+ * will do for a tuple that holds the text of every column
+ */
+char *tuple_column(struct table *tb, unsigned char *t, int i);
+
+/*
+ * write to `buf' the tuple `t' of `tb' with the text of every column held
+ * in the tuple, as in a table without dictionaries; returns its length,
+ * and only writes it if that is at most `size'
+ */
+int tuple_inline(struct table *tb, unsigned char *t, unsigned char *buf,
+                 int size);
+
+/*
+ * the reverse of tuple_inline(): encode the tuple `t', which holds the text
+ * of every column, as a tuple of `tb'; -1 if a value could not be interned
+ */
+int tuple_intern(struct table *tb, unsigned char *t, unsigned char *buf,
+                 int size);
+
 #endif /* _TUPLE_H_ */
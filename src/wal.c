@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * wal.c - write-ahead log for persistent tables
+ *
+ * each change to a persistent table is appended to a buffer in memory
+ * while the table is still locked, so records are in the order in which
+ * the changes were made; wal_commit() writes the buffer to the log file
+ * before the change is acknowledged
+ *
+ * commits are grouped: the first thread to commit writes (and syncs)
+ * everything appended so far, and threads that commit while it is doing
+ * so wait for it, and are usually covered by the same write
+ *
+ * a record is a header holding the length and checksum of its payload,
+ * followed by the payload: the record type and a sequence of NUL-terminated
+ * fields; the log is replayed at startup, from the position recorded in
+ * the checkpoint that was loaded, if any, and a torn record at its end is
+ * cut off
+ */
+
+#include "wal.h"
+#include "table.h"
+#include "typetable.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#define BUFFER_INITIAL 65536	/* initial size of each append buffer */
+#define MAX_RECORD (1024 * 1024)	/* longer payloads are torn headers */
+
+struct header {
+    unsigned int length;	/* bytes in the payload */
+    unsigned int checksum;	/* checksum of the payload */
+};
+
+typedef struct buffer {
+    unsigned char *data;
+    long used;
+    long size;
+} Buffer;
+
+static char *wal_file = NULL;		/* log file, NULL if not logging */
+static int wal_policy = WAL_SYNC_ALWAYS;
+static int wal_millis = 0;		/* interval for WAL_SYNC_BATCH */
+static int fd = -1;			/* open log file */
+static int replaying = 0;		/* set while the log is replayed */
+static Buffer bufs[2];
+static Buffer *cur = &bufs[0];		/* buffer being appended to */
+static Buffer *spare = &bufs[1];	/* buffer to swap in when writing */
+static unsigned long long appended = 0;	/* bytes appended to the log */
+static unsigned long long written = 0;	/* bytes written to the log */
+static int writing = 0;			/* set while a thread writes */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher;
+
+/*
+ * 32-bit FNV-1a hash of `len' bytes at `p'
+ */
+static unsigned int checksum(unsigned char *p, unsigned int len) {
+    unsigned int h = 2166136261U;
+    while (len-- > 0) {
+        h ^= *p++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/*
+ * append a record of type `type' with `nfields' fields to the log
+ */
+static void append(int type, int nfields, char **fields) {
+    struct header h;
+    unsigned char *p;
+    long need;
+    int i;
+
+    h.length = 1;
+    for (i = 0; i < nfields; i++)
+        h.length += strlen(fields[i]) + 1;
+    if (h.length > MAX_RECORD) {
+        errorf("log record of %u bytes is too long, not logged\n", h.length);
+        return;
+    }
+    (void) pthread_mutex_lock(&mutex);
+    need = cur->used + sizeof(h) + h.length;
+    if (need > cur->size) {
+        long size = 2 * cur->size;
+        unsigned char *tmp;
+        while (size < need)
+            size *= 2;
+        if (! (tmp = (unsigned char *)realloc(cur->data, size))) {
+            errorf("unable to extend log buffer, record not logged\n");
+            (void) pthread_mutex_unlock(&mutex);
+            return;
+        }
+        cur->data = tmp;
+        cur->size = size;
+    }
+    p = cur->data + cur->used + sizeof(h);
+    *p++ = (unsigned char)type;
+    for (i = 0; i < nfields; i++) {
+        long len = strlen(fields[i]) + 1;
+        memcpy(p, fields[i], len);
+        p += len;
+    }
+    h.checksum = checksum(cur->data + cur->used + sizeof(h), h.length);
+    memcpy(cur->data + cur->used, &h, sizeof(h));
+    cur->used = need;
+    appended += sizeof(h) + h.length;
+    (void) pthread_mutex_unlock(&mutex);
+}
+
+static int write_all(unsigned char *p, long n) {
+    ssize_t k;
+    while (n > 0) {
+        if ((k = write(fd, p, n)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        p += k;
+        n -= k;
+    }
+    return 1;
+}
+
+/*
+ * put the records in `out', which could not be written, back in front of
+ * those appended since, so that the next write retries them; if there is
+ * no room for them they are dropped; must be called with the mutex held
+ */
+static void requeue(Buffer *out) {
+    long need = out->used + cur->used;
+
+    if (need > out->size) {
+        unsigned char *tmp = (unsigned char *)realloc(out->data, need);
+        if (! tmp) {
+            errorf("unable to keep unwritten log records, %ld bytes dropped\n",
+                   out->used);
+            appended -= out->used;
+            out->used = 0;
+            spare = out;
+            return;
+        }
+        out->data = tmp;
+        out->size = need;
+    }
+    memcpy(out->data + out->used, cur->data, cur->used);
+    out->used = need;
+    cur->used = 0;
+    spare = cur;
+    cur = out;
+}
+
+/*
+ * write everything appended so far to the log, syncing it if `sync' is
+ * set; must be called with the mutex held, which is given up while
+ * writing
+ *
+ * if the write fails, the log is cut back to the end of the last good
+ * write and the records are kept for the next one
+ *
+ * returns 1 if everything appended so far was written, 0 if not
+ */
+static int flush(int sync) {
+    unsigned long long target = appended, upto;
+    Buffer *out;
+    int ok;
+
+    while (written < target) {
+        if (writing) {		/* wait, then see if we were covered */
+            (void) pthread_cond_wait(&done, &mutex);
+            continue;
+        }
+        writing = 1;
+        out = cur;
+        cur = spare;
+        upto = appended;
+        (void) pthread_mutex_unlock(&mutex);
+        ok = write_all(out->data, out->used);
+        if (ok && sync)
+            ok = (fsync(fd) == 0);
+        if (! ok) {
+            errorf("unable to write log %s: %s\n", wal_file, strerror(errno));
+            if (ftruncate(fd, (off_t)written) != 0 ||
+                    lseek(fd, (off_t)written, SEEK_SET) != (off_t)written) {
+                errorf("unable to cut log %s back to %llu bytes\n",
+                       wal_file, written);
+            }
+        }
+        (void) pthread_mutex_lock(&mutex);
+        if (ok) {
+            out->used = 0;
+            spare = out;
+            written = upto;
+        } else
+            requeue(out);
+        writing = 0;
+        (void) pthread_cond_broadcast(&done);
+        if (! ok)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * thread that syncs the log every wal_millis milliseconds
+ */
+static void *do_flush(__attribute__ ((unused)) void *args) {
+    struct timespec interval;
+
+    interval.tv_sec = wal_millis / 1000;
+    interval.tv_nsec = (wal_millis % 1000) * 1000000L;
+    for (;;) {
+        (void) nanosleep(&interval, NULL);
+        (void) pthread_mutex_lock(&mutex);
+        (void) flush(1);
+        (void) pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+static long read_all(void *buf, long n) {
+    unsigned char *p = (unsigned char *)buf;
+    long got = 0;
+    ssize_t k;
+    while (got < n) {
+        if ((k = read(fd, p + got, n - got)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (k == 0)
+            break;
+        got += k;
+    }
+    return got;
+}
+
+/*
+ * split the payload of a record into fields and apply it
+ */
+static void apply_record(WalApply apply, unsigned char *payload, long len) {
+    char **fields;
+    int nfields = 0, i;
+    long j;
+
+    for (j = 1; j < len; j++)
+        if (payload[j] == '\0')
+            nfields++;
+    if (! (fields = (char **)malloc((nfields + 1) * sizeof(char *)))) {
+        errorf("unable to allocate fields for log record\n");
+        return;
+    }
+    for (i = 0, j = 1; i < nfields; i++) {
+        fields[i] = (char *)(payload + j);
+        j += strlen(fields[i]) + 1;
+    }
+    apply(payload[0], nfields, fields);
+    free(fields);
+}
+
+/*
+ * replay the log from offset `from', truncating it after the last intact
+ * record
+ *
+ * returns 1 if successful, 0 if not
+ */
+static int replay(WalApply apply, off_t from) {
+    struct header h;
+    unsigned char *payload = NULL;
+    long size = 0, n = 0;
+    off_t good, end;
+
+    end = lseek(fd, 0, SEEK_END);
+    if (from > end) {
+        errorf("log %s is shorter than the checkpoint expects, replaying all of it\n",
+               wal_file);
+        from = 0;
+    }
+    good = from;
+    replaying = 1;
+    (void) lseek(fd, from, SEEK_SET);
+    for (;;) {
+        if (read_all(&h, sizeof(h)) != sizeof(h))
+            break;
+        if (h.length == 0 || h.length > MAX_RECORD)
+            break;
+        if (h.length > size) {
+            unsigned char *tmp = (unsigned char *)realloc(payload, h.length);
+            if (! tmp)
+                break;
+            payload = tmp;
+            size = h.length;
+        }
+        if (read_all(payload, h.length) != h.length)
+            break;
+        if (checksum(payload, h.length) != h.checksum)
+            break;
+        if (h.length > 1 && payload[h.length - 1] != '\0')
+            break;
+        apply_record(apply, payload, h.length);
+        good += sizeof(h) + h.length;
+        n++;
+    }
+    replaying = 0;
+    free(payload);
+    if (n == 0 && from > 0 && good < end) {
+        errorf("log %s has no record at the checkpoint position, replaying all of it\n",
+               wal_file);
+        return replay(apply, 0);
+    }
+    debugf("replayed %ld records from log %s\n", n, wal_file);
+    if (end > good) {
+        errorf("log %s: discarding %lld bytes after last intact record\n",
+               wal_file, (long long)(end - good));
+        if (ftruncate(fd, good) != 0)
+            return 0;
+    }
+    appended = written = good;
+    return (lseek(fd, good, SEEK_SET) == good);
+}
+
+/*
+ * wal_configure() - log persistent tables to `file', syncing it according
+ * to `policy'; must be called before wal_init()
+ */
+void wal_configure(char *file, int policy, int millis) {
+    wal_file = file;
+    wal_policy = policy;
+    wal_millis = millis;
+}
+
+/*
+ * wal_init() - open the log, if one has been configured, and call `apply'
+ * for each record in it from position `from' on
+ *
+ * return 1 if successful, 0 if not
+ */
+int wal_init(WalApply apply, unsigned long long from) {
+    int i;
+
+    if (! wal_file)
+        return 1;
+    if ((fd = open(wal_file, O_RDWR | O_CREAT, 0644)) < 0) {
+        errorf("unable to open log %s: %s\n", wal_file, strerror(errno));
+        return 0;
+    }
+    if (! replay(apply, (off_t)from)) {
+        errorf("unable to recover log %s\n", wal_file);
+        close(fd);
+        fd = -1;
+        return 0;
+    }
+    for (i = 0; i < 2; i++) {
+        if (! (bufs[i].data = (unsigned char *)malloc(BUFFER_INITIAL))) {
+            errorf("unable to allocate log buffers\n");
+            return 0;
+        }
+        bufs[i].used = 0;
+        bufs[i].size = BUFFER_INITIAL;
+    }
+    if (wal_policy == WAL_SYNC_BATCH &&
+            pthread_create(&flusher, NULL, do_flush, NULL) != 0) {
+        errorf("unable to start log flusher\n");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * log the creation of persistent table `tb'
+ */
+void wal_create(Table *tb) {
+    char **fields, ncols[16], primary[16], *flags = NULL;
+    int i, n = 3 + 2 * tb->ncols;
+
+    if (fd < 0 || replaying || ! tb->name)
+        return;
+    if (! (fields = (char **)malloc((n + 1) * sizeof(char *))) ||
+            (tb->dict && ! (flags = (char *)malloc(tb->ncols + 1)))) {
+        errorf("unable to log creation of %s\n", tb->name);
+        free(fields);
+        return;
+    }
+    sprintf(ncols, "%d", tb->ncols);
+    sprintf(primary, "%d", tb->primary_column);
+    fields[0] = tb->name;
+    fields[1] = ncols;
+    fields[2] = primary;
+    for (i = 0; i < tb->ncols; i++) {
+        fields[3 + 2 * i] = tb->colname[i];
+        fields[4 + 2 * i] = (char *)primtype_name[*(tb->coltype[i])];
+    }
+    if (flags) {	/* which columns are dictionary-encoded */
+        for (i = 0; i < tb->ncols; i++)
+            flags[i] = (tb->dict[i]) ? '1' : '0';
+        flags[i] = '\0';
+        fields[n++] = flags;
+    }
+    append(WAL_CREATE, n, fields);
+    free(fields);
+    free(flags);
+}
+
+/*
+ * log that the row `vals' stamped `ts' has been put into `tb', replacing
+ * any row with the same key
+ */
+void wal_put(Table *tb, tstamp_t ts, int ncols, char *vals[]) {
+    char **fields, stamp[32];
+    int i;
+
+    if (fd < 0 || replaying || ! tb->name)
+        return;
+    if (! (fields = (char **)malloc((ncols + 2) * sizeof(char *)))) {
+        errorf("unable to log row of %s\n", tb->name);
+        return;
+    }
+    sprintf(stamp, "%llu", (unsigned long long)ts);
+    fields[0] = tb->name;
+    fields[1] = stamp;
+    for (i = 0; i < ncols; i++)
+        fields[i + 2] = vals[i];
+    append(WAL_PUT, ncols + 2, fields);
+    free(fields);
+}
+
+/*
+ * log that the row with key `key' has been deleted from `tb'
+ */
+void wal_delete(Table *tb, char *key) {
+    char *fields[2];
+
+    if (fd < 0 || replaying || ! tb->name)
+        return;
+    fields[0] = tb->name;
+    fields[1] = key;
+    append(WAL_DELETE, 2, fields);
+}
+
+/*
+ * wal_position() - return the position in the log after the last record
+ * appended; a checkpoint that holds every change logged before it is
+ * loaded with the log replayed from that position
+ */
+unsigned long long wal_position(void) {
+    unsigned long long pos;
+    (void) pthread_mutex_lock(&mutex);
+    pos = appended;
+    (void) pthread_mutex_unlock(&mutex);
+    return pos;
+}
+
+/*
+ * wal_commit() - make the records logged so far as durable as the policy
+ * requires; with WAL_SYNC_BATCH, that is left to the flusher thread
+ *
+ * returns 1 if successful, 0 if the records could not be written
+ */
+int wal_commit(void) {
+    int ok;
+
+    if (fd < 0 || replaying || wal_policy == WAL_SYNC_BATCH)
+        return 1;
+    (void) pthread_mutex_lock(&mutex);
+    ok = flush(wal_policy == WAL_SYNC_ALWAYS);
+    (void) pthread_mutex_unlock(&mutex);
+    return ok;
+}
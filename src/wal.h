@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * wal.h - write-ahead log for persistent tables
+ */
+#ifndef _WAL_H_
+#define _WAL_H_
+
+#include "table.h"
+#include "timestamp.h"
+
+/*
+ * when appended records are forced to disk
+ */
+#define WAL_SYNC_ALWAYS 0	/* before each mutation is acknowledged */
+#define WAL_SYNC_BATCH 1	/* every so many milliseconds */
+#define WAL_SYNC_OFF 2		/* never; records are only written */
+
+/*
+ * types of log records
+ */
+#define WAL_CREATE 'C'		/* name, ncols, primary, {colname, type}
+				   and, if any column is dictionary-encoded,
+				   a '0' or '1' for each column */
+#define WAL_PUT 'P'		/* name, tstamp, values */
+#define WAL_DELETE 'D'		/* name, key */
+
+/*
+ * called for each record found in the log at startup
+ */
+typedef void (*WalApply)(int type, int nfields, char **fields);
+
+void wal_configure(char *file, int policy, int millis);
+int wal_init(WalApply apply, unsigned long long from);
+
+void wal_create(Table *tb);
+void wal_put(Table *tb, tstamp_t ts, int ncols, char *vals[]);
+void wal_delete(Table *tb, char *key);
+int wal_commit(void);
+unsigned long long wal_position(void);
+
+#endif /* _WAL_H_ */